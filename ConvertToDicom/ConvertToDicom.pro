@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -38,7 +38,27 @@ SOURCES += main.cpp\
     dicomdictionaryinterface.cpp \
     dicomparametersreader.cpp \
     imageinfo.cpp \
-    fileutils.cpp
+    fileutils.cpp \
+    parallel.cpp \
+    slicequeue.cpp \
+    conversionprogress.cpp \
+    batchconverter.cpp \
+    conversionjob.cpp \
+    sliceview.cpp \
+    imageprobe.cpp \
+    imageheader.cpp \
+    headerindex.cpp \
+    hotfolderconverter.cpp \
+    mappedfile.cpp \
+    rescale.cpp \
+    slicedictionary.cpp \
+    stringarena.cpp \
+    uidgenerator.cpp \
+    seriesgeometry.cpp \
+    dicomslicetemplate.cpp \
+    multiframewriter.cpp \
+    pixelcodec.cpp \
+    outputsink.cpp
 
 HEADERS += mainwindow.h \
     seriesinfo.h \
@@ -54,7 +74,27 @@ HEADERS += mainwindow.h \
     dicomparametersreader.h \
     itktypedefs.h \
     imageinfo.h \
-    fileutils.h
+    fileutils.h \
+    parallel.h \
+    slicequeue.h \
+    conversionprogress.h \
+    batchconverter.h \
+    conversionjob.h \
+    sliceview.h \
+    imageprobe.h \
+    imageheader.h \
+    headerindex.h \
+    hotfolderconverter.h \
+    mappedfile.h \
+    rescale.h \
+    slicedictionary.h \
+    stringarena.h \
+    uidgenerator.h \
+    seriesgeometry.h \
+    dicomslicetemplate.h \
+    multiframewriter.h \
+    pixelcodec.h \
+    outputsink.h
 
 # Precompile the ITK headers
 CONFIG += precompile_header
@@ -0,0 +1,506 @@
+//
+//  batchconverter.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "batchconverter.h"
+#include "seriesinfo.h"
+#include "seriesconverter.h"
+#include "conversionprogress.h"
+#include "conversionjob.h"
+#include "parallel.h"
+#include "hotfolderconverter.h"
+#include "uidgenerator.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+
+#include <algorithm>
+#include <string>
+
+// Options controlling the batch.
+static const char* BatchOption = "batch";
+static const char* ManifestOption = "manifest";
+static const char* OutputOption = "output";
+static const char* JobsOption = "jobs";
+static const char* ThreadsOption = "threads";
+static const char* SummaryOption = "summary";
+static const char* OverwriteOption = "overwrite";
+static const char* StreamOption = "stream";
+static const char* SlicesInFlightOption = "slices-in-flight";
+static const char* WatchOption = "watch";
+static const char* ExpectOption = "expect";
+static const char* SettleOption = "settle";
+static const char* UidRootOption = "uid-root";
+static const char* MultiFrameOption = "multi-frame";
+static const char* CompressionOption = "compression";
+static const char* MinCompressionRateOption = "min-compression-rate";
+static const char* OutputFormatOption = "output-format";
+
+// Options setting the DICOM attributes. These override the saved settings.
+static const char* PatientNameOption = "patient-name";
+static const char* PatientIDOption = "patient-id";
+static const char* PatientDOBOption = "patient-dob";
+static const char* PatientSexOption = "patient-sex";
+static const char* StudyDescriptionOption = "study-description";
+static const char* StudyIDOption = "study-id";
+static const char* StudyModalityOption = "study-modality";
+static const char* StudyDateTimeOption = "study-date-time";
+static const char* StudyInstanceUIDOption = "study-uid";
+static const char* SeriesNumberOption = "series-number";
+static const char* SeriesDescriptionOption = "series-description";
+static const char* SeriesPatientPositionOption = "patient-position";
+static const char* SeriesTimeIncrementOption = "time-increment";
+
+BatchConverter::BatchConverter()
+    : logger(Logger::getInstance(std::string(LOGGER_NAME) + ".BatchConverter"))
+{
+}
+
+bool BatchConverter::isBatchMode(int argc, char* argv[])
+{
+    std::string batchArg = std::string("--") + BatchOption;
+    for (int idx = 1; idx < argc; ++idx)
+    {
+        if (batchArg == argv[idx])
+            return true;
+    }
+
+    return false;
+}
+
+void BatchConverter::addOptions()
+{
+    parser.setApplicationDescription("Converts image series to DICOM without a GUI.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("directories", "Directories containing the series to convert.",
+                                 "[directories...]");
+
+    parser.addOption(QCommandLineOption(BatchOption, "Run without a GUI."));
+    parser.addOption(QCommandLineOption(ManifestOption,
+                                        "File listing the directories to convert, one per line.",
+                                        "file"));
+    parser.addOption(QCommandLineOption(OutputOption, "Base output directory.", "directory"));
+    parser.addOption(QCommandLineOption(JobsOption, "Number of series converted at once.", "count"));
+    parser.addOption(QCommandLineOption(ThreadsOption,
+                                        "Total number of worker threads shared by all jobs.", "count"));
+    parser.addOption(QCommandLineOption(SummaryOption, "Write the job results to this CSV file.",
+                                        "file"));
+    parser.addOption(QCommandLineOption(OverwriteOption, "Overwrite files in the output directories."));
+    parser.addOption(QCommandLineOption(StreamOption, "Write slices while the series is being read."));
+    parser.addOption(QCommandLineOption(SlicesInFlightOption,
+                                        "When streaming, the maximum number of slices queued.", "count"));
+    parser.addOption(QCommandLineOption(WatchOption,
+                                        "Convert the files in the one directory given as they arrive."));
+    parser.addOption(QCommandLineOption(ExpectOption,
+                                        "When watching, the number of files in the complete series.", "count"));
+    parser.addOption(QCommandLineOption(SettleOption,
+                                        "When watching, the series is complete when no file has arrived "
+                                        "for this long. Default 10.", "seconds"));
+    parser.addOption(QCommandLineOption(UidRootOption,
+                                        "Organisation's root for the UIDs made, instead of the saved one.", "root"));
+    parser.addOption(QCommandLineOption(MultiFrameOption,
+                                        "Write each series as a single multi-frame file."));
+    parser.addOption(QCommandLineOption(CompressionOption,
+                                        "Lossless compression of the pixels: none, rle, jpeg-ls, jpeg2000 "
+                                        "or auto, which tries each on a few slices of the series.",
+                                        "codec"));
+    parser.addOption(QCommandLineOption(MinCompressionRateOption,
+                                        "With auto compression, the slowest a codec may compress in one "
+                                        "thread and still be chosen. Default 50.", "MB/s"));
+    parser.addOption(QCommandLineOption(OutputFormatOption,
+                                        "How the DICOM files of each series are written: files, or streamed "
+                                        "into one tar or zip archive in the output directory. Watching writes "
+                                        "files.", "format"));
+
+    parser.addOption(QCommandLineOption(PatientNameOption, "Patient's name.", "name"));
+    parser.addOption(QCommandLineOption(PatientIDOption, "Patient ID.", "id"));
+    parser.addOption(QCommandLineOption(PatientDOBOption, "Patient's birth date (yyyy-mm-dd).", "date"));
+    parser.addOption(QCommandLineOption(PatientSexOption, "Patient's sex.", "sex"));
+    parser.addOption(QCommandLineOption(StudyDescriptionOption, "Study description.", "text"));
+    parser.addOption(QCommandLineOption(StudyIDOption, "Study ID.", "id"));
+    parser.addOption(QCommandLineOption(StudyModalityOption, "Modality.", "modality"));
+    parser.addOption(QCommandLineOption(StudyDateTimeOption,
+                                        "Study date and time (yyyy-mm-ddThh:mm:ss).", "datetime"));
+    parser.addOption(QCommandLineOption(StudyInstanceUIDOption, "Study instance UID.", "uid"));
+    parser.addOption(QCommandLineOption(SeriesNumberOption,
+                                        "Series number of the first series. Later ones are numbered "
+                                        "consecutively unless the manifest says otherwise.", "number"));
+    parser.addOption(QCommandLineOption(SeriesDescriptionOption,
+                                        "Series description. Defaults to the directory name.", "text"));
+    parser.addOption(QCommandLineOption(SeriesPatientPositionOption, "Patient position.", "position"));
+    parser.addOption(QCommandLineOption(SeriesTimeIncrementOption,
+                                        "Time between images in seconds.", "seconds"));
+}
+
+int BatchConverter::run(const QStringList& arguments)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    QTextStream err(stderr);
+
+    addOptions();
+    if (!parser.parse(arguments))
+    {
+        err << parser.errorText() << "\n";
+        return 2;
+    }
+
+    if (parser.isSet("help"))
+    {
+        QTextStream(stdout) << parser.helpText();
+        return 0;
+    }
+
+    if (!parser.isSet(OutputOption))
+    {
+        err << "The --" << OutputOption << " option is required.\n";
+        return 2;
+    }
+
+    if (parser.isSet(UidRootOption) && !UidGenerator::setRoot(parser.value(UidRootOption).toStdString()))
+    {
+        err << "The --" << UidRootOption << " option is not a valid UID root.\n";
+        return 2;
+    }
+
+    Compression compression = Compression::NONE;
+    if (parser.isSet(CompressionOption) && !CompressionFromName(parser.value(CompressionOption), compression))
+    {
+        err << "The --" << CompressionOption << " option is not a known compression.\n";
+        return 2;
+    }
+
+    OutputFormat outputFormat = OutputFormat::FILES;
+    if (parser.isSet(OutputFormatOption) && !OutputFormatFromName(parser.value(OutputFormatOption), outputFormat))
+    {
+        err << "The --" << OutputFormatOption << " option is not a known output format.\n";
+        return 2;
+    }
+
+    // The command line overrides the saved settings. Nothing is saved back.
+    settings.loadSettings();
+    applyAttributes(&settings);
+
+    if (!loadJobs())
+    {
+        err << "No input directories given.\n";
+        return 2;
+    }
+
+    if (parser.isSet(WatchOption))
+    {
+        if (jobs.size() != 1)
+        {
+            err << "The --" << WatchOption << " option takes exactly one directory.\n";
+            return 2;
+        }
+
+        // The files are written again when the series is complete, which an archive cannot be.
+        if (outputFormat != OutputFormat::FILES)
+        {
+            err << "The --" << WatchOption << " option writes files, not a "
+                << OutputFormatName(outputFormat) << " archive.\n";
+            return 2;
+        }
+
+        runWatch(jobs[0]);
+        reportResults();
+        return (jobs[0].result == ErrorCode::SUCCESS) ? 0 : 1;
+    }
+
+    // Share the thread budget between the jobs running at once.
+    int totalThreads = EffectiveThreadCount(parser.value(ThreadsOption).toInt());
+    int concurrentJobs = parser.isSet(JobsOption) ? parser.value(JobsOption).toInt()
+                                                  : std::max(1, totalThreads / 4);
+    concurrentJobs = std::max(1, std::min(concurrentJobs, jobs.size()));
+    int threadsPerJob = std::max(1, totalThreads / concurrentJobs);
+
+    LOG4CPLUS_INFO(logger, "Converting " << jobs.size() << " series, " << concurrentJobs
+                   << " at a time with " << threadsPerJob << " threads each.");
+
+    Job* jobData = jobs.data();
+    ParallelFor(jobs.size(), concurrentJobs, [this, jobData, threadsPerJob](int jobIdx)
+    {
+        runJob(jobData[jobIdx], threadsPerJob);
+    });
+
+    reportResults();
+
+    for (int idx = 0; idx < jobs.size(); ++idx)
+    {
+        if (jobs[idx].result != ErrorCode::SUCCESS)
+            return 1;
+    }
+
+    return 0;
+}
+
+bool BatchConverter::loadJobs()
+{
+    jobs.clear();
+
+    if (parser.isSet(ManifestOption) && !loadManifest(parser.value(ManifestOption)))
+        return false;
+
+    QStringList dirs = parser.positionalArguments();
+    for (int idx = 0; idx < dirs.size(); ++idx)
+    {
+        Job job;
+        job.inputDir = dirs[idx];
+        job.seriesNumber = -1;
+        jobs.append(job);
+    }
+
+    // Fill in the series numbers and descriptions which were not given in the manifest.
+    int seriesNumber = settings.seriesNumber();
+    for (int idx = 0; idx < jobs.size(); ++idx)
+    {
+        Job& job = jobs[idx];
+        if (job.seriesNumber < 0)
+            job.seriesNumber = seriesNumber + idx;
+
+        if (job.seriesDescription.isEmpty())
+        {
+            job.seriesDescription = settings.seriesDescription();
+            if (job.seriesDescription.isEmpty())
+                job.seriesDescription = QDir(job.inputDir).dirName();
+        }
+
+        job.result = ErrorCode::ERROR;
+        job.numberOfSlices = 0;
+        job.seconds = 0.0;
+        job.rawPixelBytes = 0;
+        job.storedPixelBytes = 0;
+        job.compressionNanoseconds = 0;
+    }
+
+    return !jobs.isEmpty();
+}
+
+bool BatchConverter::loadManifest(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        LOG4CPLUS_ERROR(logger, "Could not open manifest: " << path.toStdString());
+        return false;
+    }
+
+    QTextStream stream(&file);
+    while (!stream.atEnd())
+    {
+        QString line = stream.readLine();
+        if (line.trimmed().isEmpty() || line.trimmed().startsWith('#'))
+            continue;
+
+        QStringList fields = line.split('\t');
+
+        Job job;
+        job.inputDir = fields[0].trimmed();
+        job.seriesNumber = -1;
+        if (fields.size() > 1 && !fields[1].trimmed().isEmpty())
+            job.seriesNumber = fields[1].trimmed().toInt();
+        if (fields.size() > 2)
+            job.seriesDescription = fields[2].trimmed();
+
+        jobs.append(job);
+    }
+
+    LOG4CPLUS_INFO(logger, "Read " << jobs.size() << " directories from manifest " << path.toStdString());
+    return true;
+}
+
+void BatchConverter::applyAttributes(SeriesInfo* info) const
+{
+    if (parser.isSet(OutputOption))
+        info->setOutputDir(QDir(parser.value(OutputOption)));
+    if (parser.isSet(OverwriteOption))
+        info->setOverwriteFiles(true);
+    if (parser.isSet(StreamOption))
+        info->setStreamSlices(true);
+    if (parser.isSet(SlicesInFlightOption))
+        info->setMaxSlicesInFlight(parser.value(SlicesInFlightOption).toInt());
+    if (parser.isSet(MultiFrameOption))
+        info->setMultiFrame(true);
+
+    Compression compression;
+    if (parser.isSet(CompressionOption) && CompressionFromName(parser.value(CompressionOption), compression))
+        info->setCompression(compression);
+    if (parser.isSet(MinCompressionRateOption))
+        info->setMinCompressionRate(parser.value(MinCompressionRateOption).toDouble());
+
+    OutputFormat outputFormat;
+    if (parser.isSet(OutputFormatOption) && OutputFormatFromName(parser.value(OutputFormatOption), outputFormat))
+        info->setOutputFormat(outputFormat);
+    if (parser.isSet(ThreadsOption))
+        info->setNumberOfThreads(parser.value(ThreadsOption).toInt());
+
+    if (parser.isSet(PatientNameOption))
+        info->setPatientName(parser.value(PatientNameOption));
+    if (parser.isSet(PatientIDOption))
+        info->setPatientID(parser.value(PatientIDOption));
+    if (parser.isSet(PatientDOBOption))
+        info->setPatientDOB(QDate::fromString(parser.value(PatientDOBOption), Qt::ISODate));
+    if (parser.isSet(PatientSexOption))
+        info->setPatientSex(parser.value(PatientSexOption));
+
+    if (parser.isSet(StudyDescriptionOption))
+        info->setStudyDescription(parser.value(StudyDescriptionOption));
+    if (parser.isSet(StudyIDOption))
+        info->setStudyID(parser.value(StudyIDOption));
+    if (parser.isSet(StudyModalityOption))
+        info->setStudyModality(parser.value(StudyModalityOption));
+    if (parser.isSet(StudyDateTimeOption))
+        info->setStudyDateTime(QDateTime::fromString(parser.value(StudyDateTimeOption), Qt::ISODate));
+    if (parser.isSet(StudyInstanceUIDOption))
+        info->setStudyInstanceUID(parser.value(StudyInstanceUIDOption));
+
+    if (parser.isSet(SeriesNumberOption))
+        info->setSeriesNumber(parser.value(SeriesNumberOption).toInt());
+    if (parser.isSet(SeriesDescriptionOption))
+        info->setSeriesDescription(parser.value(SeriesDescriptionOption));
+    if (parser.isSet(SeriesPatientPositionOption))
+        info->setSeriesPositionPatient(parser.value(SeriesPatientPositionOption));
+    if (parser.isSet(SeriesTimeIncrementOption))
+        info->setSeriesTimeIncrement(parser.value(SeriesTimeIncrementOption).toDouble());
+}
+
+void BatchConverter::runJob(Job& job, int threadsPerJob)
+{
+    LOG4CPLUS_INFO(logger, "Starting job for " << job.inputDir.toStdString());
+
+    QElapsedTimer timer;
+    timer.start();
+
+    SeriesInfo seriesInfo(settings);
+    seriesInfo.setInputDir(QDir(job.inputDir));
+    seriesInfo.setSeriesNumber(job.seriesNumber);
+    seriesInfo.setSeriesDescription(job.seriesDescription);
+    seriesInfo.setNumberOfThreads(threadsPerJob);
+
+    SeriesConverter converter(&seriesInfo);
+    converter.setInputDir(seriesInfo.inputDir());
+
+    ErrorCode errCode = converter.extractImageParameters();
+    if (errCode == ErrorCode::SUCCESS)
+    {
+        errCode = converter.makeFullOutputPathDir(seriesInfo.outputDirStr());
+        if ((errCode == ErrorCode::ERROR_DIRECTORY_NOT_EMPTY) && seriesInfo.overwriteFiles())
+            errCode = ErrorCode::SUCCESS;
+    }
+
+    ConversionProgress progress;
+    if (errCode == ErrorCode::SUCCESS)
+    {
+        ConversionJob conversionJob(seriesInfo, &progress);
+        errCode = converter.convertFiles(conversionJob);
+    }
+
+    job.result = errCode;
+    job.numberOfSlices = progress.slicesWritten();
+    job.outputPath = seriesInfo.outputPath();
+    job.seconds = timer.elapsed() / 1000.0;
+    job.rawPixelBytes = progress.rawPixelBytes();
+    job.storedPixelBytes = progress.storedPixelBytes();
+    job.compressionNanoseconds = progress.compressionNanoseconds();
+
+    LOG4CPLUS_INFO(logger, "Finished job for " << job.inputDir.toStdString() << ": "
+                   << ErrorCodeAsString(job.result));
+}
+
+void BatchConverter::runWatch(Job& job)
+{
+    LOG4CPLUS_INFO(logger, "Watching " << job.inputDir.toStdString());
+
+    QElapsedTimer timer;
+    timer.start();
+
+    SeriesInfo seriesInfo(settings);
+    seriesInfo.setInputDir(QDir(job.inputDir));
+    seriesInfo.setSeriesNumber(job.seriesNumber);
+    seriesInfo.setSeriesDescription(job.seriesDescription);
+
+    HotFolderConverter converter(seriesInfo);
+    converter.setExpectedFiles(parser.value(ExpectOption).toInt());
+    if (parser.isSet(SettleOption))
+        converter.setSettleTime(int(parser.value(SettleOption).toDouble() * 1000.0));
+
+    job.result = converter.run();
+    job.numberOfSlices = converter.slicesWritten();
+    job.outputPath = converter.outputPath();
+    job.seconds = timer.elapsed() / 1000.0;
+    job.rawPixelBytes = converter.conversionProgress().rawPixelBytes();
+    job.storedPixelBytes = converter.conversionProgress().storedPixelBytes();
+    job.compressionNanoseconds = converter.conversionProgress().compressionNanoseconds();
+}
+
+void BatchConverter::reportResults()
+{
+    QTextStream out(stdout);
+
+    int numFailed = 0;
+    qint64 rawPixelBytes = 0;
+    qint64 storedPixelBytes = 0;
+    qint64 compressionNanoseconds = 0;
+    out << "Status\tSlices\tSeconds\tInput\tOutput\n";
+    for (int idx = 0; idx < jobs.size(); ++idx)
+    {
+        const Job& job = jobs[idx];
+        if (job.result != ErrorCode::SUCCESS)
+            ++numFailed;
+        rawPixelBytes += job.rawPixelBytes;
+        storedPixelBytes += job.storedPixelBytes;
+        compressionNanoseconds += job.compressionNanoseconds;
+
+        out << ErrorCodeAsString(job.result) << "\t" << job.numberOfSlices << "\t"
+            << QString::number(job.seconds, 'f', 2) << "\t" << job.inputDir << "\t"
+            << job.outputPath << "\n";
+    }
+    out << jobs.size() - numFailed << " of " << jobs.size() << " series converted.\n";
+    if (settings.compression() != Compression::NONE)
+        out << QString::fromStdString(CompressionReport(settings.compression(), rawPixelBytes,
+                                                        storedPixelBytes, compressionNanoseconds)) << "\n";
+    out.flush();
+
+    if (!parser.isSet(SummaryOption))
+        return;
+
+    QFile file(parser.value(SummaryOption));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        LOG4CPLUS_ERROR(logger, "Could not write summary: " << parser.value(SummaryOption).toStdString());
+        return;
+    }
+
+    // Quote the text fields so that commas in paths do no harm.
+    QTextStream csv(&file);
+    csv << "input,series_number,status,slices,seconds,output,pixel_bytes,stored_bytes,compress_seconds\n";
+    for (int idx = 0; idx < jobs.size(); ++idx)
+    {
+        const Job& job = jobs[idx];
+        csv << "\"" << job.inputDir << "\"," << job.seriesNumber << ","
+            << ErrorCodeAsString(job.result) << "," << job.numberOfSlices << ","
+            << QString::number(job.seconds, 'f', 2) << ",\"" << job.outputPath << "\","
+            << job.rawPixelBytes << "," << job.storedPixelBytes << ","
+            << QString::number(job.compressionNanoseconds / 1.0e9, 'f', 3) << "\n";
+    }
+}
@@ -0,0 +1,136 @@
+//
+//  batchconverter.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BATCHCONVERTER_H
+#define BATCHCONVERTER_H
+
+#include "errorcodes.h"
+#include "logger.h"
+#include "seriesinfo.h"
+
+#include <QCommandLineParser>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * Converts many series without a GUI. The input directories are given on the command line
+ * or in a manifest file. The DICOM attributes come from the saved settings, as in the GUI,
+ * and may be overridden with command line options. Up to --jobs series are converted at
+ * once and the --threads worker threads are shared between them. A summary of the result
+ * of each job is printed when all are done.
+ *
+ * With --watch a single directory is converted while its files are still arriving.
+ *
+ * All of the jobs run in this process. Each has its own copy of the settings and its own
+ * ConversionJob so they do not interfere with each other.
+ */
+class BatchConverter
+{
+public:
+    /**
+     * Default constructor.
+     */
+    BatchConverter();
+
+    /**
+     * Determine whether the program has been asked to run without a GUI.
+     * @param argc The argument count passed to main().
+     * @param argv The arguments passed to main().
+     * @return true if --batch is among the arguments.
+     */
+    static bool isBatchMode(int argc, char* argv[]);
+
+    /**
+     * Parse the arguments and do the conversions.
+     * @param arguments The command line arguments, as from QCoreApplication::arguments().
+     * @return The exit code for the program. 0 if all jobs succeeded.
+     */
+    int run(const QStringList& arguments);
+
+private:
+    /** One series to convert and the result of converting it. */
+    struct Job
+    {
+        QString inputDir;          ///< Directory containing the images.
+        int seriesNumber;          ///< Series number given to this series.
+        QString seriesDescription; ///< Series description given to this series.
+        ErrorCode result;          ///< How the conversion went.
+        int numberOfSlices;        ///< Number of slices written.
+        double seconds;            ///< Wall time taken.
+        qint64 rawPixelBytes;      ///< Pixel bytes before compression.
+        qint64 storedPixelBytes;   ///< Pixel bytes written.
+        qint64 compressionNanoseconds; ///< Time spent compressing, summed over the threads.
+        QString outputPath;        ///< Where the DICOM files went.
+    };
+
+    /**
+     * Set up the command line options.
+     */
+    void addOptions();
+
+    /**
+     * Build the job list from the positional arguments and the manifest.
+     * @return true if there is at least one job.
+     */
+    bool loadJobs();
+
+    /**
+     * Read a manifest. Each line holds an input directory, optionally followed by a tab and
+     * a series number and another tab and a series description. Blank lines and lines
+     * starting with # are ignored.
+     * @param path The path of the manifest.
+     * @return true if the manifest was read.
+     */
+    bool loadManifest(const QString& path);
+
+    /**
+     * Put the attribute options given on the command line into a SeriesInfo instance.
+     * @param info The instance to modify.
+     */
+    void applyAttributes(SeriesInfo* info) const;
+
+    /**
+     * Convert one series. This is called from several threads at once.
+     * @param job The job. Its results are filled in.
+     * @param threadsPerJob The number of worker threads the job may use.
+     */
+    void runJob(Job& job, int threadsPerJob);
+
+    /**
+     * Convert one series as its files arrive. See HotFolderConverter.
+     * @param job The job. Its results are filled in.
+     */
+    void runWatch(Job& job);
+
+    /**
+     * Print the result of each job to stdout and, if --summary was given, to a CSV file.
+     */
+    void reportResults();
+
+    QCommandLineParser parser; ///< The command line.
+    SeriesInfo settings;       ///< The saved settings with the command line options applied.
+    QVector<Job> jobs;         ///< The series to convert.
+
+    Logger logger;             ///< Logger for this class.
+};
+
+#endif // BATCHCONVERTER_H
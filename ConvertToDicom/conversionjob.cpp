@@ -0,0 +1,53 @@
+//
+//  conversionjob.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "conversionjob.h"
+
+ConversionJob::ConversionJob(const SeriesInfo& seriesInfo, ConversionProgress* progress)
+    : m_seriesInfo(withDefaults(seriesInfo)),
+      m_progress(progress),
+      m_numberOfImages(m_seriesInfo.imageNumberOfImages()),
+      m_slicesPerImage(m_seriesInfo.imageSlicesPerImage()),
+      m_numberOfSlices(m_seriesInfo.imageNumberOfSlices()),
+      m_isRescaled(false),
+      m_seriesDictionary(m_seriesInfo.metaDataDictionary(m_uids))
+{
+}
+
+void ConversionJob::setImageCounts(int numberOfImages, int slicesPerImage, int numberOfSlices)
+{
+    m_numberOfImages = numberOfImages;
+    m_slicesPerImage = slicesPerImage;
+    m_numberOfSlices = numberOfSlices;
+}
+
+SeriesInfo ConversionJob::withDefaults(const SeriesInfo& seriesInfo)
+{
+    SeriesInfo info(seriesInfo);
+
+    if (info.imageSliceSpacing() == 0.0)
+        info.setImageSliceSpacing(1.0);
+
+    if (info.imagePatientOrientation() == "")
+        info.setImagePatientOrientation("1\\0\\0\\0\\1\\0");
+
+    return info;
+}
@@ -0,0 +1,200 @@
+//
+//  conversionjob.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CONVERSIONJOB_H
+#define CONVERSIONJOB_H
+
+#include "seriesinfo.h"
+#include "imageheader.h"
+#include "rescale.h"
+#include "uidgenerator.h"
+
+#include "itkheaders.pch.h"
+
+#include <QList>
+#include <QTime>
+#include <QVector>
+
+class ConversionProgress;
+
+/**
+ * Everything needed to convert one series. The settings are a copy of a SeriesInfo taken
+ * when the job is made and do not change afterwards. The rest is the state which the
+ * conversion builds up as it goes: the image counts found in the files, the acquisition
+ * times and the series level DICOM attributes. A job is passed explicitly to the
+ * SeriesConverter and the DicomSeriesWriter, so each series being converted at the same
+ * time has its own.
+ */
+class ConversionJob
+{
+public:
+    /**
+     * Class constructor. The series level metadata, including the new series UID, are made here.
+     * @param seriesInfo The settings to use. A copy is kept. Defaults are filled in for the
+     * slice spacing and orientation if they have not been set.
+     * @param progress The record of progress for this job. May be null.
+     */
+    explicit ConversionJob(const SeriesInfo& seriesInfo, ConversionProgress* progress = 0);
+
+    /**
+     * Get the settings for this job.
+     * @return The SeriesInfo copied when the job was made.
+     */
+    const SeriesInfo& seriesInfo() const
+    {
+        return m_seriesInfo;
+    }
+
+    /**
+     * Get the record of progress.
+     * @return Pointer to the ConversionProgress. May be null.
+     */
+    ConversionProgress* progress() const
+    {
+        return m_progress;
+    }
+
+    int numberOfImages() const
+    {
+        return m_numberOfImages;
+    }
+
+    int slicesPerImage() const
+    {
+        return m_slicesPerImage;
+    }
+
+    int numberOfSlices() const
+    {
+        return m_numberOfSlices;
+    }
+
+    /**
+     * Set the image counts found when reading the files.
+     * @param numberOfImages The number of image files.
+     * @param slicesPerImage The number of slices in each image file.
+     * @param numberOfSlices The total number of slices.
+     */
+    void setImageCounts(int numberOfImages, int slicesPerImage, int numberOfSlices);
+
+    /**
+     * Get the acquisition time of each image.
+     * @return Reference to the list of times.
+     */
+    QList<QTime>& acqTimes()
+    {
+        return m_acqTimes;
+    }
+
+    const QList<QTime>& acqTimes() const
+    {
+        return m_acqTimes;
+    }
+
+    /**
+     * Get the header of each input file, in file order. These are read once when the files
+     * are checked for consistency so later stages need not read them again.
+     * @return The headers. Empty if the files have not been checked.
+     */
+    const QVector<ImageHeader>& fileHeaders() const
+    {
+        return m_fileHeaders;
+    }
+
+    /**
+     * Set the header of each input file.
+     * @param headers The headers in file order.
+     */
+    void setFileHeaders(const QVector<ImageHeader>& headers)
+    {
+        m_fileHeaders = headers;
+    }
+
+    /**
+     * Find out whether the slices are rescaled from floating point before they are written.
+     * @return true if rescale() applies.
+     */
+    bool isRescaled() const
+    {
+        return m_isRescaled;
+    }
+
+    /**
+     * Get the rescale written as the Rescale Slope and Intercept of the images.
+     * @return The rescale. Only meaningful if isRescaled() is true.
+     */
+    const RescaleParameters& rescale() const
+    {
+        return m_rescale;
+    }
+
+    /**
+     * Set the rescale of the images written from here on.
+     * @param rescale The rescale found from the range of the pixels.
+     */
+    void setRescale(const RescaleParameters& rescale)
+    {
+        m_rescale = rescale;
+        m_isRescaled = true;
+    }
+
+    /**
+     * Get the generator of the job's UIDs. Its prefix is unique to the job so the writers
+     * can share it without contention.
+     * @return The generator. It may be used from several threads at once.
+     */
+    UidGenerator& uidGenerator() const
+    {
+        return m_uids;
+    }
+
+    /**
+     * Get the DICOM attributes common to every slice of the series.
+     * @return The dictionary made by the constructor.
+     */
+    const itk::MetaDataDictionary& seriesDictionary() const
+    {
+        return m_seriesDictionary;
+    }
+
+private:
+    /**
+     * Fill in the values a conversion cannot do without.
+     * @param seriesInfo The settings given to the constructor.
+     * @return A copy of seriesInfo with the defaults in place.
+     */
+    static SeriesInfo withDefaults(const SeriesInfo& seriesInfo);
+
+    const SeriesInfo m_seriesInfo;              ///< The settings. Never changed.
+    ConversionProgress* m_progress;             ///< Progress of the conversion. May be null.
+
+    int m_numberOfImages;                       ///< Number of image files.
+    int m_slicesPerImage;                       ///< Number of slices in each image file.
+    int m_numberOfSlices;                       ///< Total number of slices.
+    QList<QTime> m_acqTimes;                    ///< Acquisition time of each image.
+    QVector<ImageHeader> m_fileHeaders;         ///< Header of each input file.
+    bool m_isRescaled;                          ///< Whether the pixels are rescaled.
+    RescaleParameters m_rescale;                ///< Rescale of the stored pixels.
+    mutable UidGenerator m_uids;                ///< Makes the UIDs of the series and its slices.
+    itk::MetaDataDictionary m_seriesDictionary; ///< Attributes common to all slices.
+};
+
+#endif // CONVERSIONJOB_H
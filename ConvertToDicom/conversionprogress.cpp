@@ -0,0 +1,83 @@
+//
+//  conversionprogress.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "conversionprogress.h"
+
+ConversionProgress::ConversionProgress()
+    : m_numberOfFiles(0), m_filesRead(0), m_numberOfSlices(0), m_slicesWritten(0),
+      m_rawPixelBytes(0), m_storedPixelBytes(0), m_compressionNanoseconds(0), m_cancelled(0)
+{
+}
+
+void ConversionProgress::reset()
+{
+    m_numberOfFiles.store(0);
+    m_filesRead.store(0);
+    m_numberOfSlices.store(0);
+    m_slicesWritten.store(0);
+    m_rawPixelBytes.store(0);
+    m_storedPixelBytes.store(0);
+    m_compressionNanoseconds.store(0);
+    m_cancelled.store(0);
+}
+
+void ConversionProgress::setNumberOfFiles(int numberOfFiles)
+{
+    m_numberOfFiles.store(numberOfFiles);
+}
+
+void ConversionProgress::setNumberOfSlices(int numberOfSlices)
+{
+    m_numberOfSlices.store(numberOfSlices);
+}
+
+void ConversionProgress::fileRead()
+{
+    m_filesRead.fetchAndAddRelaxed(1);
+}
+
+void ConversionProgress::sliceWritten()
+{
+    m_slicesWritten.fetchAndAddRelaxed(1);
+}
+
+void ConversionProgress::pixelsCompressed(qint64 rawBytes, qint64 storedBytes, qint64 nanoseconds)
+{
+    m_rawPixelBytes.fetchAndAddRelaxed(rawBytes);
+    m_storedPixelBytes.fetchAndAddRelaxed(storedBytes);
+    m_compressionNanoseconds.fetchAndAddRelaxed(nanoseconds);
+}
+
+int ConversionProgress::percentDone() const
+{
+    int numFiles = numberOfFiles();
+    int numSlices = numberOfSlices();
+
+    double readFraction = numFiles > 0 ? double(filesRead()) / numFiles : 0.0;
+    double writeFraction = numSlices > 0 ? double(slicesWritten()) / numSlices : 0.0;
+
+    return int(50.0 * (readFraction + writeFraction));
+}
+
+void ConversionProgress::cancel()
+{
+    m_cancelled.store(1);
+}
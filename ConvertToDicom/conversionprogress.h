@@ -0,0 +1,152 @@
+//
+//  conversionprogress.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef CONVERSIONPROGRESS_H
+#define CONVERSIONPROGRESS_H
+
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+/**
+ * Thread safe record of how far a conversion has got, and a flag which asks it to stop.
+ * The conversion threads update the counters as each file is read and each slice is
+ * written. The GUI reads them on a timer so it is never updated more often than it
+ * needs to be, however fast the slices go by.
+ */
+class ConversionProgress
+{
+public:
+    /**
+     * Default constructor.
+     */
+    ConversionProgress();
+
+    /**
+     * Clear the counters and the cancel flag before a new conversion.
+     */
+    void reset();
+
+    /**
+     * Set the number of files which will be read.
+     * @param numberOfFiles The number of files.
+     */
+    void setNumberOfFiles(int numberOfFiles);
+
+    /**
+     * Set the number of slices which will be written.
+     * @param numberOfSlices The number of slices.
+     */
+    void setNumberOfSlices(int numberOfSlices);
+
+    /**
+     * Record that a file has been read.
+     */
+    void fileRead();
+
+    /**
+     * Record that a slice has been written.
+     */
+    void sliceWritten();
+
+    /**
+     * Record that the pixels of a slice have been compressed.
+     * @param rawBytes The size of the pixels before compression.
+     * @param storedBytes The size of the pixels after compression.
+     * @param nanoseconds The time it took.
+     */
+    void pixelsCompressed(qint64 rawBytes, qint64 storedBytes, qint64 nanoseconds);
+
+    int numberOfFiles() const
+    {
+        return m_numberOfFiles.load();
+    }
+
+    int filesRead() const
+    {
+        return m_filesRead.load();
+    }
+
+    int numberOfSlices() const
+    {
+        return m_numberOfSlices.load();
+    }
+
+    int slicesWritten() const
+    {
+        return m_slicesWritten.load();
+    }
+
+    qint64 rawPixelBytes() const
+    {
+        return m_rawPixelBytes.load();
+    }
+
+    qint64 storedPixelBytes() const
+    {
+        return m_storedPixelBytes.load();
+    }
+
+    qint64 compressionNanoseconds() const
+    {
+        return m_compressionNanoseconds.load();
+    }
+
+    /**
+     * Get the overall progress. Reading and writing each count for half.
+     * @return The percentage of the work done, 0 to 100.
+     */
+    int percentDone() const;
+
+    /**
+     * Ask the conversion to stop. The readers and writers check this before each slice.
+     */
+    void cancel();
+
+    /**
+     * @return true if cancel() has been called since the last reset().
+     */
+    bool isCancelled() const
+    {
+        return m_cancelled.load() != 0;
+    }
+
+private:
+    QAtomicInt m_numberOfFiles;
+    QAtomicInt m_filesRead;
+    QAtomicInt m_numberOfSlices;
+    QAtomicInt m_slicesWritten;
+    QAtomicInteger<qint64> m_rawPixelBytes;
+    QAtomicInteger<qint64> m_storedPixelBytes;
+    QAtomicInteger<qint64> m_compressionNanoseconds;
+    QAtomicInt m_cancelled;
+};
+
+/**
+ * Convenience function for code which may or may not have a ConversionProgress.
+ * @param progress Pointer to the ConversionProgress. May be null.
+ * @return true if progress is not null and the conversion has been cancelled.
+ */
+inline bool IsCancelled(const ConversionProgress* progress)
+{
+    return (progress != 0) && progress->isCancelled();
+}
+
+#endif // CONVERSIONPROGRESS_H
@@ -23,6 +23,7 @@
 #include "ui_dicomattributesdialog.h"
 #include "seriesinfo.h"
 #include "logger.h"
+#include "uidgenerator.h"
 
 #include "itkheaders.pch.h"
 
@@ -39,10 +40,10 @@ static QStringList positions = {"HFP", "HFS", "HFDR", "HFDL", "FFDR",
                                 "FFDL", "FFP", "FFS", "LFP", "LFS", "RFP",
                                 "RFS", "AFDR", "AFDL", "PFDR", "PFDL"};
 
-DicomAttributesDialog::DicomAttributesDialog(QWidget *parent) :
+DicomAttributesDialog::DicomAttributesDialog(SeriesInfo* seriesInfo, QWidget *parent) :
     QDialog(parent),
     ui(new Ui::DicomAttributesDialog),
-    seriesInfo(SeriesInfo::getInstance()),
+    seriesInfo(seriesInfo),
     logger(Logger::getInstance(std::string(LOGGER_NAME) + ".SeriesInfo"))
 {
     ui->setupUi(this);
@@ -300,8 +301,8 @@ void DicomAttributesDialog::handleStudyDateNowButtonClicked()
 
 void DicomAttributesDialog::handleStudyUIDGenerateButtonClicked()
 {
-    gdcm::UIDGenerator suid;
-    QString studyUID = suid.Generate();
+    UidGenerator suid;
+    QString studyUID = QString::fromStdString(suid.generate());
     seriesInfo->setStudyInstanceUID(studyUID);
     ui->studyInstanceUIDLineEdit->setText(studyUID);
 
@@ -38,7 +38,12 @@ class DicomAttributesDialog : public QDialog
     Q_OBJECT
 
 public:
-    explicit DicomAttributesDialog(QWidget *parent = 0);
+    /**
+     * Class constructor.
+     * @param seriesInfo The settings shown and edited by the dialog. Not owned by the dialog.
+     * @param parent The parent widget.
+     */
+    explicit DicomAttributesDialog(SeriesInfo* seriesInfo, QWidget *parent = 0);
     ~DicomAttributesDialog();
 
     void loadData();
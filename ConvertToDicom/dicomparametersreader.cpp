@@ -23,8 +23,8 @@
 
 #include "itkheaders.pch.h"
 
-DicomParametersReader::DicomParametersReader(const QString& directoryPath)
-    : seriesInfo(SeriesInfo::getInstance()), inputDirectory(directoryPath.toStdString()),
+DicomParametersReader::DicomParametersReader(const QString& directoryPath, SeriesInfo* seriesInfo)
+    : seriesInfo(seriesInfo), inputDirectory(directoryPath.toStdString()),
       namesFinder(itk::GDCMSeriesFileNames::New()),
       logger(Logger::getInstance(std::string(LOGGER_NAME) + ".DicomParametersReader"))
 {
@@ -33,7 +33,7 @@
 
 /**
  * Class to read a dicom series and extract parameters from its dictionary, placing them into
- * the global SeriesInfo instance.
+ * a SeriesInfo instance.
  */
 class DicomParametersReader
 {
@@ -44,8 +44,9 @@ public:
      * Class constructor.
      * @param directoryPath The input directory path. This the full path of the directory containing
      * the DICOM file(s).
+     * @param seriesInfo The SeriesInfo to receive the parameters. Not owned by this class.
      */
-    explicit DicomParametersReader(const QString& directoryPath);
+    DicomParametersReader(const QString& directoryPath, SeriesInfo* seriesInfo);
 
     /**
      * Do the parameter reading.
@@ -57,7 +58,7 @@ protected:
     ErrorCode GetDirectoryContents();
 
 private:
-    SeriesInfo* seriesInfo;                          ///< The SeriesInfoITK passed in the constructor.
+    SeriesInfo* seriesInfo;                          ///< The SeriesInfo passed in the constructor.
     std::string inputDirectory;                      ///< The input directory passed in the constructor.
     std::vector<itk::MetaDataDictionary*> dictArray; ///< Array of itk::MetaDataDictionary instances.
     itk::GDCMSeriesFileNames::Pointer namesFinder;
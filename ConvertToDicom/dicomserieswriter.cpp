@@ -20,7 +20,11 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "dicomserieswriter.h"
+#include "conversionjob.h"
 #include "dumpmetadatadictionary.h"
+#include "parallel.h"
+#include "conversionprogress.h"
+#include "seriesgeometry.h"
 
 #include "itkheaders.pch.h"
 
@@ -29,16 +33,79 @@
 #include <iostream>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 
-DicomSeriesWriter::DicomSeriesWriter(QVector<Image2DType::Pointer>& images, const QString& outputDirectoryName)
-    : seriesInfo(SeriesInfo::getInstance()), images(images), outputDirectory(outputDirectoryName),
+DicomSeriesWriter::DicomSeriesWriter(const ConversionJob& job, QVector<AnyImage2DType::Pointer>& images,
+                                     const QString& outputDirectoryName)
+    : job(&job), seriesInfo(&job.seriesInfo()), images(images), outputDirectory(outputDirectoryName),
+  compression(Compression::NONE), compressionChosen(0), appendedImages(0), progress(job.progress()),
   logger(Logger::getInstance(std::string(LOGGER_NAME) + ".DicomSeriesWriter"))
 {
     std::string name = std::string(LOGGER_NAME) + ".DicomSeriesWriter";
     LOG4CPLUS_TRACE(logger, "Enter");
 }
 
+DicomSeriesWriter::DicomSeriesWriter(const ConversionJob& job, const QString& outputDirectoryName)
+    : job(&job), seriesInfo(&job.seriesInfo()), outputDirectory(outputDirectoryName),
+  compression(Compression::NONE), compressionChosen(0), appendedImages(0), progress(job.progress()),
+  logger(Logger::getInstance(std::string(LOGGER_NAME) + ".DicomSeriesWriter"))
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+}
+
+DicomSeriesWriter::~DicomSeriesWriter()
+{
+    AbandonSeries();
+    ClearDictionaries();
+}
+
 ErrorCode DicomSeriesWriter::WriteFileSeries()
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    ErrorCode errCode = PrepareSeries(images.size());
+    if (errCode != ErrorCode::SUCCESS)
+        return errCode;
+
+    WriteSlices(0, images.constData(), images.size(), sliceErrors);
+
+    // Report the first failure, if any.
+    for (std::size_t sliceIdx = 0; sliceIdx < sliceErrors.size(); ++sliceIdx)
+    {
+        if (sliceErrors[sliceIdx] != ErrorCode::SUCCESS)
+        {
+            AbandonSeries();
+            return sliceErrors[sliceIdx];
+        }
+    }
+
+    return FinishSeries();
+}
+
+void DicomSeriesWriter::WriteSlices(int firstSlice, const AnyImage2DType::Pointer* slices, int numSlices,
+                                    std::vector<ErrorCode>& errors)
+{
+    ChooseSeriesCompression(slices, numSlices);
+
+    // Give each worker a contiguous block of slices and its own template.
+    int numWorkers = std::min(EffectiveThreadCount(seriesInfo->numberOfThreads()), numSlices);
+    errors.assign(std::size_t(numSlices), ErrorCode::SUCCESS);
+
+    LOG4CPLUS_DEBUG(logger, "Writing " << numSlices << " slices with " << numWorkers << " threads.");
+
+    ParallelFor(numWorkers, numWorkers, [this, firstSlice, slices, numSlices, numWorkers, &errors](int worker)
+    {
+        int beginIdx = int((qint64(numSlices) * worker) / numWorkers);
+        int endIdx = int((qint64(numSlices) * (worker + 1)) / numWorkers);
+
+        SliceTemplatePointer sliceTemplate = AcquireTemplate();
+        for (int idx = beginIdx; idx < endIdx; ++idx)
+            errors[std::size_t(idx)] = WriteSlice(firstSlice + idx, slices[idx], *sliceTemplate);
+        ReleaseTemplate(sliceTemplate);
+    });
+}
+
+ErrorCode DicomSeriesWriter::PrepareSeries(int numberOfSlices)
 {
     LOG4CPLUS_TRACE(logger, "Enter");
     // Set up the new metadata dictionary array
@@ -48,44 +115,372 @@ ErrorCode DicomSeriesWriter::WriteFileSeries()
 
     PrepareMetaDataDictionaryArray();
 
-    //
-    // create a Dicom series writer
-    itk::GDCMImageIO::Pointer dicomIo = itk::GDCMImageIO::New();
-    dicomIo->SetPixelType(itk::ImageIOBase::SCALAR);
-    dicomIo->KeepOriginalUIDOn();
+    if (int(sliceDicts.size()) != numberOfSlices)
+    {
+        LOG4CPLUS_ERROR(logger, "Number of slices (" << numberOfSlices
+                        << ") does not match number of dictionaries (" << sliceDicts.size() << ")");
+        return ErrorCode::ERROR_IMAGE_INCONSISTENT;
+    }
 
     // define the filenames generator type and instance
     typedef itk::NumericSeriesFileNames NameGeneratorType;
     NameGeneratorType::Pointer nameGenerator = NameGeneratorType::New();
 
-    QString value = outputDirectory + "/IM-" + QString::number(seriesInfo->seriesNumber()) + "-%04d.dcm";
+    QString value = "IM-" + QString::number(seriesInfo->seriesNumber()) + "-%04d.dcm";
     nameGenerator->SetSeriesFormat(value.toStdString());
     nameGenerator->SetStartIndex(1);
-    nameGenerator->SetEndIndex(itk::SizeValueType(images.size()));
+    nameGenerator->SetEndIndex(itk::SizeValueType(numberOfSlices));
     fileNames = nameGenerator->GetFileNames();
 
+    if (progress != 0)
+        progress->setNumberOfSlices(numberOfSlices);
+
+    // We want to empty the output directory so we remove it and recreate it.
+    itksys::SystemTools::RemoveADirectory(outputDirectory.toStdString());
+    if (!itksys::SystemTools::MakeDirectory(outputDirectory.toStdString()))
+        return ErrorCode::ERROR_CREATING_DIRECTORY;
+
+    ResetCompression();
+    ErrorCode errCode = BeginOutput(false);
+    if (errCode != ErrorCode::SUCCESS)
+        return errCode;
+
+    return BeginMultiFrame();
+}
+
+ErrorCode DicomSeriesWriter::BeginSeries()
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    ClearDictionaries();
+    fileNames.clear();
+    appendedImages = 0;
+    seriesLayer = MakeSeriesLayer(job->numberOfImages());
+    PrepareSliceGeometry();
+
     // We want to empty the output directory so we remove it and recreate it.
     itksys::SystemTools::RemoveADirectory(outputDirectory.toStdString());
-    itksys::SystemTools::MakeDirectory(outputDirectory.toStdString());
+    if (!itksys::SystemTools::MakeDirectory(outputDirectory.toStdString()))
+        return ErrorCode::ERROR_CREATING_DIRECTORY;
+
+    ResetCompression();
+    ErrorCode errCode = BeginOutput(true);
+    if (errCode != ErrorCode::SUCCESS)
+        return errCode;
+
+    return BeginMultiFrame();
+}
+
+ErrorCode DicomSeriesWriter::BeginOutput(bool appending)
+{
+    OutputFormat format = seriesInfo->outputFormat();
+    if (seriesInfo->multiFrame() && (format != OutputFormat::FILES))
+    {
+        LOG4CPLUS_INFO(logger, "A multi-frame series is one file so it is not put into a "
+                       << OutputFormatName(format) << " archive.");
+        format = OutputFormat::FILES;
+    }
+    else if (appending && (format != OutputFormat::FILES))
+    {
+        LOG4CPLUS_INFO(logger, "A series written as its images arrive is written as files, not a "
+                       << OutputFormatName(format) << " archive.");
+        format = OutputFormat::FILES;
+    }
+
+    QString archiveName = "IM-" + QString::number(seriesInfo->seriesNumber());
+    outputSink.reset(OutputSink::create(format, outputDirectory, archiveName));
+    ErrorCode errCode = outputSink->begin();
+    if (errCode != ErrorCode::SUCCESS)
+        outputSink.clear();
+    return errCode;
+}
+
+void DicomSeriesWriter::AbandonSeries()
+{
+    if (!multiFrameWriter.isNull())
+    {
+        LOG4CPLUS_INFO(logger, "The multi-frame file of the series is not written.");
+        multiFrameWriter.clear();
+    }
+
+    if (outputSink.isNull())
+        return;
+
+    // An archive needs its trailer, and index, for the slices already in it to be read.
+    if (outputSink->finish() == ErrorCode::SUCCESS)
+        LOG4CPLUS_INFO(logger, "The slices already written are kept in " << outputDirectory.toStdString());
+    outputSink.clear();
+}
+
+void DicomSeriesWriter::ResetCompression()
+{
+    compression = seriesInfo->compression();
+    compressionChosen.storeRelease((compression == Compression::AUTO) ? 0 : 1);
+    if (compression == Compression::AUTO)
+        compression = Compression::NONE;
+}
+
+void DicomSeriesWriter::ChooseSeriesCompression(const AnyImage2DType::Pointer* slices, int numSlices)
+{
+    if (compressionChosen.loadAcquire() != 0)
+        return;
+
+    QMutexLocker locker(&compressionMutex);
+    if ((compressionChosen.loadAcquire() != 0) || (numSlices <= 0))
+        return;
+
+    // The samples come from the middle of equal parts of the slices, away from the ends of the
+    // series where there is often little to see.
+    const int maxSamples = 4;
+    int numSamples = std::min(maxSamples, numSlices);
+    std::vector<Compression> candidates = CompressionCandidates();
+    std::vector<std::vector<CompressionTrial> > sampleTrials(std::size_t(numSamples));
+    ParallelFor(numSamples, seriesInfo->numberOfThreads(),
+                [this, slices, numSlices, numSamples, &candidates, &sampleTrials](int sampleIdx)
+    {
+        const AnyImage2DType::Pointer& slice = slices[(qint64(numSlices) * (2 * sampleIdx + 1)) / (2 * numSamples)];
+        DicomSliceTemplate sliceTemplate(seriesLayer, Compression::NONE, 0);
+        std::vector<CompressionTrial>& trials = sampleTrials[std::size_t(sampleIdx)];
+        for (std::size_t idx = 0; idx < candidates.size(); ++idx)
+        {
+            CompressionTrial trial = { candidates[idx], 0, 0, 0 };
+            if (slice.IsNull() || !sliceTemplate.tryCompression(slice, trial))
+                trial.storedBytes = -1;
+            trials.push_back(trial);
+        }
+    });
+
+    // A codec which fails on any of the sample is not a candidate.
+    std::vector<CompressionTrial> trials;
+    for (std::size_t idx = 0; idx < candidates.size(); ++idx)
+    {
+        CompressionTrial trial = { candidates[idx], 0, 0, 0 };
+        for (int sampleIdx = 0; sampleIdx < numSamples; ++sampleIdx)
+        {
+            const CompressionTrial& sampleTrial = sampleTrials[std::size_t(sampleIdx)][idx];
+            if (sampleTrial.storedBytes < 0)
+            {
+                trial.rawBytes = 0;
+                break;
+            }
+            trial.rawBytes += sampleTrial.rawBytes;
+            trial.storedBytes += sampleTrial.storedBytes;
+            trial.nanoseconds += sampleTrial.nanoseconds;
+        }
+
+        if (trial.rawBytes > 0)
+            LOG4CPLUS_INFO(logger, "Tried " << CompressionReport(trial.compression, trial.rawBytes,
+                                                                 trial.storedBytes, trial.nanoseconds));
+        else
+            LOG4CPLUS_WARN(logger, "Could not compress the sample with " << CompressionName(trial.compression));
+        trials.push_back(trial);
+    }
+
+    compression = ChooseCompression(trials, seriesInfo->minCompressionRate());
+    LOG4CPLUS_INFO(logger, "Chose " << CompressionName(compression) << " for the series from " << numSamples
+                   << " slices, with a floor of " << seriesInfo->minCompressionRate() << " MB/s.");
+
+    if (!multiFrameWriter.isNull())
+        multiFrameWriter->setCompression(compression);
+    compressionChosen.storeRelease(1);
+}
+
+ErrorCode DicomSeriesWriter::BeginMultiFrame()
+{
+    multiFrameWriter.clear();
+    if (!seriesInfo->multiFrame())
+        return ErrorCode::SUCCESS;
+
+    QString fileName = outputDirectory + "/IM-" + QString::number(seriesInfo->seriesNumber()) + ".dcm";
+    multiFrameWriter.reset(new MultiFrameWriter(*job, fileName.toStdString()));
+    multiFrameWriter->setCompression(compression);
+    return multiFrameWriter->begin();
+}
+
+ErrorCode DicomSeriesWriter::AppendImage(const std::vector<AnyImage2DType::Pointer>& slices)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    if (int(slices.size()) != job->slicesPerImage())
+    {
+        LOG4CPLUS_ERROR(logger, "Image " << appendedImages << " has " << slices.size()
+                        << " slices, expected " << job->slicesPerImage());
+        return ErrorCode::ERROR_IMAGE_INCONSISTENT;
+    }
+
+    if (appendedImages >= job->acqTimes().size())
+    {
+        LOG4CPLUS_ERROR(logger, "No acquisition time for image " << appendedImages);
+        return ErrorCode::ERROR;
+    }
+
+    // The slices are numbered through the whole series, as PrepareSeries() numbers them.
+    int firstSlice = int(fileNames.size());
+    AppendImageDictionaries(seriesLayer, appendedImages);
+    for (std::size_t idx = 0; idx < slices.size(); ++idx)
+    {
+        QString fileName = "IM-" + QString::number(seriesInfo->seriesNumber()) + "-"
+                + QString("%1").arg(firstSlice + int(idx) + 1, 4, 10, QChar('0')) + ".dcm";
+        fileNames.push_back(fileName.toStdString());
+    }
+    ++appendedImages;
+
+    // The slices of the image are written, and compressed, concurrently.
+    std::vector<ErrorCode> imageErrors;
+    WriteSlices(firstSlice, slices.data(), int(slices.size()), imageErrors);
+    for (std::size_t idx = 0; idx < imageErrors.size(); ++idx)
+    {
+        if (imageErrors[idx] != ErrorCode::SUCCESS)
+            return imageErrors[idx];
+    }
+
+    return ErrorCode::SUCCESS;
+}
+
+ErrorCode DicomSeriesWriter::FinishSeries()
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
 
-    typedef itk::ImageSeriesWriter<Image3DType, Image2DType> WriterType;
-    WriterType::Pointer writer = WriterType::New();
-    writer->SetImageIO(dicomIo);
-    writer->SetFileNames(fileNames);
-    writer->SetMetaDataDictionaryArray(&dictArray);
-    Image3DType::Pointer image = MergeSlices();
-    writer->SetInput(image);
+    // Every slice has been compressed by now.
+    if ((compression != Compression::NONE) && (progress != 0))
+        LOG4CPLUS_INFO(logger, "Compressed with " << CompressionReport(compression, progress->rawPixelBytes(),
+                                                                     progress->storedPixelBytes(),
+                                                                     progress->compressionNanoseconds()));
 
-    try
+    // Every slice is in the sink by now, so an archive can be closed.
+    if (!outputSink.isNull())
     {
-        writer->Update();
+        ErrorCode errCode = outputSink->finish();
+        outputSink.clear();
+        if (errCode != ErrorCode::SUCCESS)
+            return errCode;
     }
-    catch (itk::ExceptionObject& ex)
+
+    if (!multiFrameWriter.isNull())
     {
-        LOG4CPLUS_ERROR(logger, "ExceptionObject caught. " << ex.what());
+        // A hot folder only knows the number of temporal positions now.
+        SliceDictionary::SeriesLayer finalLayer = (appendedImages > 0) ? MakeSeriesLayer(appendedImages) : seriesLayer;
+        ErrorCode errCode = multiFrameWriter->finish(finalLayer, sliceDicts);
+        multiFrameWriter.clear();
+        return errCode;
+    }
+
+    // Only the number of temporal positions depends on the number of images. It is already
+    // right if the expected number of images arrived.
+    bool isTimeSeries = (seriesInfo->seriesTimeIncrement() > 0.0);
+    if (!isTimeSeries || appendedImages < 2 || appendedImages == job->numberOfImages())
+        return ErrorCode::SUCCESS;
+
+    LOG4CPLUS_DEBUG(logger, "Setting number of temporal positions to " << appendedImages
+                    << " in " << fileNames.size() << " files.");
+
+    int numFiles = int(fileNames.size());
+    int numTemporalPositions = appendedImages;
+    std::vector<ErrorCode> fileErrors(fileNames.size(), ErrorCode::SUCCESS);
+    ParallelFor(numFiles, seriesInfo->numberOfThreads(), [this, numTemporalPositions, &fileErrors](int fileIdx)
+    {
+        std::string fileName = outputDirectory.toStdString() + "/" + fileNames[std::size_t(fileIdx)];
+
+        gdcm::Reader reader;
+        reader.SetFileName(fileName.c_str());
+        if (!reader.Read())
+        {
+            LOG4CPLUS_ERROR(logger, "Could not read back " << fileName);
+            fileErrors[std::size_t(fileIdx)] = ErrorCode::ERROR_READING_FILE;
+            return;
+        }
+
+        gdcm::Attribute<0x0020, 0x0105> attribute;
+        attribute.SetValue(numTemporalPositions);
+        reader.GetFile().GetDataSet().Replace(attribute.GetAsDataElement());
+
+        gdcm::Writer writer;
+        writer.SetFile(reader.GetFile());
+        writer.SetFileName(fileName.c_str());
+        if (!writer.Write())
+        {
+            LOG4CPLUS_ERROR(logger, "Could not rewrite " << fileName);
+            fileErrors[std::size_t(fileIdx)] = ErrorCode::ERROR_WRITING_FILE;
+        }
+    });
+
+    for (std::size_t idx = 0; idx < fileErrors.size(); ++idx)
+    {
+        if (fileErrors[idx] != ErrorCode::SUCCESS)
+            return fileErrors[idx];
+    }
+
+    return ErrorCode::SUCCESS;
+}
+
+ErrorCode DicomSeriesWriter::WriteSlice(int sliceIdx, const AnyImage2DType::Pointer& slice)
+{
+    // Slices streamed in one at a time only have themselves to sample.
+    ChooseSeriesCompression(&slice, 1);
+
+    // Each call has a template to itself so that slices can be written concurrently.
+    SliceTemplatePointer sliceTemplate = AcquireTemplate();
+    ErrorCode errCode = WriteSlice(sliceIdx, slice, *sliceTemplate);
+    ReleaseTemplate(sliceTemplate);
+    return errCode;
+}
+
+DicomSeriesWriter::SliceTemplatePointer DicomSeriesWriter::AcquireTemplate()
+{
+    {
+        QMutexLocker locker(&templateMutex);
+        if (!idleTemplates.empty())
+        {
+            SliceTemplatePointer sliceTemplate = idleTemplates.back();
+            idleTemplates.pop_back();
+            return sliceTemplate;
+        }
+    }
+
+    // Making a template converts the series attributes so it is done outside the lock.
+    return SliceTemplatePointer(new DicomSliceTemplate(seriesLayer, compression, progress));
+}
+
+void DicomSeriesWriter::ReleaseTemplate(const SliceTemplatePointer& sliceTemplate)
+{
+    QMutexLocker locker(&templateMutex);
+    idleTemplates.push_back(sliceTemplate);
+}
+
+ErrorCode DicomSeriesWriter::WriteSlice(int sliceIdx, const AnyImage2DType::Pointer& slice,
+                                        DicomSliceTemplate& sliceTemplate)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    if ((sliceIdx < 0) || (std::size_t(sliceIdx) >= sliceDicts.size()))
+    {
+        LOG4CPLUS_ERROR(logger, "Slice index out of range: " << sliceIdx);
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    if (multiFrameWriter.isNull() && outputSink.isNull())
+    {
+        LOG4CPLUS_ERROR(logger, "Slice " << sliceIdx << " is not part of a series being written.");
         return ErrorCode::ERROR_WRITING_FILE;
     }
 
+    if (IsCancelled(progress))
+        return ErrorCode::ERROR_CANCELLED;
+
+    // The slice is written in its own pixel type so the bit depth of the input is kept.
+    ErrorCode errCode = multiFrameWriter.isNull()
+            ? sliceTemplate.write(sliceDicts[std::size_t(sliceIdx)], slice, fileNames[std::size_t(sliceIdx)],
+                                  *outputSink)
+            : multiFrameWriter->writeFrame(sliceIdx, slice);
+    if (errCode != ErrorCode::SUCCESS)
+    {
+        LOG4CPLUS_ERROR(logger, "Failed to write slice " << sliceIdx << ".");
+        return errCode;
+    }
+
+    if (progress != 0)
+        progress->sliceWritten();
+
     return ErrorCode::SUCCESS;
 }
 
@@ -120,9 +515,47 @@ void DicomSeriesWriter::PrepareMetaDataDictionaryArray()
     LOG4CPLUS_TRACE(logger, "Enter");
 
     // It may have been used in a previous run.
-    dictArray.clear();
+    ClearDictionaries();
+
+    seriesLayer = MakeSeriesLayer(job->numberOfImages());
+    PrepareSliceGeometry();
+
+    // loop through the images, and the slices in each image
+    sliceDicts.reserve(std::size_t(job->numberOfImages()) * std::size_t(job->slicesPerImage()));
+    for (int imageIdx = 0; imageIdx < job->numberOfImages(); ++imageIdx)
+        AppendImageDictionaries(seriesLayer, imageIdx);
+}
+
+void DicomSeriesWriter::ClearDictionaries()
+{
+    // The slices point into the arena so they go first.
+    sliceDicts.clear();
+    sliceArena.clear();
 
-    itk::MetaDataDictionary seriesDict = seriesInfo->metaDataDictionary();
+    QMutexLocker locker(&templateMutex);
+    idleTemplates.clear();
+}
+
+void DicomSeriesWriter::PrepareSliceGeometry()
+{
+    // Every image has the same slice positions so they are worked out once for the series.
+    SeriesGeometry geometry(*seriesInfo);
+    geometry.sliceStrings(job->slicesPerImage(), slicePositions, sliceLocations);
+}
+
+SliceDictionary::SeriesLayer DicomSeriesWriter::MakeSeriesLayer(int numberOfImages)
+{
+    // Only the string entries are written, as before the dictionaries were layered.
+    QSharedPointer<itk::MetaDataDictionary> seriesDict(new itk::MetaDataDictionary);
+    CopyDictionary(MakeSeriesDictionary(numberOfImages), *seriesDict);
+    return seriesDict;
+}
+
+itk::MetaDataDictionary DicomSeriesWriter::MakeSeriesDictionary(int numberOfImages)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    itk::MetaDataDictionary seriesDict = job->seriesDictionary();
     LOG4CPLUS_TRACE(logger, "********** seriesDict - 1 ************");
     LOG4CPLUS_TRACE(logger, DumpDicomMetaDataDictionary(seriesDict));
 
@@ -130,7 +563,7 @@ void DicomSeriesWriter::PrepareMetaDataDictionaryArray()
     if (isTimeSeries)
     {
         std::stringstream sstr;
-        int numTimes = seriesInfo->imageNumberOfImages();
+        int numTimes = numberOfImages;
         if (numTimes > 1)
         {
             sstr.str("");
@@ -156,91 +589,68 @@ void DicomSeriesWriter::PrepareMetaDataDictionaryArray()
     std::string derivationDesc(value.str(), 0, lengthOfDesc > 1024 ? 1024 : lengthOfDesc);
     itk::EncapsulateMetaData<std::string>(seriesDict, "0008|2111", derivationDesc);
 
-    // loop through the images, and the slices in each image
-    int instanceNumber = 1;
-    for (int imageIdx = 0; imageIdx < seriesInfo->imageNumberOfImages(); ++imageIdx)
-    {
-        itk::MetaDataDictionary imageDict;
-        CopyDictionary(seriesDict, imageDict);
-
-        if (isTimeSeries)
-        {
-            // Temporal Position
-            std::stringstream sstr;
-            sstr.str("");
-            sstr << imageIdx+1;
-            std::string temporalPosition = sstr.str();
-            itk::EncapsulateMetaData<std::string>(imageDict, "0020|0100", temporalPosition);
-        }
-
-        QTime time = seriesInfo->acqTimes()[imageIdx];
-        std::string acqTime = time.toString("HHmmss.zzz").toStdString();
-        itk::EncapsulateMetaData<std::string>(imageDict, "0008|0032", acqTime);
-
-        float sliceLocation = 0.0;
-        for (int sliceIdx = 0; sliceIdx < seriesInfo->imageSlicesPerImage(); ++sliceIdx)
-        {
-            // Make a new dictionary for the slice and copy over the information already set
-            // We need a pointer because the dictionary array is an array of pointers.
-            itk::MetaDataDictionary *sliceDict = new itk::MetaDataDictionary();
-            CopyDictionary(imageDict, *sliceDict);
-
-            gdcm::UIDGenerator sopuidGen;
-            std::string sopInstanceUID = sopuidGen.Generate();
-            //itk::EncapsulateMetaData<std::string>(*sliceDict, "0008|0018", sopInstanceUID);
-            itk::EncapsulateMetaData<std::string>(*sliceDict, "0002|0003", sopInstanceUID);
+    return seriesDict;
+}
 
-            // Set the IPP for this slice
-            std::stringstream sstr;
-            sstr << std::fixed << std::setprecision(2) << seriesInfo->imagePositionPatientX() << "\\"
-            << seriesInfo->imagePositionPatientY() << "\\" << seriesInfo->imagePositionPatientZ() << "\\";
+void DicomSeriesWriter::AppendImageDictionaries(const SliceDictionary::SeriesLayer& seriesLayer, int imageIdx)
+{
+    bool isTimeSeries = (seriesInfo->seriesTimeIncrement() > 0.0);
+    int instanceNumber = imageIdx * job->slicesPerImage() + 1;
 
-            std::string imagePositionPatient = seriesInfo->imagePositionPatientString(sliceIdx).toStdString();
-            itk::EncapsulateMetaData<std::string>(*sliceDict, "0020|0032", imagePositionPatient);
+    // The entries which differ between images are shared by the slices of this one.
+    QSharedPointer<SliceDictionary::EntryList> imageEntries(new SliceDictionary::EntryList);
 
-            // The relative location of this slice from the first one.
-            sstr.str("");
-            sstr << std::fixed << std::setprecision(1) << sliceLocation;
-            itk::EncapsulateMetaData<std::string>(*sliceDict, "0020|1041",  sstr.str());
-            sliceLocation += seriesInfo->imageSliceSpacing();
+    if (isTimeSeries)
+    {
+        // Temporal Position
+        std::stringstream sstr;
+        sstr.str("");
+        sstr << imageIdx+1;
+        std::string temporalPosition = sstr.str();
+        SliceDictionary::setEntry(*imageEntries, "0020|0100", temporalPosition);
+    }
 
-            sstr.str("");
-            sstr << instanceNumber;
-            itk::EncapsulateMetaData<std::string>(*sliceDict, "0020|0013", sstr.str());
-            ++instanceNumber;
+    QTime time = job->acqTimes()[imageIdx];
+    std::string acqTime = time.toString("HHmmss.zzz").toStdString();
+    SliceDictionary::setEntry(*imageEntries, "0008|0032", acqTime);
 
-            LOG4CPLUS_TRACE(logger, "*** Image " << imageIdx << " slice " << sliceIdx << " ***");
-            LOG4CPLUS_TRACE(logger, DumpDicomMetaDataDictionary(*sliceDict));
-            dictArray.push_back(sliceDict);
-        }
+    // Floating point pixels are stored rescaled. The rescale is taken when the image is added
+    // as an image arriving in a hot folder has its own.
+    if (job->isRescaled())
+    {
+        SliceDictionary::setEntry(*imageEntries, "0028|1052", job->rescale().interceptString);
+        SliceDictionary::setEntry(*imageEntries, "0028|1053", job->rescale().slopeString);
     }
-}
 
-Image3DType::Pointer DicomSeriesWriter::MergeSlices()
-{
-    LOG4CPLUS_TRACE(logger, "Enter");
+    SliceDictionary::ImageLayer imageLayer = imageEntries;
 
-    // Concatenate the whole bunch of slices into one image.
-    typedef itk::TileImageFilter<Image2DType, Image3DType> TileFilterType;
-    TileFilterType::Pointer tileFilter = TileFilterType::New();
+    for (int sliceIdx = 0; sliceIdx < job->slicesPerImage(); ++sliceIdx)
+    {
+        // The slice holds only its own entries and shares the rest.
+        SliceDictionary sliceDict(seriesLayer, imageLayer, &sliceArena);
 
-    itk::FixedArray<unsigned int, 3> layout;
-    layout[0] = 1;
-    layout[1] = 1;
-    layout[2] = 0;
+        std::string sopInstanceUID = job->uidGenerator().generate();
+        // gdcm::Writer copies it into the file meta information.
+        sliceDict.set("0008|0018", sopInstanceUID);
 
-    LOG4CPLUS_DEBUG(logger, "Layout = " << layout);
+        // Set the IPP for this slice
+        sliceDict.set("0020|0032", slicePositions[std::size_t(sliceIdx)]);
 
-    tileFilter->SetLayout(layout);
-    tileFilter->SetDefaultPixelValue(0);
-    int numSlices = images.size();
-    for (int idx = 0; idx < numSlices; ++idx)
-    {
-        tileFilter->SetInput(unsigned(idx), images[idx]);
-    }
+        // The relative location of this slice from the first one.
+        sliceDict.set("0020|1041", sliceLocations[std::size_t(sliceIdx)]);
 
-    tileFilter->Update();
+        std::stringstream sstr;
+        sstr << instanceNumber;
+        sliceDict.set("0020|0013", sstr.str());
+        ++instanceNumber;
 
-    Image3DType::Pointer image3d = tileFilter->GetOutput();
-    return image3d;
+        LOG4CPLUS_TRACE(logger, "*** Image " << imageIdx << " slice " << sliceIdx << " ***");
+        if (logger.isEnabledFor(log4cplus::TRACE_LOG_LEVEL))
+        {
+            itk::MetaDataDictionary dict;
+            sliceDict.flatten(dict);
+            LOG4CPLUS_TRACE(logger, DumpDicomMetaDataDictionary(dict));
+        }
+        sliceDicts.push_back(sliceDict);
+    }
 }
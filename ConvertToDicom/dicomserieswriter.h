@@ -26,14 +26,30 @@
 #include "errorcodes.h"
 #include "itktypedefs.h"
 #include "seriesinfo.h"
+#include "slicedictionary.h"
+#include "dicomslicetemplate.h"
+#include "multiframewriter.h"
+#include "outputsink.h"
 
+#include <QAtomicInt>
+#include <QMutex>
+#include <QSharedPointer>
 #include <QString>
 #include <QVector>
 
+class ConversionJob;
+class ConversionProgress;
+
 /**
- * Class to write a DICOM series. This class uses itk::ImageSeriesWriter and its arguments to
- * write a DICOM series. The series is always written as 2D slices. The logical order of the slices
- * is the same as the alphabetical order of the files which contain them.
+ * Class to write a DICOM series. Each 2D slice is written directly with gdcm by a
+ * DicomSliceTemplate, which holds the series attributes ready made, using the matching
+ * SliceDictionary for the rest. The slices
+ * keep the pixel type they were read with, so the bits allocated and the pixel representation
+ * follow the input. The series is
+ * written as 2D slices, or as a single multi-frame file by a MultiFrameWriter if
+ * SeriesInfo::multiFrame() is set. The slices go to an OutputSink, which writes them as files in
+ * the output directory or streams them into one archive there. The logical order of the slices is the same as the alphabetical
+ * order of the files which contain them.
  */
 class DicomSeriesWriter
 {
@@ -42,19 +58,168 @@ public:
 
 /**
  * Class constructor.
+ * @param job The conversion this series belongs to. It must outlive the writer.
  * @param images The DICOM images to write.
  * @param outputDirectoryName The output directory. This the deepest directory
  * in the tree and is the place into which the files will be written.
  */
-    explicit DicomSeriesWriter(QVector<Image2DType::Pointer>& images, const QString& outputDirectoryName);
+    DicomSeriesWriter(const ConversionJob& job, QVector<AnyImage2DType::Pointer>& images,
+                      const QString& outputDirectoryName);
 
     /**
-     * Do the file writing.
-     * @return Suitable value in ErrorCode enum.
+     * Class constructor for writing slices one at a time with PrepareSeries() and WriteSlice().
+     * @param job The conversion this series belongs to. It must outlive the writer.
+     * @param outputDirectoryName The output directory. This the deepest directory
+     * in the tree and is the place into which the files will be written.
+     */
+    DicomSeriesWriter(const ConversionJob& job, const QString& outputDirectoryName);
+
+    /**
+     * Class destructor.
+     */
+    ~DicomSeriesWriter();
+
+    /**
+     * Do the file writing. The slices are written concurrently by SeriesInfo::numberOfThreads()
+     * threads, each with its own DicomSliceTemplate. The result for each slice is available
+     * from SliceErrors() afterwards. The series is finished with FinishSeries().
+     * @return Suitable value in ErrorCode enum. If any slice failed this is the error for the
+     * first slice which failed.
      */
     ErrorCode WriteFileSeries();
 
+    /**
+     * Get the result of writing each slice in the last call to WriteFileSeries().
+     * @return One ErrorCode per slice, in slice order.
+     */
+    const std::vector<ErrorCode>& SliceErrors() const
+    {
+        return sliceErrors;
+    }
+
+    /**
+     * Get ready to write a series slice by slice. This prepares the metadata dictionaries
+     * and file names and empties the output directory.
+     * @param numberOfSlices The number of slices which will be written.
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode PrepareSeries(int numberOfSlices);
+
+    /**
+     * Write one slice of the series. PrepareSeries() must have been called first. This may be
+     * called from several threads at once.
+     * @param sliceIdx The index of the slice in the series.
+     * @param slice The slice to write.
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode WriteSlice(int sliceIdx, const AnyImage2DType::Pointer& slice);
+
+    /**
+     * Get ready to write a series image by image, as the images become available, when the
+     * number of images is not known beforehand. This empties the output directory.
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode BeginSeries();
+
+    /**
+     * Write the slices of the next image of a series started with BeginSeries(). The image's
+     * acquisition time must already be in the job.
+     * @param slices The slices of the image. There must be ConversionJob::slicesPerImage() of them.
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode AppendImage(const std::vector<AnyImage2DType::Pointer>& slices);
+
+    /**
+     * Finish a series written with AppendImage() or WriteSlice(). The attributes which depend
+     * on the number of images, such as the number of temporal positions, are filled into the
+     * files already written. A multi-frame file is written now, when all of its frames are in.
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode FinishSeries();
+
+    /**
+     * Stop a series which failed or was cancelled, keeping the slices already written. An
+     * archive is closed with the slices already in it, so it can still be read. A multi-frame
+     * file is not written. The destructor does this if the series was not finished.
+     */
+    void AbandonSeries();
+
+    /**
+     * Get the number of images written by AppendImage().
+     * @return The number of images.
+     */
+    int NumberOfAppendedImages() const
+    {
+        return appendedImages;
+    }
+
 private:
+    typedef QSharedPointer<DicomSliceTemplate> SliceTemplatePointer;
+
+    /**
+     * Take a template for writing slices of the series, reusing one given back by
+     * ReleaseTemplate() if there is one. A template must only be used by one thread at a time.
+     * @return The template.
+     */
+    SliceTemplatePointer AcquireTemplate();
+
+    /**
+     * Give back a template taken with AcquireTemplate() so that it can be used again.
+     * @param sliceTemplate The template.
+     */
+    void ReleaseTemplate(const SliceTemplatePointer& sliceTemplate);
+
+    /**
+     * Write consecutive slices of the series with a pool of workers, each with its own template.
+     * @param firstSlice The index in the series of the first of the slices.
+     * @param slices The slices.
+     * @param numSlices The number of slices.
+     * @param errors Set to the result of writing each slice.
+     */
+    void WriteSlices(int firstSlice, const AnyImage2DType::Pointer* slices, int numSlices,
+                     std::vector<ErrorCode>& errors);
+
+    /**
+     * Start choosing the compression of a new series. It is settled now unless it is
+     * Compression::AUTO.
+     */
+    void ResetCompression();
+
+    /**
+     * Settle the compression of the series if it is Compression::AUTO and has not been chosen
+     * yet. A few of the slices, spread through those given, are compressed with each of
+     * CompressionCandidates() and ChooseCompression() picks the codec for the whole series.
+     * This may be called from several threads at once; only the first call chooses.
+     * @param slices The slices to take the sample from.
+     * @param numSlices The number of slices.
+     */
+    void ChooseSeriesCompression(const AnyImage2DType::Pointer* slices, int numSlices);
+
+    /**
+     * Make the sink the slices of the series go to, as SeriesInfo::outputFormat() says. A
+     * multi-frame series is a single file so it is always written as one. A series written
+     * image by image is always written as files, because FinishSeries() may write them again.
+     * @param appending true if the series is written with AppendImage().
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode BeginOutput(bool appending);
+
+    /**
+     * Start the multi-frame file of the series if SeriesInfo::multiFrame() is set.
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode BeginMultiFrame();
+
+    /**
+     * Write one slice of the series using the given template, or as a frame of the
+     * multi-frame file.
+     * @param sliceIdx The index of the slice in the series.
+     * @param slice The slice to write.
+     * @param sliceTemplate The template to write with.
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode WriteSlice(int sliceIdx, const AnyImage2DType::Pointer& slice, DicomSliceTemplate& sliceTemplate);
+
     /**
      * Copy the contents of one itk::MetaDataDictionary instance to another. The contents of the receiving
      * dictionary on entry are generally preserved although entries may be overwritten.
@@ -64,25 +229,68 @@ private:
     void CopyDictionary(const itk::MetaDataDictionary& fromDict, itk::MetaDataDictionary& toDict);
 
     /**
-     * Initialise the itk::MetaDataDictionaryArray for the itk::ImageSeriesWriter. This adds all of the
-     * entries needed to write the series. NOTE: Any enhancement that requires adding entries to
-     * the itk::MetaDataDictionaryArray should do it by first extending the SeriesInfoITK class
-     * and using it to add the appropriate entries.
+     * Make the dictionary of the attributes common to every slice of the series.
+     * @param numberOfImages The number of images in the series, if known, otherwise 0.
+     * @return The dictionary.
      */
-    void PrepareMetaDataDictionaryArray();
+    itk::MetaDataDictionary MakeSeriesDictionary(int numberOfImages);
+
+    /**
+     * Work out the position and location strings of the slices of an image.
+     */
+    void PrepareSliceGeometry();
+
+    /**
+     * Make the layer of the slice dictionaries shared by the whole series. It holds the
+     * string entries of MakeSeriesDictionary().
+     * @param numberOfImages The number of images in the series, if known, otherwise 0.
+     * @return The layer.
+     */
+    SliceDictionary::SeriesLayer MakeSeriesLayer(int numberOfImages);
+
+    /**
+     * Add the dictionaries of the slices of one image to the dictionary array. The slices
+     * share the series layer and a layer for the image, and hold only their own entries.
+     * @param seriesLayer The layer made by MakeSeriesLayer().
+     * @param imageIdx The index of the image in the series.
+     */
+    void AppendImageDictionaries(const SliceDictionary::SeriesLayer& seriesLayer, int imageIdx);
+
+    /**
+     * Empty the dictionary array and release the storage of its entries in one go. The
+     * templates made from the series layer go too.
+     */
+    void ClearDictionaries();
 
     /**
-     * Create a 3D volume from the 2D slices contained in images.
-     * @return ITK smart pointer to the 3D image.
+     * Initialise the itk::MetaDataDictionaryArray for the slices. This adds all of the
+     * entries needed to write the series. NOTE: Any enhancement that requires adding entries to
+     * the itk::MetaDataDictionaryArray should do it by first extending the SeriesInfo class
+     * and using it to add the appropriate entries.
      */
-    Image3DType::Pointer MergeSlices();
+    void PrepareMetaDataDictionaryArray();
 
-    SeriesInfo* seriesInfo;           ///< The SeriesInfoITK passed in the constructor.
-    QVector<Image2DType::Pointer>& images; ///< The array of slices.
+    const ConversionJob* job;              ///< The job passed in the constructor.
+    const SeriesInfo* seriesInfo;          ///< The settings of the job.
+    QVector<AnyImage2DType::Pointer> images;  ///< The array of slices.
     QString outputDirectory;               ///< The output directory passed in the constructor.
 
-    std::vector<std::string> fileNames;        ///< The file names of the generated DICOM files.
-    std::vector<itk::MetaDataDictionary*> dictArray; ///< Array of itk::MetaDataDictionary instances.
+    std::vector<std::string> fileNames;        ///< The names of the DICOM files in the output directory.
+    std::vector<SliceDictionary> sliceDicts;   ///< The attributes of each slice.
+    StringArena sliceArena;                    ///< Holds the entries of sliceDicts.
+    std::vector<std::string> slicePositions;   ///< Image Position (Patient) of each slice of an image.
+    std::vector<std::string> sliceLocations;   ///< Slice Location of each slice of an image.
+    std::vector<ErrorCode> sliceErrors;        ///< Result of writing each slice.
+    SliceDictionary::SeriesLayer seriesLayer;  ///< Attributes shared by every slice.
+    QMutex templateMutex;                      ///< Guards idleTemplates.
+    std::vector<SliceTemplatePointer> idleTemplates; ///< Templates ready for reuse.
+    QSharedPointer<MultiFrameWriter> multiFrameWriter; ///< Writes the series as one file. May be null.
+    QSharedPointer<OutputSink> outputSink;     ///< Where the slices go. Null outside a series.
+    Compression compression;                   ///< The compression of the series, once chosen.
+    QAtomicInt compressionChosen;              ///< Non-zero once compression is settled.
+    QMutex compressionMutex;                   ///< Lets only one thread choose the compression.
+    int appendedImages;                        ///< Number of images written with AppendImage().
+    ConversionProgress* progress;              ///< Progress record of the job. May be null.
 
     Logger logger; ///< Logger for this class.
 };
@@ -0,0 +1,382 @@
+//
+//  dicomslicetemplate.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "dicomslicetemplate.h"
+#include "conversionprogress.h"
+
+#include <QElapsedTimer>
+
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+bool HasTag(const std::vector<gdcm::DataElement>& elements, const gdcm::Tag& tag)
+{
+    for (std::vector<gdcm::DataElement>::const_iterator iter = elements.begin(); iter != elements.end(); ++iter)
+    {
+        if (iter->GetTag() == tag)
+            return true;
+    }
+
+    return false;
+}
+
+std::string ElementString(const gdcm::DataSet& dataSet, const gdcm::Tag& tag)
+{
+    std::string value;
+    if (dataSet.FindDataElement(tag))
+    {
+        const gdcm::ByteValue* byteValue = dataSet.GetDataElement(tag).GetByteValue();
+        if (byteValue != 0)
+            value.assign(byteValue->GetPointer(), byteValue->GetLength());
+    }
+
+    // Strip the padding.
+    std::string::size_type end = value.find_last_not_of(std::string(" \0", 2));
+    value.erase(end == std::string::npos ? 0 : end + 1);
+    return value;
+}
+}
+
+DicomSliceTemplate::DicomSliceTemplate(const SliceDictionary::SeriesLayer& seriesLayer, Compression compression,
+                                       ConversionProgress* progress)
+    : compression(compression),
+      progress(progress),
+      file(new gdcm::File),
+      columns(0), rows(0), bitsAllocated(0), isSigned(false),
+      logger(Logger::getInstance(std::string(LOGGER_NAME) + ".DicomSliceTemplate"))
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    spacing[0] = 0.0;
+    spacing[1] = 0.0;
+
+    gdcm::DataSet& dataSet = file->GetDataSet();
+    gdcm::DataElement element;
+    if (!seriesLayer.isNull())
+    {
+        typedef itk::MetaDataObject<std::string> MetaDataStringType;
+        itk::MetaDataDictionary::ConstIterator end = seriesLayer->End();
+        for (itk::MetaDataDictionary::ConstIterator iter = seriesLayer->Begin(); iter != end; ++iter)
+        {
+            const MetaDataStringType* entry = dynamic_cast<const MetaDataStringType*>(iter->second.GetPointer());
+            if (entry == 0)
+                continue;
+
+            const std::string& value = entry->GetMetaDataObjectValue();
+            if (makeElement(iter->first.c_str(), value.c_str(), value.size(), element))
+                dataSet.Replace(element);
+        }
+    }
+
+    // The SOP Class follows from the modality, as gdcm::ImageWriter would choose it.
+    gdcm::MediaStorage mediaStorage;
+    mediaStorage.GuessFromModality(ElementString(dataSet, gdcm::Tag(0x0008, 0x0060)).c_str(), 2);
+    if (mediaStorage == gdcm::MediaStorage::MS_END)
+        mediaStorage = gdcm::MediaStorage::SecondaryCaptureImageStorage;
+    if (!dataSet.FindDataElement(gdcm::Tag(0x0008, 0x0016)))
+    {
+        const char* sopClassUid = mediaStorage.GetString();
+        if (makeElement("0008|0016", sopClassUid, std::strlen(sopClassUid), element))
+            dataSet.Replace(element);
+    }
+
+    // CT images must have a rescale.
+    if ((mediaStorage == gdcm::MediaStorage::CTImageStorage) && !dataSet.FindDataElement(gdcm::Tag(0x0028, 0x1052)))
+    {
+        if (makeElement("0028|1052", "0", 1, element))
+            dataSet.Replace(element);
+        if (makeElement("0028|1053", "1", 1, element))
+            dataSet.Replace(element);
+    }
+
+    // Our slices are always single grey scale samples.
+    if (makeElement("0028|0002", "1", 1, element))
+        dataSet.Replace(element);
+    if (makeElement("0028|0004", "MONOCHROME2", 11, element))
+        dataSet.Replace(element);
+
+    seriesDataSet = dataSet;
+
+    // gdcm::Writer makes the rest of the file meta information from the data set of each slice.
+    file->GetHeader().SetDataSetTransferSyntax(CompressionTransferSyntax(compression));
+}
+
+ErrorCode DicomSliceTemplate::write(const SliceDictionary& dict, const AnyImage2DType* slice,
+                                    const std::string& fileName, OutputSink& sink)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    if (!setPixels(slice))
+    {
+        LOG4CPLUS_ERROR(logger, "The slice for " << fileName << " has a pixel type which cannot be written.");
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    if ((compression != Compression::NONE) && !compressPixels())
+    {
+        LOG4CPLUS_ERROR(logger, "Could not compress the pixels for " << fileName << " with "
+                        << CompressionName(compression));
+        file->GetDataSet().Remove(gdcm::Tag(0x7fe0, 0x0010));
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    setSliceAttributes(dict);
+
+    gdcm::Writer writer;
+    writer.SetFile(*file);
+    std::ostringstream encoded;
+    writer.SetStream(encoded);
+    bool written = writer.Write();
+
+    // Don't hold on to a copy of the pixels until the next slice.
+    file->GetDataSet().Remove(gdcm::Tag(0x7fe0, 0x0010));
+
+    if (!written)
+    {
+        LOG4CPLUS_ERROR(logger, "Could not encode " << fileName);
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    return sink.write(fileName, encoded.str());
+}
+
+bool DicomSliceTemplate::makeElement(const char* key, const char* value, std::size_t length,
+                                     gdcm::DataElement& element)
+{
+    // Keys which are not tags, such as ITK's own, are left out. The file meta information
+    // is made by gdcm::Writer.
+    gdcm::Tag tag;
+    if (!tag.ReadFromPipeSeparatedString(key) || (tag.GetGroup() == 0x0002) || tag.IsGroupLength())
+        return false;
+
+    const gdcm::DictEntry& dictEntry = gdcm::Global::GetInstance().GetDicts().GetDictEntry(tag);
+    gdcm::VR::VRType vrType = dictEntry.GetVR();
+    gdcm::VR vr(vrType);
+
+    element = gdcm::DataElement(tag);
+    element.SetVR(vr.IsVRFile() ? vr : gdcm::VR(gdcm::VR::UN));
+
+    if (gdcm::VR::IsASCII(vrType))
+    {
+        // Values have an even length. UIDs are padded with a null and the rest with a space.
+        std::string padded(value, length);
+        if (padded.size() % 2 != 0)
+            padded += (vrType == gdcm::VR::UI) ? '\0' : ' ';
+        element.SetByteValue(padded.data(), gdcm::VL(static_cast<uint32_t>(padded.size())));
+    }
+    else
+    {
+        gdcm::StringFilter filter;
+        std::string binary = filter.FromString(tag, value, length);
+        element.SetByteValue(binary.data(), gdcm::VL(static_cast<uint32_t>(binary.size())));
+    }
+
+    return true;
+}
+
+void DicomSliceTemplate::setSliceAttributes(const SliceDictionary& dict)
+{
+    gdcm::DataSet& dataSet = file->GetDataSet();
+    gdcm::DataElement element;
+
+    // The slices of an image share its layer so its entries are converted once.
+    bool imageChanged = (dict.imageLayer() != appliedImage);
+    if (imageChanged)
+    {
+        appliedImage = dict.imageLayer();
+        imageElements.clear();
+        if (!appliedImage.isNull())
+        {
+            for (SliceDictionary::EntryList::const_iterator iter = appliedImage->begin();
+                 iter != appliedImage->end(); ++iter)
+            {
+                if (makeElement(iter->first.c_str(), iter->second.c_str(), iter->second.size(), element))
+                    imageElements.push_back(element);
+            }
+        }
+    }
+
+    // The image's values have to go back wherever the last slice replaced them.
+    bool reapplyImage = imageChanged;
+    for (std::vector<gdcm::DataElement>::const_iterator iter = sliceElements.begin();
+         iter != sliceElements.end(); ++iter)
+    {
+        if (HasTag(imageElements, iter->GetTag()))
+            reapplyImage = true;
+    }
+
+    sliceElements.clear();
+    for (int idx = 0; idx < dict.entryCount(); ++idx)
+    {
+        const char* value = dict.entryValue(idx);
+        if (makeElement(dict.entryKey(idx), value, std::strlen(value), element))
+            sliceElements.push_back(element);
+    }
+
+    // Anything set for the last slice and not for this one goes back to the series value.
+    for (std::vector<gdcm::Tag>::const_iterator iter = patchedTags.begin(); iter != patchedTags.end(); ++iter)
+    {
+        if (!HasTag(imageElements, *iter) && !HasTag(sliceElements, *iter))
+            restoreAttribute(*iter);
+    }
+
+    patchedTags.clear();
+    for (std::vector<gdcm::DataElement>::const_iterator iter = imageElements.begin();
+         iter != imageElements.end(); ++iter)
+    {
+        if (reapplyImage)
+            dataSet.Replace(*iter);
+        patchedTags.push_back(iter->GetTag());
+    }
+
+    for (std::vector<gdcm::DataElement>::const_iterator iter = sliceElements.begin();
+         iter != sliceElements.end(); ++iter)
+    {
+        dataSet.Replace(*iter);
+        patchedTags.push_back(iter->GetTag());
+    }
+}
+
+void DicomSliceTemplate::restoreAttribute(const gdcm::Tag& tag)
+{
+    if (seriesDataSet.FindDataElement(tag))
+        file->GetDataSet().Replace(seriesDataSet.GetDataElement(tag));
+    else
+        file->GetDataSet().Remove(tag);
+}
+
+bool DicomSliceTemplate::tryCompression(const AnyImage2DType* slice, CompressionTrial& trial)
+{
+    if (!setPixels(slice))
+        return false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    gdcm::DataSet& dataSet = file->GetDataSet();
+    const gdcm::DataElement& pixelData = dataSet.GetDataElement(gdcm::Tag(0x7fe0, 0x0010));
+    gdcm::DataElement compressed;
+    bool isCompressed = CompressPixels(trial.compression, pixelData, columns, rows, bitsAllocated, isSigned,
+                                       compressed);
+    if (isCompressed)
+    {
+        trial.nanoseconds += timer.nsecsElapsed();
+        trial.rawBytes += qint64(pixelData.GetByteValue()->GetLength());
+        trial.storedBytes += qint64(compressed.GetSequenceOfFragments()->ComputeByteLength());
+    }
+
+    dataSet.Remove(gdcm::Tag(0x7fe0, 0x0010));
+    return isCompressed;
+}
+
+bool DicomSliceTemplate::setPixels(const AnyImage2DType* slice)
+{
+    SlicePixels pixels;
+    if (!GetSlicePixels(slice, pixels))
+        return false;
+
+    setPixelModule(pixels.columns, pixels.rows, pixels.spacing, pixels.bitsAllocated, pixels.isSigned);
+
+    gdcm::DataElement pixelData(gdcm::Tag(0x7fe0, 0x0010));
+    pixelData.SetVR((pixels.bitsAllocated == 8) ? gdcm::VR::OB : gdcm::VR::OW);
+    pixelData.SetByteValue(pixels.data, gdcm::VL(static_cast<uint32_t>(pixels.length)));
+    file->GetDataSet().Replace(pixelData);
+
+    return true;
+}
+
+bool DicomSliceTemplate::compressPixels()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    gdcm::DataSet& dataSet = file->GetDataSet();
+    const gdcm::DataElement& pixelData = dataSet.GetDataElement(gdcm::Tag(0x7fe0, 0x0010));
+    gdcm::DataElement compressed;
+    if (!CompressPixels(compression, pixelData, columns, rows, bitsAllocated, isSigned, compressed))
+        return false;
+
+    if (progress != 0)
+    {
+        const gdcm::ByteValue* rawPixels = pixelData.GetByteValue();
+        qint64 rawBytes = (rawPixels != 0) ? qint64(rawPixels->GetLength()) : 0;
+        qint64 storedBytes = qint64(compressed.GetSequenceOfFragments()->ComputeByteLength());
+        progress->pixelsCompressed(rawBytes, storedBytes, timer.nsecsElapsed());
+    }
+
+    dataSet.Replace(compressed);
+    return true;
+}
+
+void DicomSliceTemplate::setPixelModule(unsigned sliceColumns, unsigned sliceRows, const double sliceSpacing[2],
+                                        unsigned short sliceBitsAllocated, bool sliceIsSigned)
+{
+    // The slices of a series are nearly always alike so this is rarely more than a comparison.
+    if ((sliceColumns == columns) && (sliceRows == rows)
+            && (sliceSpacing[0] == spacing[0]) && (sliceSpacing[1] == spacing[1])
+            && (sliceBitsAllocated == bitsAllocated) && (sliceIsSigned == isSigned))
+        return;
+
+    columns = sliceColumns;
+    rows = sliceRows;
+    spacing[0] = sliceSpacing[0];
+    spacing[1] = sliceSpacing[1];
+    bitsAllocated = sliceBitsAllocated;
+    isSigned = sliceIsSigned;
+
+    addPixelModule(file->GetDataSet(), columns, rows, spacing, bitsAllocated, isSigned);
+}
+
+void DicomSliceTemplate::addPixelModule(gdcm::DataSet& dataSet, unsigned columns, unsigned rows,
+                                        const double spacing[2], unsigned short bitsAllocated, bool isSigned)
+{
+    gdcm::Attribute<0x0028, 0x0010> rowsAttribute;
+    rowsAttribute.SetValue(static_cast<unsigned short>(rows));
+    dataSet.Replace(rowsAttribute.GetAsDataElement());
+
+    gdcm::Attribute<0x0028, 0x0011> columnsAttribute;
+    columnsAttribute.SetValue(static_cast<unsigned short>(columns));
+    dataSet.Replace(columnsAttribute.GetAsDataElement());
+
+    // DICOM has the spacing between rows first.
+    gdcm::Attribute<0x0028, 0x0030> spacingAttribute;
+    spacingAttribute.SetValue(spacing[1], 0);
+    spacingAttribute.SetValue(spacing[0], 1);
+    dataSet.Replace(spacingAttribute.GetAsDataElement());
+
+    gdcm::Attribute<0x0028, 0x0100> bitsAllocatedAttribute;
+    bitsAllocatedAttribute.SetValue(bitsAllocated);
+    dataSet.Replace(bitsAllocatedAttribute.GetAsDataElement());
+
+    gdcm::Attribute<0x0028, 0x0101> bitsStoredAttribute;
+    bitsStoredAttribute.SetValue(bitsAllocated);
+    dataSet.Replace(bitsStoredAttribute.GetAsDataElement());
+
+    gdcm::Attribute<0x0028, 0x0102> highBitAttribute;
+    highBitAttribute.SetValue(static_cast<unsigned short>(bitsAllocated - 1));
+    dataSet.Replace(highBitAttribute.GetAsDataElement());
+
+    gdcm::Attribute<0x0028, 0x0103> pixelRepresentationAttribute;
+    pixelRepresentationAttribute.SetValue(isSigned ? 1 : 0);
+    dataSet.Replace(pixelRepresentationAttribute.GetAsDataElement());
+}
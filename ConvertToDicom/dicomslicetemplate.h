@@ -0,0 +1,165 @@
+//
+//  dicomslicetemplate.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DICOMSLICETEMPLATE_H
+#define DICOMSLICETEMPLATE_H
+
+#include "logger.h"
+#include "errorcodes.h"
+#include "itktypedefs.h"
+#include "slicedictionary.h"
+#include "pixelcodec.h"
+#include "outputsink.h"
+
+#include "itkheaders.pch.h"
+
+#include <string>
+#include <vector>
+
+class ConversionProgress;
+
+/**
+ * A DICOM file held ready for writing the slices of one series directly with gdcm. The
+ * attributes of the series are converted to a gdcm::DataSet once, when the template is made.
+ * Writing a slice then replaces only the attributes of its image and its own attributes, such
+ * as the instance number, the position and the SOP Instance UID, and the pixel data. The
+ * image pixel module is set again only when a slice differs from the one before it. The
+ * pixels are compressed, if they are to be, by the thread writing the slice.
+ *
+ * A template is not thread safe: gdcm shares the values of data elements without locking, so
+ * each thread must write with its own.
+ */
+class DicomSliceTemplate
+{
+public:
+    /**
+     * Constructor.
+     * @param seriesLayer The attributes shared by every slice of the series.
+     * @param compression The compression of the pixels.
+     * @param progress Records how well the pixels compress. May be null.
+     */
+    DicomSliceTemplate(const SliceDictionary::SeriesLayer& seriesLayer, Compression compression,
+                       ConversionProgress* progress);
+
+    /**
+     * Write one slice. The file is encoded in memory and given to the sink whole.
+     * @param dict The attributes of the slice. It must have the series layer of the template.
+     * @param slice The slice. It must have one of the pixel types of the DICOM output.
+     * @param fileName The name of the file in the output directory.
+     * @param sink Where the file goes.
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode write(const SliceDictionary& dict, const AnyImage2DType* slice, const std::string& fileName,
+                    OutputSink& sink);
+
+    /**
+     * Compress the pixels of a slice without writing it, to see how well a codec does on them.
+     * The compression of the template is not used.
+     * @param slice The slice. It must have one of the pixel types of the DICOM output.
+     * @param trial Says which codec to try. The sizes and the time taken are added to it.
+     * @return true if the pixels were compressed.
+     */
+    bool tryCompression(const AnyImage2DType* slice, CompressionTrial& trial);
+
+    /**
+     * Make a data element from a dictionary entry. The VR is the one in the DICOM dictionary
+     * and values with binary VRs are converted from their string form.
+     * @param key The DICOM tag as "gggg|eeee".
+     * @param value The value.
+     * @param length The length of the value.
+     * @param element Set to the data element.
+     * @return false if the key is not a tag which belongs in the data set.
+     */
+    static bool makeElement(const char* key, const char* value, std::size_t length, gdcm::DataElement& element);
+
+    /**
+     * Set the attributes of the image pixel module which depend on the pixels, replacing any
+     * already in the data set.
+     * @param dataSet The data set.
+     * @param columns The number of columns.
+     * @param rows The number of rows.
+     * @param spacing The pixel spacing, column spacing first as ITK has it.
+     * @param bitsAllocated The number of bits per pixel.
+     * @param isSigned Whether the pixels are signed.
+     */
+    static void addPixelModule(gdcm::DataSet& dataSet, unsigned columns, unsigned rows, const double spacing[2],
+                               unsigned short bitsAllocated, bool isSigned);
+
+private:
+
+    /**
+     * Set the attributes of the slice's image and the slice's own. Any set for the last slice
+     * and not for this one go back to their series values.
+     * @param dict The attributes of the slice.
+     */
+    void setSliceAttributes(const SliceDictionary& dict);
+
+    /**
+     * Put an attribute back as the series has it, or remove it if the series does not have it.
+     * @param tag The tag of the attribute.
+     */
+    void restoreAttribute(const gdcm::Tag& tag);
+
+    /**
+     * Set the image pixel module and the pixel data of a slice.
+     * @param slice The slice.
+     * @return false if the slice has none of the pixel types of the DICOM output.
+     */
+    bool setPixels(const AnyImage2DType* slice);
+
+    /**
+     * Replace the native pixel data with its compressed form.
+     * @return true if the pixels were compressed.
+     */
+    bool compressPixels();
+
+    /**
+     * Set the attributes of the image pixel module for the slice, if they are not already set
+     * for it.
+     * @param sliceColumns The number of columns.
+     * @param sliceRows The number of rows.
+     * @param sliceSpacing The pixel spacing, column spacing first as ITK has it.
+     * @param sliceBitsAllocated The number of bits per pixel.
+     * @param sliceIsSigned Whether the pixels are signed.
+     */
+    void setPixelModule(unsigned sliceColumns, unsigned sliceRows, const double sliceSpacing[2],
+                        unsigned short sliceBitsAllocated, bool sliceIsSigned);
+
+    Compression compression;                     ///< The compression of the pixels.
+    ConversionProgress* progress;                ///< Records the compression. May be null.
+    gdcm::SmartPointer<gdcm::File> file;         ///< The file written for each slice.
+    gdcm::DataSet seriesDataSet;                 ///< The series attributes, as first set in file.
+
+    SliceDictionary::ImageLayer appliedImage;    ///< The image layer of the last slice written.
+    std::vector<gdcm::DataElement> imageElements; ///< The attributes of appliedImage.
+    std::vector<gdcm::DataElement> sliceElements; ///< The own attributes of the last slice.
+    std::vector<gdcm::Tag> patchedTags;          ///< Attributes which differ from the series.
+
+    unsigned columns;                            ///< Columns in the image pixel module.
+    unsigned rows;                               ///< Rows in the image pixel module.
+    double spacing[2];                           ///< Pixel spacing in the image pixel module.
+    unsigned short bitsAllocated;                ///< Bits allocated in the image pixel module.
+    bool isSigned;                               ///< Pixel representation in the image pixel module.
+
+    Logger logger; ///< Logger for this class.
+};
+
+#endif // DICOMSLICETEMPLATE_H
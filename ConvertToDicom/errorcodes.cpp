@@ -46,6 +46,8 @@ const char* ErrorCodeAsString(ErrorCode code)
             return "Directory not empty";
         case ErrorCode::ERROR_IMAGE_INCONSISTENT:
             return "Image inconsistent";
+        case ErrorCode::ERROR_CANCELLED:
+            return "Cancelled";
         default:
             return QString("Unknown ErrorCode value: %1").arg(static_cast<int>(code)).toStdString().c_str();
     };
@@ -35,7 +35,8 @@ enum struct ErrorCode
     ERROR_READING_PARAMETERS, ///< Problem reading DICOM dictionary.
     ERROR_CREATING_DIRECTORY, ///< Problem creating a directory.
     ERROR_DIRECTORY_NOT_EMPTY,///< Directory contains files when it shouldn't.
-    ERROR_IMAGE_INCONSISTENT  ///< Problem with input images.
+    ERROR_IMAGE_INCONSISTENT, ///< Problem with input images.
+    ERROR_CANCELLED           ///< The user stopped the operation.
 };
 
 const char* ErrorCodeAsString(ErrorCode code);
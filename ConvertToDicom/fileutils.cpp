@@ -21,6 +21,7 @@
  */
 #include "fileutils.h"
 #include "imageinfo.h"
+#include "imageprobe.h"
 
 #include "itkheaders.pch.h"
 
@@ -36,24 +37,12 @@ ErrorCode FileUtils::getImageFileNames(const QString& dirPath, QStringList& file
 {
     LOG4CPLUS_TRACE(logger, "Enter");
 
-    // Assume the array is not empty and empty it
-    fileNames.clear();
-
-    QDir inputDir(dirPath);
-
-    QStringList fNames = inputDir.entryList(QDir::Files | QDir::Readable, QDir::Name);
-
-    // we have to prepend the directory path to the file names
-    int len = fNames.length();
-    for (int idx = 0; idx < len; ++idx)
-    {
-        QString path = inputDir.absolutePath() + "/" + fNames[idx];
-        LOG4CPLUS_DEBUG(logger, fNames[idx].toStdString());
-        fileNames.append(path);
-    }
+    // The probe keeps the listing, and the HeaderIndex keeps it between runs.
+    // A directory whose first file cannot be read still has a listing.
+    ImageProbe::getInstance()->fileNames(dirPath, fileNames);
 
     LOG4CPLUS_INFO(logger, "Reading " << fileNames.length() << " file names from directory: "
-                   << inputDir.absolutePath().toStdString());
+                   << QDir(dirPath).absolutePath().toStdString());
 
     if (fileNames.isEmpty())
         return ErrorCode::ERROR_FILE_NOT_FOUND;
@@ -65,85 +54,11 @@ ErrorCode FileUtils::getImageInfo(const QString& inputDirPath, ImageInfo& info)
 {
     LOG4CPLUS_TRACE(logger, "Enter");
 
-    info.init();
-    QDir inputDir(inputDirPath);
-
-    //std::string inDir = inputDir.path().toStdString();
-    QStringList fileNames;
-
-    // Take the information we need from the first image
-    ErrorCode errCode = getImageFileNames(inputDirPath, fileNames);
+    ErrorCode errCode = ImageProbe::getInstance()->imageInfo(inputDirPath, info);
     if (errCode != ErrorCode::SUCCESS)
-    {
-        LOG4CPLUS_ERROR(logger, "Could not find files in " << inputDirPath.toStdString());
-        return errCode;
-    }
-
-    std::string firstFileName(fileNames[0].toStdString());
-    itk::ImageIOBase::Pointer imageIO =
-        itk::ImageIOFactory::CreateImageIO(firstFileName.c_str(), itk::ImageIOFactory::ReadMode);
-
-    // If there is a problem, catch it
-    if (imageIO.IsNull())
-    {
-        LOG4CPLUS_ERROR(logger, "Could not get metadata from file: " << firstFileName);
-        return ErrorCode::ERROR;
-    };
-
-    imageIO->SetFileName(firstFileName);
-    imageIO->ReadImageInformation();
-
-    std::string nameOfClass = imageIO->GetNameOfClass();
-    info.setImageTypeName(nameOfClass);
-    LOG4CPLUS_DEBUG(logger, "ImageIO class name = " << imageIO->GetNameOfClass());
-
-    //    if (std::string(imageIO->GetNameOfClass()) == std::string("GDCMImageIO"))
-    //    {
-
-    //        itk::GDCMImageIO::Pointer& p = reinterpret_cast<itk::GDCMImageIO::Pointer&>(imageIO);
-    //        itk::MetaDataDictionary seriesDict = p->GetMetaDataDictionary();
-
-    //    }
-
-    // Get the number of dimensions.
-    unsigned numDims = imageIO->GetNumberOfDimensions();
-    info.setNumDims(numDims);
-    LOG4CPLUS_DEBUG(logger, "dimensions = " << numDims);
-
-    int numFiles = fileNames.length();
-
-    for (unsigned int idx = 0; idx < numDims; ++idx)
-    {
-        info.setSpacing(idx, imageIO->GetSpacing(idx));
-    }
-
-    if (numDims == 3)
-        info.setSlicesPerImage(int(imageIO->GetDimensions(2)));
-    else
-        info.setSlicesPerImage(1);
-
-    info.setNumberOfSlices(numFiles * info.slicesPerImage());
-    info.setNumberOfImages(numFiles / info.slicesPerImage());
-
-    LOG4CPLUS_DEBUG(logger, "slicesPerImage = " << info.slicesPerImage());
-    LOG4CPLUS_DEBUG(logger, "imageSliceSpacing = " << info.spacingStr());
-    LOG4CPLUS_DEBUG(logger, "numberOfImages = " << info.numberOfImages());
-
-    // use for creating strings below.
-    std::ostringstream value;
-
-    // Set the Image Orientation Patient attribute from the image direction info.
-    std::vector<double> dir = imageIO->GetDirection(0);
-    value << dir[0] << "\\" << dir[1] << "\\" << dir[2] << "\\";
-    dir = imageIO->GetDirection(1);
-    value << dir[0] << "\\" << dir[1] << "\\" << dir[2];
-    std::string imageOrientationPatient = value.str();
-    info.setImageOrientationPatient(imageOrientationPatient);
-
-    LOG4CPLUS_DEBUG(logger, "imagePatientOrientation = " << info.imageOrientationPatient());
-
-    return ErrorCode::SUCCESS;
+        LOG4CPLUS_ERROR(logger, "Could not get metadata from files in " << inputDirPath.toStdString());
 
+    return errCode;
 }
 
 bool FileUtils::isValidSourceDir(const QString& dirPath)
@@ -0,0 +1,289 @@
+//
+//  headerindex.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "headerindex.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace
+{
+// Identifies an index file, and its layout. Change the version when the layout changes.
+const quint32 IndexMagic = 0x43544448;
+const quint32 IndexVersion = 1;
+
+QDataStream& operator<<(QDataStream& stream, const std::vector<double>& values)
+{
+    stream << quint32(values.size());
+    for (std::size_t idx = 0; idx < values.size(); ++idx)
+        stream << values[idx];
+    return stream;
+}
+
+QDataStream& operator>>(QDataStream& stream, std::vector<double>& values)
+{
+    quint32 size;
+    stream >> size;
+    values.resize(size);
+    for (std::size_t idx = 0; idx < values.size(); ++idx)
+        stream >> values[idx];
+    return stream;
+}
+
+QDataStream& operator<<(QDataStream& stream, const ImageHeader& header)
+{
+    stream << quint32(header.numDims);
+    for (unsigned idx = 0; idx < header.numDims; ++idx)
+    {
+        stream << quint64(header.dimensions[idx]) << header.spacing[idx] << header.origin[idx]
+               << header.direction[idx];
+    }
+    stream << qint32(header.componentType) << qint32(header.pixelType) << quint32(header.numComponents)
+           << QString::fromStdString(header.imageIOClass);
+    return stream;
+}
+
+QDataStream& operator>>(QDataStream& stream, ImageHeader& header)
+{
+    header = ImageHeader();
+
+    quint32 numDims;
+    stream >> numDims;
+    if (numDims > 3)
+    {
+        stream.setStatus(QDataStream::ReadCorruptData);
+        return stream;
+    }
+
+    header.numDims = numDims;
+    header.dimensions.resize(numDims);
+    header.spacing.resize(numDims);
+    header.origin.resize(numDims);
+    header.direction.resize(numDims);
+    for (unsigned idx = 0; idx < numDims; ++idx)
+    {
+        quint64 dimension;
+        stream >> dimension >> header.spacing[idx] >> header.origin[idx] >> header.direction[idx];
+        header.dimensions[idx] = itk::SizeValueType(dimension);
+    }
+
+    qint32 componentType;
+    qint32 pixelType;
+    quint32 numComponents;
+    QString imageIOClass;
+    stream >> componentType >> pixelType >> numComponents >> imageIOClass;
+    header.componentType = itk::ImageIOBase::IOComponentType(componentType);
+    header.pixelType = itk::ImageIOBase::IOPixelType(pixelType);
+    header.numComponents = numComponents;
+    header.imageIOClass = imageIOClass.toStdString();
+    return stream;
+}
+}
+
+HeaderIndex::HeaderIndex()
+    : cacheDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/HeaderIndex"),
+      logger(Logger::getInstance(std::string(LOGGER_NAME) + ".HeaderIndex"))
+{
+
+}
+
+bool HeaderIndex::fileNames(const QString& dirPath, QStringList& fileNames)
+{
+    QDir dir(dirPath);
+    QString absPath = dir.absolutePath();
+    QDateTime modified = QFileInfo(absPath).lastModified();
+
+    fileNames.clear();
+
+    QMutexLocker locker(&mutex);
+    const DirRecord& record = dirRecord(absPath);
+    if (!record.modified.isValid() || record.modified != modified)
+        return false;
+
+    for (int idx = 0; idx < record.fileNames.length(); ++idx)
+        fileNames.append(absPath + "/" + record.fileNames[idx]);
+
+    return true;
+}
+
+void HeaderIndex::setFileNames(const QString& dirPath, const QStringList& fileNames)
+{
+    QString absPath = QDir(dirPath).absolutePath();
+    QDateTime modified = QFileInfo(absPath).lastModified();
+
+    QStringList names;
+    for (int idx = 0; idx < fileNames.length(); ++idx)
+        names.append(QFileInfo(fileNames[idx]).fileName());
+
+    QMutexLocker locker(&mutex);
+    DirRecord& record = dirRecord(absPath);
+    record.modified = modified;
+    record.fileNames = names;
+
+    QHash<QString, FileRecord> files;
+    for (int idx = 0; idx < names.length(); ++idx)
+    {
+        QHash<QString, FileRecord>::const_iterator iter = record.files.constFind(names[idx]);
+        if (iter != record.files.constEnd())
+            files.insert(names[idx], iter.value());
+    }
+    record.files.swap(files);
+    record.dirty = true;
+}
+
+bool HeaderIndex::header(const QString& filePath, ImageHeader& header)
+{
+    QFileInfo fileInfo(filePath);
+    qint64 size = fileInfo.size();
+    QDateTime modified = fileInfo.lastModified();
+
+    QMutexLocker locker(&mutex);
+    const DirRecord& record = dirRecord(fileInfo.absolutePath());
+    QHash<QString, FileRecord>::const_iterator iter = record.files.constFind(fileInfo.fileName());
+    if (iter == record.files.constEnd() || iter.value().size != size || iter.value().modified != modified)
+        return false;
+
+    header = iter.value().header;
+    return true;
+}
+
+void HeaderIndex::setHeader(const QString& filePath, const ImageHeader& header)
+{
+    QFileInfo fileInfo(filePath);
+
+    FileRecord fileRecord;
+    fileRecord.size = fileInfo.size();
+    fileRecord.modified = fileInfo.lastModified();
+    fileRecord.header = header;
+
+    QMutexLocker locker(&mutex);
+    DirRecord& record = dirRecord(fileInfo.absolutePath());
+    record.files.insert(fileInfo.fileName(), fileRecord);
+    record.dirty = true;
+}
+
+void HeaderIndex::save(const QString& dirPath)
+{
+    QString absPath = QDir(dirPath).absolutePath();
+
+    // Copy the record so that the file is written without holding the lock.
+    DirRecord record;
+    {
+        QMutexLocker locker(&mutex);
+        DirRecord& current = dirRecord(absPath);
+        if (!current.dirty)
+            return;
+        current.dirty = false;
+        record = current;
+    }
+
+    if (!QDir().mkpath(cacheDir))
+    {
+        LOG4CPLUS_WARN(logger, "Could not create header index directory " << cacheDir.toStdString());
+        return;
+    }
+
+    // The index is written to a temporary file which replaces the old one only when complete,
+    // so another instance of the program never reads half of it.
+    QSaveFile file(indexPath(absPath));
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        LOG4CPLUS_WARN(logger, "Could not write header index " << file.fileName().toStdString());
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << IndexMagic << IndexVersion << absPath << record.modified << record.fileNames
+           << quint32(record.files.size());
+    for (QHash<QString, FileRecord>::const_iterator iter = record.files.constBegin();
+         iter != record.files.constEnd(); ++iter)
+    {
+        stream << iter.key() << iter.value().size << iter.value().modified << iter.value().header;
+    }
+
+    if (!file.commit())
+        LOG4CPLUS_WARN(logger, "Could not write header index " << file.fileName().toStdString());
+    else
+        LOG4CPLUS_DEBUG(logger, "Saved " << record.files.size() << " headers for " << absPath.toStdString());
+}
+
+HeaderIndex::DirRecord& HeaderIndex::dirRecord(const QString& dirPath)
+{
+    QHash<QString, DirRecord>::iterator iter = dirs.find(dirPath);
+    if (iter != dirs.end())
+        return iter.value();
+
+    DirRecord record;
+    if (load(indexPath(dirPath), record))
+        LOG4CPLUS_DEBUG(logger, "Loaded " << record.files.size() << " headers for " << dirPath.toStdString());
+
+    return dirs.insert(dirPath, record).value();
+}
+
+QString HeaderIndex::indexPath(const QString& dirPath) const
+{
+    QByteArray hash = QCryptographicHash::hash(dirPath.toUtf8(), QCryptographicHash::Sha1);
+    return cacheDir + "/" + QString::fromLatin1(hash.toHex()) + ".idx";
+}
+
+bool HeaderIndex::load(const QString& path, DirRecord& record)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic;
+    quint32 version;
+    QString dirPath;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != IndexMagic || version != IndexVersion)
+        return false;
+
+    quint32 numFiles;
+    DirRecord loaded;
+    stream >> dirPath >> loaded.modified >> loaded.fileNames >> numFiles;
+    for (quint32 idx = 0; idx < numFiles && stream.status() == QDataStream::Ok; ++idx)
+    {
+        QString name;
+        FileRecord fileRecord;
+        stream >> name >> fileRecord.size >> fileRecord.modified >> fileRecord.header;
+        loaded.files.insert(name, fileRecord);
+    }
+
+    if (stream.status() != QDataStream::Ok)
+    {
+        LOG4CPLUS_WARN(logger, "Ignoring damaged header index " << path.toStdString());
+        return false;
+    }
+
+    record = loaded;
+    return true;
+}
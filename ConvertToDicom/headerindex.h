@@ -0,0 +1,147 @@
+//
+//  headerindex.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HEADERINDEX_H
+#define HEADERINDEX_H
+
+#include "imageheader.h"
+#include "logger.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+/**
+ * A record, kept on disk between runs, of the files in each input directory and their headers.
+ * Operators open the same large directories many times, and listing a directory and reading
+ * thousands of headers over a network file system is slow. Each directory has its own index file
+ * in the per-user cache location so that directories do not contend with each other.
+ *
+ * A directory's list of files is used while the directory's modification time is unchanged. A
+ * file's header is used while the file's size and modification time are unchanged. The index
+ * is shared by the whole program and may be used from several threads at once.
+ */
+class HeaderIndex
+{
+public:
+    /**
+     * Get the global instance of this class.
+     * @return Pointer to single instance of this class.
+     */
+    static HeaderIndex* getInstance()
+    {
+        static HeaderIndex instance;
+        return &instance;
+    }
+
+    /**
+     * Get the files in a directory as they were when last listed.
+     * @param dirPath The path of the directory.
+     * @param fileNames Filled with the full paths of the files, in name order.
+     * @return true if the list is still current, false if the directory must be listed again.
+     */
+    bool fileNames(const QString& dirPath, QStringList& fileNames);
+
+    /**
+     * Record the files in a directory. Headers of files no longer in it are forgotten.
+     * @param dirPath The path of the directory.
+     * @param fileNames The full paths of the files, in name order.
+     */
+    void setFileNames(const QString& dirPath, const QStringList& fileNames);
+
+    /**
+     * Get the header of a file.
+     * @param filePath The path of the file.
+     * @param header Filled with the header.
+     * @return true if the header is still current, false if the file must be read again.
+     */
+    bool header(const QString& filePath, ImageHeader& header);
+
+    /**
+     * Record the header of a file. The file's size and modification time are taken now.
+     * @param filePath The path of the file.
+     * @param header The header read from the file.
+     */
+    void setHeader(const QString& filePath, const ImageHeader& header);
+
+    /**
+     * Write what has changed for a directory to its index file.
+     * @param dirPath The path of the directory.
+     */
+    void save(const QString& dirPath);
+
+private:
+    /** What is known about one file. */
+    struct FileRecord
+    {
+        qint64 size;        ///< Size of the file.
+        QDateTime modified; ///< Modification time of the file.
+        ImageHeader header; ///< The file's header.
+    };
+
+    /** What is known about one directory. */
+    struct DirRecord
+    {
+        DirRecord() : dirty(false) {}
+
+        QDateTime modified;                 ///< Modification time of the directory when listed.
+        QStringList fileNames;              ///< Names of the files, without the directory.
+        QHash<QString, FileRecord> files;   ///< Keyed by file name.
+        bool dirty;                         ///< Changed since it was loaded or saved.
+    };
+
+    /**
+     * Default constructor.
+     */
+    HeaderIndex();
+
+    /**
+     * Find the record of a directory, loading it from disk the first time. The mutex must be held.
+     * @param dirPath The absolute path of the directory.
+     * @return Reference to the record.
+     */
+    DirRecord& dirRecord(const QString& dirPath);
+
+    /**
+     * Get the name of the index file of a directory.
+     * @param dirPath The absolute path of the directory.
+     * @return The path of the index file.
+     */
+    QString indexPath(const QString& dirPath) const;
+
+    /**
+     * Read an index file.
+     * @param path The path of the index file.
+     * @param record Filled with what was read.
+     * @return true if the file was read. false if it is missing, damaged or of another version.
+     */
+    bool load(const QString& path, DirRecord& record);
+
+    QString cacheDir;                   ///< Where the index files are kept.
+    QMutex mutex;                       ///< Guards dirs.
+    QHash<QString, DirRecord> dirs;     ///< Keyed by absolute directory path.
+
+    Logger logger;                      ///< Logger for this class.
+};
+
+#endif // HEADERINDEX_H
@@ -0,0 +1,295 @@
+//
+//  hotfolderconverter.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "hotfolderconverter.h"
+#include "seriesconverter.h"
+#include "conversionjob.h"
+#include "dicomserieswriter.h"
+#include "imagereader.h"
+#include "imageinfo.h"
+#include "imageprobe.h"
+#include "headerindex.h"
+#include "rescale.h"
+
+#include <QDir>
+#include <QEventLoop>
+#include <QFileInfo>
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+// How often the directory is looked at, in case the watcher misses a change.
+static const int PollMsecs = 250;
+// A file whose size has not changed for this long is taken to be complete.
+static const int StableMsecs = 500;
+// A complete file which cannot be read is tried this many times before giving up.
+static const int MaxReadAttempts = 5;
+
+HotFolderConverter::HotFolderConverter(const SeriesInfo& settings, QObject* parent)
+    : QObject(parent),
+      seriesInfo(settings),
+      expectedFiles(0),
+      settleMsecs(10000),
+      lastActivity(0),
+      done(false),
+      result(ErrorCode::SUCCESS),
+      logger(Logger::getInstance(std::string(LOGGER_NAME) + ".HotFolderConverter"))
+{
+    connect(&watcher, SIGNAL(directoryChanged(QString)), this, SLOT(scan()));
+    connect(&pollTimer, SIGNAL(timeout()), this, SLOT(scan()));
+}
+
+HotFolderConverter::~HotFolderConverter()
+{
+
+}
+
+ErrorCode HotFolderConverter::run()
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    QString dirPath = seriesInfo.inputDir().absolutePath();
+    if (!QDir(dirPath).exists())
+    {
+        LOG4CPLUS_ERROR(logger, "Directory does not exist: " << dirPath.toStdString());
+        return ErrorCode::ERROR_FILE_NOT_FOUND;
+    }
+
+    LOG4CPLUS_INFO(logger, "Watching " << dirPath.toStdString());
+
+    done = false;
+    clock.start();
+    lastActivity = 0;
+
+    // The watcher may not work on a network file system, so we poll as well.
+    watcher.addPath(dirPath);
+    pollTimer.start(PollMsecs);
+
+    QEventLoop loop;
+    connect(this, SIGNAL(finished()), &loop, SLOT(quit()));
+    QTimer::singleShot(0, this, SLOT(scan()));
+    loop.exec();
+
+    return result;
+}
+
+void HotFolderConverter::scan()
+{
+    if (done)
+        return;
+
+    QDir dir(seriesInfo.inputDir().absolutePath());
+    QStringList names = dir.entryList(QDir::Files | QDir::Readable, QDir::Name);
+    qint64 now = clock.elapsed();
+
+    // Find the files which have stopped growing.
+    QStringList ready;
+    for (int idx = 0; idx < names.length(); ++idx)
+    {
+        QString path = dir.absoluteFilePath(names[idx]);
+        if (convertedFiles.contains(path))
+            continue;
+
+        qint64 size = QFileInfo(path).size();
+        QHash<QString, PendingFile>::iterator iter = pendingFiles.find(path);
+        if (iter == pendingFiles.end() || iter.value().size != size)
+        {
+            PendingFile pending;
+            pending.size = size;
+            pending.sizeChanged = now;
+            pendingFiles.insert(path, pending);
+            lastActivity = now;
+        }
+        else if (size > 0 && now - iter.value().sizeChanged >= StableMsecs)
+        {
+            ready.append(path);
+        }
+    }
+
+    for (int idx = 0; idx < ready.length(); ++idx)
+    {
+        const QString& path = ready[idx];
+
+        ErrorCode errCode = job.isNull() ? startSeries(path) : ErrorCode::SUCCESS;
+        if (errCode == ErrorCode::SUCCESS)
+            errCode = convertFile(path);
+
+        // The scanner may still have the file open.
+        if (errCode == ErrorCode::ERROR_READING_FILE && ++failedReads[path] < MaxReadAttempts)
+        {
+            LOG4CPLUS_DEBUG(logger, "Could not read " << path.toStdString() << " yet.");
+            continue;
+        }
+
+        if (errCode != ErrorCode::SUCCESS)
+        {
+            if (!writer.isNull())
+                writer->AbandonSeries();
+            finish(errCode);
+            return;
+        }
+
+        if (!lastFile.isEmpty() && path < lastFile)
+            LOG4CPLUS_WARN(logger, path.toStdString() << " arrived after " << lastFile.toStdString()
+                           << ". The slices are in order of arrival.");
+
+        lastFile = path;
+        convertedFiles.insert(path);
+        pendingFiles.remove(path);
+        failedReads.remove(path);
+        lastActivity = clock.elapsed();
+
+        if (expectedFiles > 0 && convertedFiles.size() >= expectedFiles)
+        {
+            finish(writer->FinishSeries());
+            return;
+        }
+    }
+
+    // Nothing has happened for a while so the series is taken to be complete.
+    if (!job.isNull() && clock.elapsed() - lastActivity >= settleMsecs)
+    {
+        if (!pendingFiles.isEmpty())
+            LOG4CPLUS_WARN(logger, "Ignoring " << pendingFiles.size() << " empty or unreadable files.");
+
+        finish(writer->FinishSeries());
+    }
+}
+
+ErrorCode HotFolderConverter::startSeries(const QString& filePath)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    if (!ReadImageHeader(filePath.toStdString(), 0, firstHeader) || firstHeader.numDims < 2)
+        return ErrorCode::ERROR_READING_FILE;
+
+    imageIOPrototype = CreateImageIOByName(firstHeader.imageIOClass).GetPointer();
+
+    // The rest of the directory may not have arrived so the parameters come from this file alone.
+    ImageInfo info;
+    try
+    {
+        ImageProbe::fillInfo(firstHeader, 1, info);
+    }
+    catch (std::invalid_argument&)
+    {
+        return ErrorCode::ERROR_READING_FILE;
+    }
+
+    SeriesConverter converter(&seriesInfo);
+    converter.setInputDir(seriesInfo.inputDir());
+    ErrorCode errCode = converter.extractImageParameters(info);
+    if (errCode != ErrorCode::SUCCESS)
+        return errCode;
+
+    errCode = converter.makeFullOutputPathDir(seriesInfo.outputDirStr());
+    if ((errCode == ErrorCode::ERROR_DIRECTORY_NOT_EMPTY) && seriesInfo.overwriteFiles())
+        errCode = ErrorCode::SUCCESS;
+    if (errCode != ErrorCode::SUCCESS)
+        return errCode;
+
+    int slicesPerImage = firstHeader.slicesPerImage();
+    job.reset(new ConversionJob(seriesInfo, &progress));
+    job->setImageCounts(expectedFiles, slicesPerImage, expectedFiles * slicesPerImage);
+
+    writer.reset(new DicomSeriesWriter(*job, job->seriesInfo().outputPath()));
+    errCode = writer->BeginSeries();
+    if (errCode != ErrorCode::SUCCESS)
+        return errCode;
+
+    LOG4CPLUS_INFO(logger, "Writing series to " << job->seriesInfo().outputPath().toStdString());
+
+    return ErrorCode::SUCCESS;
+}
+
+ErrorCode HotFolderConverter::convertFile(const QString& filePath)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    std::string fileName = filePath.toStdString();
+
+    ImageHeader header;
+    if (!ReadImageHeader(fileName, imageIOPrototype, header))
+        return ErrorCode::ERROR_READING_FILE;
+
+    std::string difference;
+    if (!HeadersConsistent(firstHeader, header, difference))
+    {
+        LOG4CPLUS_ERROR(logger, "File " << fileName << ": " << difference);
+        return ErrorCode::ERROR_IMAGE_INCONSISTENT;
+    }
+
+    ImageReader reader;
+    reader.SetUseSliceViews(seriesInfo.sliceViews());
+    reader.SetImageIOPrototype(imageIOPrototype);
+    ImageReader::ImageVector slices = reader.ReadImage(fileName);
+    if (slices.empty())
+        return ErrorCode::ERROR_READING_FILE;
+
+    // The rest of the series has not arrived, so a floating point image is rescaled over its own range.
+    if (NativeComponentType(header) == itk::ImageIOBase::FLOAT)
+    {
+        float minValue = std::numeric_limits<float>::infinity();
+        float maxValue = -std::numeric_limits<float>::infinity();
+        for (std::size_t idx = 0; idx < slices.size(); ++idx)
+            SliceRange(slices[idx].GetPointer(), minValue, maxValue);
+
+        job->setRescale(MakeRescale(minValue, maxValue));
+        for (std::size_t idx = 0; idx < slices.size(); ++idx)
+            slices[idx] = RescaleSlice(slices[idx], job->rescale());
+    }
+
+    // Each image is a time increment after the one before, as in SeriesConverter.
+    QList<QTime>& acqTimes = job->acqTimes();
+    if (acqTimes.isEmpty())
+        acqTimes.append(job->seriesInfo().studyDateTime().time());
+    else
+        acqTimes.append(acqTimes.last().addMSecs(int(std::round(job->seriesInfo().seriesTimeIncrement() * 1000.0))));
+
+    ErrorCode errCode = writer->AppendImage(slices);
+    if (errCode != ErrorCode::SUCCESS)
+    {
+        acqTimes.removeLast();
+        return errCode;
+    }
+
+    HeaderIndex::getInstance()->setHeader(filePath, header);
+
+    LOG4CPLUS_DEBUG(logger, "Converted " << fileName << " as image " << writer->NumberOfAppendedImages());
+
+    return ErrorCode::SUCCESS;
+}
+
+void HotFolderConverter::finish(ErrorCode errCode)
+{
+    done = true;
+    result = errCode;
+
+    pollTimer.stop();
+    watcher.removePath(seriesInfo.inputDir().absolutePath());
+    HeaderIndex::getInstance()->save(seriesInfo.inputDir().absolutePath());
+
+    LOG4CPLUS_INFO(logger, "Finished watching " << seriesInfo.inputDir().absolutePath().toStdString()
+                   << " after " << convertedFiles.size() << " files: " << ErrorCodeAsString(errCode));
+
+    emit finished();
+}
@@ -0,0 +1,186 @@
+//
+//  hotfolderconverter.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HOTFOLDERCONVERTER_H
+#define HOTFOLDERCONVERTER_H
+
+#include "errorcodes.h"
+#include "logger.h"
+#include "seriesinfo.h"
+#include "imageheader.h"
+#include "conversionprogress.h"
+
+#include "itkheaders.pch.h"
+
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QScopedPointer>
+#include <QSet>
+#include <QString>
+#include <QTimer>
+
+class ConversionJob;
+class DicomSeriesWriter;
+
+/**
+ * Converts a series while a scanner is still writing it. The input directory is watched and
+ * each file is converted as soon as it is complete, so the series is ready shortly after the
+ * last file arrives rather than a whole conversion later.
+ *
+ * A file is taken to be complete when its size has not changed between two looks at the
+ * directory. Files are converted in the order they become complete, which should also be
+ * name order. The series is finished when the expected number of files has been converted,
+ * or when no file has arrived for the settle time. Only then are the attributes which depend
+ * on the number of images, such as the number of temporal positions, filled in.
+ */
+class HotFolderConverter : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Class constructor.
+     * @param settings The settings for the series. The input directory is the one watched.
+     * @param parent The parent object.
+     */
+    explicit HotFolderConverter(const SeriesInfo& settings, QObject* parent = 0);
+    ~HotFolderConverter();
+
+    /**
+     * Set the number of files in the complete series.
+     * @param count The number of files. 0, the default, if not known.
+     */
+    void setExpectedFiles(int count)
+    {
+        expectedFiles = count;
+    }
+
+    /**
+     * Set how long to wait for another file before taking the series to be complete.
+     * @param msecs The time in milliseconds.
+     */
+    void setSettleTime(int msecs)
+    {
+        settleMsecs = msecs;
+    }
+
+    /**
+     * Watch the directory and convert the files until the series is complete or fails.
+     * @return Suitable code in ErrorCode enum.
+     */
+    ErrorCode run();
+
+    /**
+     * Get the number of slices written.
+     * @return The number of slices.
+     */
+    int slicesWritten() const
+    {
+        return progress.slicesWritten();
+    }
+
+    /**
+     * Get the counts kept while converting.
+     * @return The progress.
+     */
+    const ConversionProgress& conversionProgress() const
+    {
+        return progress;
+    }
+
+    /**
+     * Get where the DICOM files are written.
+     * @return The path of the output directory. Empty until the first file has arrived.
+     */
+    QString outputPath() const
+    {
+        return seriesInfo.outputPath();
+    }
+
+signals:
+    /**
+     * Emitted when the series is complete or has failed.
+     */
+    void finished();
+
+private slots:
+    /**
+     * Look for files which have arrived or have finished arriving, and convert them.
+     */
+    void scan();
+
+private:
+    /**
+     * Set up the conversion from the first file to arrive.
+     * @param filePath The path of the file.
+     * @return Suitable code in ErrorCode enum.
+     */
+    ErrorCode startSeries(const QString& filePath);
+
+    /**
+     * Convert one file.
+     * @param filePath The path of the file.
+     * @return Suitable code in ErrorCode enum.
+     */
+    ErrorCode convertFile(const QString& filePath);
+
+    /**
+     * Stop watching and report the result.
+     * @param errCode The result of the conversion.
+     */
+    void finish(ErrorCode errCode);
+
+    SeriesInfo seriesInfo;                 ///< The settings for the series.
+    int expectedFiles;                     ///< Number of files in the series. 0 if not known.
+    int settleMsecs;                       ///< Time without a new file after which the series is complete.
+
+    QFileSystemWatcher watcher;            ///< Tells us when the directory changes.
+    QTimer pollTimer;                      ///< Looks again in case the watcher misses something.
+    QElapsedTimer clock;                   ///< Started by run().
+    qint64 lastActivity;                   ///< When a file last arrived, grew or was converted.
+
+    /** A file which has not been converted yet. */
+    struct PendingFile
+    {
+        qint64 size;                       ///< Size when last seen.
+        qint64 sizeChanged;                ///< When the size last changed.
+    };
+
+    QHash<QString, PendingFile> pendingFiles; ///< Files not yet converted.
+    QHash<QString, int> failedReads;       ///< Number of times each file could not be read.
+    QSet<QString> convertedFiles;          ///< Files already converted.
+    QString lastFile;                      ///< The most recently converted file.
+
+    ConversionProgress progress;           ///< Counts the slices written.
+    QScopedPointer<ConversionJob> job;     ///< Made when the first file arrives.
+    QScopedPointer<DicomSeriesWriter> writer; ///< Made when the first file arrives.
+    ImageHeader firstHeader;               ///< Header of the first file. Others must match it.
+    itk::ImageIOBase::ConstPointer imageIOPrototype; ///< ImageIO which read the first file.
+
+    bool done;                             ///< The series is complete or has failed.
+    ErrorCode result;                      ///< The result of the conversion.
+
+    Logger logger;                         ///< Logger for this class.
+};
+
+#endif // HOTFOLDERCONVERTER_H
@@ -0,0 +1,162 @@
+//
+//  imageheader.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "imageheader.h"
+#include "imagereader.h"
+
+#include "itkheaders.pch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+// Geometry which differs by less than this fraction of a pixel is taken to be the same.
+const double Tolerance = 1.0e-4;
+
+bool Close(double a, double b, double scale)
+{
+    return std::abs(a - b) <= Tolerance * std::max(std::abs(scale), 1.0);
+}
+}
+
+ImageHeader::ImageHeader()
+    : numDims(0),
+      componentType(itk::ImageIOBase::UNKNOWNCOMPONENTTYPE),
+      pixelType(itk::ImageIOBase::UNKNOWNPIXELTYPE),
+      numComponents(0)
+{
+
+}
+
+int ImageHeader::slicesPerImage() const
+{
+    if (numDims == 3)
+        return int(dimensions[2]);
+    else
+        return 1;
+}
+
+bool ReadImageHeader(const std::string& fileName, const itk::ImageIOBase* prototype, ImageHeader& header)
+{
+    header = ImageHeader();
+
+    itk::ImageIOBase::Pointer imageIO = CreateImageIO(fileName, prototype);
+    if (imageIO.IsNull())
+        return false;
+
+    try
+    {
+        imageIO->SetFileName(fileName);
+        imageIO->ReadImageInformation();
+    }
+    catch (itk::ExceptionObject&)
+    {
+        return false;
+    }
+
+    header.numDims = imageIO->GetNumberOfDimensions();
+    for (unsigned idx = 0; idx < header.numDims; ++idx)
+    {
+        header.dimensions.push_back(imageIO->GetDimensions(idx));
+        header.spacing.push_back(imageIO->GetSpacing(idx));
+        header.origin.push_back(imageIO->GetOrigin(idx));
+        header.direction.push_back(imageIO->GetDirection(idx));
+    }
+    header.componentType = imageIO->GetComponentType();
+    header.pixelType = imageIO->GetPixelType();
+    header.numComponents = imageIO->GetNumberOfComponents();
+    header.imageIOClass = imageIO->GetNameOfClass();
+
+    return true;
+}
+
+bool HeadersConsistent(const ImageHeader& reference, const ImageHeader& header, std::string& difference)
+{
+    std::ostringstream stream;
+
+    if (header.numDims != reference.numDims)
+    {
+        stream << "inconsistent number of dimensions: " << header.numDims << ", expected " << reference.numDims;
+        difference = stream.str();
+        return false;
+    }
+
+    if (header.componentType != reference.componentType || header.pixelType != reference.pixelType
+            || header.numComponents != reference.numComponents)
+    {
+        stream << "inconsistent pixel type: "
+               << itk::ImageIOBase::GetPixelTypeAsString(header.pixelType) << " of "
+               << itk::ImageIOBase::GetComponentTypeAsString(header.componentType) << ", expected "
+               << itk::ImageIOBase::GetPixelTypeAsString(reference.pixelType) << " of "
+               << itk::ImageIOBase::GetComponentTypeAsString(reference.componentType);
+        difference = stream.str();
+        return false;
+    }
+
+    for (unsigned dim = 0; dim < reference.numDims; ++dim)
+    {
+        if (header.dimensions[dim] != reference.dimensions[dim])
+        {
+            stream << "inconsistent dimension " << dim << ": " << header.dimensions[dim]
+                   << ", expected " << reference.dimensions[dim];
+            difference = stream.str();
+            return false;
+        }
+
+        if (!Close(header.spacing[dim], reference.spacing[dim], reference.spacing[dim]))
+        {
+            stream << "inconsistent spacing " << dim << ": " << header.spacing[dim]
+                   << ", expected " << reference.spacing[dim];
+            difference = stream.str();
+            return false;
+        }
+
+        for (unsigned idx = 0; idx < reference.numDims; ++idx)
+        {
+            if (!Close(header.direction[dim][idx], reference.direction[dim][idx], 1.0))
+            {
+                stream << "inconsistent direction " << dim;
+                difference = stream.str();
+                return false;
+            }
+        }
+    }
+
+    // The offset between the origins must lie along the slice normal, i.e. have no
+    // component along the rows or columns.
+    for (unsigned dim = 0; dim < 2; ++dim)
+    {
+        double offset = 0.0;
+        for (unsigned idx = 0; idx < reference.numDims; ++idx)
+            offset += (header.origin[idx] - reference.origin[idx]) * reference.direction[dim][idx];
+
+        if (!Close(offset, 0.0, reference.spacing[dim]))
+        {
+            stream << "inconsistent origin: offset by " << offset << " along axis " << dim;
+            difference = stream.str();
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,76 @@
+//
+//  imageheader.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef IMAGEHEADER_H
+#define IMAGEHEADER_H
+
+#include "itktypedefs.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * The geometry and pixel type of one image file, as read from its header without
+ * reading the pixels.
+ */
+struct ImageHeader
+{
+    ImageHeader();
+
+    /**
+     * Get the number of slices in the file.
+     * @return The third dimension of a 3D image, 1 otherwise.
+     */
+    int slicesPerImage() const;
+
+    unsigned numDims;                              ///< Number of dimensions. 2 or 3.
+    std::vector<itk::SizeValueType> dimensions;    ///< Size along each axis.
+    std::vector<double> spacing;                   ///< Pixel spacing along each axis.
+    std::vector<double> origin;                    ///< Position of the first pixel.
+    std::vector<std::vector<double> > direction;   ///< Direction of each axis.
+    itk::ImageIOBase::IOComponentType componentType; ///< Type of each pixel component.
+    itk::ImageIOBase::IOPixelType pixelType;       ///< Scalar, RGB etc.
+    unsigned numComponents;                        ///< Number of components in each pixel.
+    std::string imageIOClass;                      ///< Name of the ImageIO class which read it.
+};
+
+/**
+ * Read the header of an image file.
+ * @param fileName The name of the file.
+ * @param prototype An ImageIO of the class expected to read the file. May be null.
+ * See CreateImageIO().
+ * @param header The header to fill in.
+ * @return true if the header was read, false if no ImageIO could read it.
+ */
+bool ReadImageHeader(const std::string& fileName, const itk::ImageIOBase* prototype, ImageHeader& header);
+
+/**
+ * Check that an image can be stacked with another to form a series. The dimensions, spacing,
+ * direction and pixel type must be the same. The origins may differ only along the slice
+ * normal, as those of a stack of 2D slices do.
+ * @param reference The header of the first file of the series.
+ * @param header The header to check.
+ * @param difference Set to a description of the first difference found.
+ * @return true if the images are consistent.
+ */
+bool HeadersConsistent(const ImageHeader& reference, const ImageHeader& header, std::string& difference);
+
+#endif // IMAGEHEADER_H
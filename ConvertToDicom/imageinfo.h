@@ -44,19 +44,6 @@ public:
      */
     ImageInfo();
 
-    /**
-     * Copy constructor
-     * @param other The other instance.
-     */
-    ImageInfo(const ImageInfo& other);
-
-    /**
-     * Copy assignment operator.
-     * @param other The other instance
-     * @return Reference to *this.
-     */
-    ImageInfo& operator=(const ImageInfo& other);
-
     /**
      * Initialises tthe instance.
      */
@@ -68,7 +55,7 @@ public:
      * <code>itk::ImageIOBase::GetNameOfClass()</code>.
      * @return The type of source image as a string.
      */
-    std::string imageTypeName()
+    std::string imageTypeName() const
     {
         return m_imageTypeName;
     }
@@ -77,22 +64,37 @@ public:
      * Get the number of dimensions in this image, 2 or 3 most likely.
      * @return The number of dimensions in this image.
      */
-    unsigned int numDims()
+    unsigned int numDims() const
     {
         return m_numDims;
     }
 
-    int slicesPerImage()
+    int slicesPerImage() const
     {
         return m_slicesPerImage;
     }
 
+    int numberOfSlices() const
+    {
+        return m_numberOfSlices;
+    }
+
+    /**
+     * Get the number of pixels along a given dimension.
+     * @param dim The dimension of interest (0..2).
+     * @return The number of pixels.
+     */
+    int dimension(unsigned int dim) const
+    {
+        return m_dimensions[static_cast<std::vector<int>::size_type>(dim)];
+    }
+
     /**
      * Get the pixel spacing in mm for a given dimension.
      * @param dim The dimension of interest (0..2).
      * @return The pixel spacing for dimension <code>dim</code>
      */
-    double spacing(unsigned int dim)
+    double spacing(unsigned int dim) const
     {
         if (dim > m_numDims - 1)
         {
@@ -107,7 +109,7 @@ public:
      * Get the spacings for the image as a string.
      * @return The spacings for the image as a string, separated by slashes.
      */
-    std::string spacingStr()
+    std::string spacingStr() const
     {
         std::stringstream sstr;
         for (unsigned int idx = 0; idx < m_numDims; ++idx)
@@ -124,7 +126,7 @@ public:
      * @param dim The dimension of interest.
      * @return
      */
-    double origin(int dim)
+    double origin(int dim) const
     {
         return m_origin[static_cast<std::vector<double>::size_type>(dim)];
     }
@@ -134,7 +136,7 @@ public:
      * @return The origin for each dimension for the image as a string, separated by
      * slashes.
      */
-    std::string originStr()
+    std::string originStr() const
     {
         std::stringstream sstr;
         for (unsigned int idx = 0; idx < m_numDims; ++idx)
@@ -147,16 +149,21 @@ public:
         return sstr.str();
     }
 
-    int numberOfImages()
+    int numberOfImages() const
     {
         return m_numberOfImages;
     }
 
-    std::string imageOrientationPatient()
+    std::string imageOrientationPatient() const
     {
         return m_imageOrientationPatient;
     }
 
+    std::string pixelType() const
+    {
+        return m_pixelType;
+    }
+
     //Setters
     /**
      * Set the image type name. Any string which does not end with "ImageIO" will cause a
@@ -183,12 +190,12 @@ public:
 
     void setOrigin(unsigned int dim, double origin)
     {
-        m_spacing[static_cast<std::vector<double>::size_type>(dim)] = origin;
+        m_origin[static_cast<std::vector<double>::size_type>(dim)] = origin;
     }
 
     void setDimension(unsigned int dim, int dimension)
     {
-        m_spacing[static_cast<std::vector<int>::size_type>(dim)] = dimension;
+        m_dimensions[static_cast<std::vector<int>::size_type>(dim)] = dimension;
     }
 
     void setSlicesPerImage(int slicesPerImage)
@@ -0,0 +1,210 @@
+//
+//  imageprobe.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "imageprobe.h"
+#include "imagereader.h"
+#include "headerindex.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include <sstream>
+#include <stdexcept>
+
+ImageProbe::ImageProbe()
+    : logger(Logger::getInstance(std::string(LOGGER_NAME) + ".ImageProbe"))
+{
+}
+
+ErrorCode ImageProbe::imageInfo(const QString& dirPath, ImageInfo& info)
+{
+    Entry entry;
+    ErrorCode errCode = lookUp(dirPath, entry);
+    if (errCode == ErrorCode::SUCCESS)
+        info = entry.info;
+    else
+        info.init();
+
+    return errCode;
+}
+
+ErrorCode ImageProbe::fileNames(const QString& dirPath, QStringList& fileNames)
+{
+    Entry entry;
+    ErrorCode errCode = lookUp(dirPath, entry);
+    fileNames = entry.fileNames;
+
+    return errCode;
+}
+
+itk::ImageIOBase::ConstPointer ImageProbe::imageIOPrototype(const QString& dirPath)
+{
+    Entry entry;
+    lookUp(dirPath, entry);
+
+    return entry.imageIO;
+}
+
+void ImageProbe::clear()
+{
+    QMutexLocker locker(&mutex);
+    entries.clear();
+}
+
+ErrorCode ImageProbe::lookUp(const QString& dirPath, Entry& entry)
+{
+    QString absPath = QDir(dirPath).absolutePath();
+
+    {
+        QMutexLocker locker(&mutex);
+        QHash<QString, Entry>::const_iterator iter = entries.constFind(absPath);
+        if (iter != entries.constEnd() && isCurrent(absPath, iter.value()))
+        {
+            entry = iter.value();
+            return ErrorCode::SUCCESS;
+        }
+    }
+
+    // Read without holding the lock so that other directories can be looked up meanwhile.
+    // If two threads read the same directory at once the later result simply replaces the earlier.
+    ErrorCode errCode = probe(absPath, entry);
+
+    QMutexLocker locker(&mutex);
+    if (errCode == ErrorCode::SUCCESS)
+        entries.insert(absPath, entry);
+    else
+        entries.remove(absPath);
+
+    return errCode;
+}
+
+bool ImageProbe::isCurrent(const QString& dirPath, const Entry& entry)
+{
+    if (QFileInfo(dirPath).lastModified() != entry.dirModified)
+        return false;
+
+    // Rewriting a file in place does not change the directory's time.
+    QFileInfo firstFile(entry.fileNames[0]);
+    return (firstFile.lastModified() == entry.firstFileModified) && (firstFile.size() == entry.firstFileSize);
+}
+
+ErrorCode ImageProbe::probe(const QString& dirPath, Entry& entry)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    HeaderIndex* index = HeaderIndex::getInstance();
+
+    QDir inputDir(dirPath);
+    entry.dirModified = QFileInfo(dirPath).lastModified();
+    entry.fileNames.clear();
+    entry.info.init();
+    entry.imageIO = nullptr;
+
+    if (!index->fileNames(dirPath, entry.fileNames))
+    {
+        QStringList fNames = inputDir.entryList(QDir::Files | QDir::Readable, QDir::Name);
+        for (int idx = 0; idx < fNames.length(); ++idx)
+            entry.fileNames.append(inputDir.absolutePath() + "/" + fNames[idx]);
+        index->setFileNames(dirPath, entry.fileNames);
+    }
+
+    LOG4CPLUS_DEBUG(logger, "Found " << entry.fileNames.length() << " files in directory: "
+                    << dirPath.toStdString());
+
+    if (entry.fileNames.isEmpty())
+    {
+        index->save(dirPath);
+        return ErrorCode::ERROR_FILE_NOT_FOUND;
+    }
+
+    QFileInfo firstFile(entry.fileNames[0]);
+    entry.firstFileModified = firstFile.lastModified();
+    entry.firstFileSize = firstFile.size();
+
+    std::string firstFileName(entry.fileNames[0].toStdString());
+    ImageHeader header;
+    if (!index->header(entry.fileNames[0], header))
+    {
+        if (!ReadImageHeader(firstFileName, 0, header))
+        {
+            LOG4CPLUS_DEBUG(logger, "Could not get metadata from file: " << firstFileName);
+            index->save(dirPath);
+            return ErrorCode::ERROR_READING_FILE;
+        }
+        index->setHeader(entry.fileNames[0], header);
+    }
+    index->save(dirPath);
+
+    if (header.numDims < 2)
+    {
+        LOG4CPLUS_DEBUG(logger, "Not an image with rows and columns: " << firstFileName);
+        return ErrorCode::ERROR_READING_FILE;
+    }
+
+    try
+    {
+        fillInfo(header, entry.fileNames.length(), entry.info);
+    }
+    catch (std::invalid_argument&)
+    {
+        return ErrorCode::ERROR_READING_FILE;
+    }
+
+    entry.imageIO = CreateImageIOByName(header.imageIOClass).GetPointer();
+
+    LOG4CPLUS_DEBUG(logger, "Probed " << firstFileName << ": " << header.imageIOClass << ", "
+                    << header.numDims << " dimensions, " << entry.info.slicesPerImage() << " slices per image");
+
+    return ErrorCode::SUCCESS;
+}
+
+void ImageProbe::fillInfo(const ImageHeader& header, int numFiles, ImageInfo& info)
+{
+    info.setImageTypeName(header.imageIOClass);
+
+    unsigned numDims = header.numDims;
+    info.setNumDims(numDims);
+    for (unsigned int idx = 0; idx < numDims && idx < 3; ++idx)
+    {
+        info.setSpacing(idx, header.spacing[idx]);
+        info.setOrigin(idx, header.origin[idx]);
+        info.setDimension(idx, int(header.dimensions[idx]));
+    }
+    info.setPixelType(itk::ImageIOBase::GetComponentTypeAsString(header.componentType));
+
+    info.setSlicesPerImage(header.slicesPerImage());
+    info.setNumberOfSlices(numFiles * info.slicesPerImage());
+    info.setNumberOfImages(numFiles / info.slicesPerImage());
+
+    // Set the Image Orientation Patient attribute from the image direction info. A 2D
+    // image has only two components in each direction.
+    std::ostringstream value;
+    for (unsigned axis = 0; axis < 2; ++axis)
+    {
+        std::vector<double> dir = header.direction[axis];
+        dir.resize(3, 0.0);
+        if (axis > 0)
+            value << "\\";
+        value << dir[0] << "\\" << dir[1] << "\\" << dir[2];
+    }
+    info.setImageOrientationPatient(value.str());
+}
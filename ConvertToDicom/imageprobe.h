@@ -0,0 +1,147 @@
+//
+//  imageprobe.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef IMAGEPROBE_H
+#define IMAGEPROBE_H
+
+#include "errorcodes.h"
+#include "imageinfo.h"
+#include "imageheader.h"
+#include "logger.h"
+
+#include "itkheaders.pch.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+/**
+ * Reads the header of the first image in a directory and remembers what it found. The GUI
+ * asks about the same directory many times, as the user types a path and again when the
+ * attributes are edited, and each header read can be slow on a network file system.
+ *
+ * An entry is read again when the directory, or its first file, has been modified since
+ * it was made. The listing and the header are themselves taken from the HeaderIndex when
+ * it has them, so a directory seen in an earlier run is not read at all. The cache is shared by the whole program and may be used from several
+ * threads at once.
+ */
+class ImageProbe
+{
+public:
+    /**
+     * Get the global instance of this class.
+     * @return Pointer to single instance of this class.
+     */
+    static ImageProbe* getInstance()
+    {
+        static ImageProbe instance;
+        return &instance;
+    }
+
+    /**
+     * Get the information in the first image of a directory.
+     * @param dirPath The path of the directory.
+     * @param info Filled with the information.
+     * @return SUCCESS, ERROR_FILE_NOT_FOUND if there are no files or ERROR_READING_FILE
+     * if the first file cannot be read.
+     */
+    ErrorCode imageInfo(const QString& dirPath, ImageInfo& info);
+
+    /**
+     * Get the full paths of the files in a directory, in name order.
+     * @param dirPath The path of the directory.
+     * @param fileNames Filled with the paths.
+     * @return Suitable code in ErrorCode enum, as for imageInfo().
+     */
+    ErrorCode fileNames(const QString& dirPath, QStringList& fileNames);
+
+    /**
+     * Get the ImageIO which read the first image of a directory, for use as a prototype.
+     * It must not be used to read anything.
+     * @param dirPath The path of the directory.
+     * @return The ImageIO, or a null pointer if there is none.
+     */
+    itk::ImageIOBase::ConstPointer imageIOPrototype(const QString& dirPath);
+
+    /**
+     * Forget everything.
+     */
+    void clear();
+
+    /**
+     * Fill in the information about a series from the header of its first file.
+     * @param header The header.
+     * @param numFiles The number of files in the series.
+     * @param info The information to fill in.
+     * @throws std::invalid_argument if the header has more than 3 dimensions.
+     */
+    static void fillInfo(const ImageHeader& header, int numFiles, ImageInfo& info);
+
+private:
+    /** What was found in one directory. */
+    struct Entry
+    {
+        QDateTime dirModified;       ///< Modification time of the directory.
+        QDateTime firstFileModified; ///< Modification time of the first file.
+        qint64 firstFileSize;        ///< Size of the first file.
+        QStringList fileNames;       ///< Full paths of the files.
+        ImageInfo info;              ///< From the header of the first file.
+        itk::ImageIOBase::ConstPointer imageIO; ///< The ImageIO which read the header.
+    };
+
+    /**
+     * Default constructor.
+     */
+    ImageProbe();
+
+    /**
+     * Find the entry for a directory, reading the directory if the entry is missing or out of date.
+     * @param dirPath The path of the directory.
+     * @param entry Filled with the entry.
+     * @return Suitable code in ErrorCode enum.
+     */
+    ErrorCode lookUp(const QString& dirPath, Entry& entry);
+
+    /**
+     * Read the file names in a directory and the header of the first file.
+     * @param dirPath The absolute path of the directory.
+     * @param entry Filled with what was found.
+     * @return Suitable code in ErrorCode enum.
+     */
+    ErrorCode probe(const QString& dirPath, Entry& entry);
+
+    /**
+     * Determine whether an entry still describes its directory.
+     * @param dirPath The absolute path of the directory.
+     * @param entry The entry.
+     * @return true if neither the directory nor its first file has changed.
+     */
+    bool isCurrent(const QString& dirPath, const Entry& entry);
+
+    QMutex mutex;                 ///< Guards entries.
+    QHash<QString, Entry> entries; ///< Keyed by absolute directory path.
+
+    Logger logger;                ///< Logger for this class.
+};
+
+#endif // IMAGEPROBE_H
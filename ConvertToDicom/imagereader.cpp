@@ -20,11 +20,134 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "imagereader.h"
+#include "conversionprogress.h"
+#include "sliceview.h"
+#include "mappedfile.h"
 
 #include "itkheaders.pch.h"
 
+itk::ImageIOBase::Pointer CreateImageIO(const std::string& fileName, const itk::ImageIOBase* prototype)
+{
+    if (prototype != 0)
+    {
+        itk::ImageIOBase::Pointer imageIO =
+            dynamic_cast<itk::ImageIOBase*>(prototype->CreateAnother().GetPointer());
+        if (imageIO.IsNotNull() && imageIO->CanReadFile(fileName.c_str()))
+            return imageIO;
+
+        Logger logger = Logger::getInstance(std::string(LOGGER_NAME) + ".ImageReader");
+        LOG4CPLUS_DEBUG(logger, prototype->GetNameOfClass() << " cannot read " << fileName
+                        << ". Asking the factories.");
+    }
+
+    return itk::ImageIOFactory::CreateImageIO(fileName.c_str(), itk::ImageIOFactory::ReadMode);
+}
+
+itk::ImageIOBase::Pointer CreateImageIOByName(const std::string& className)
+{
+    // This is how ImageIOFactory finds the ImageIO classes, without asking each about a file.
+    std::list<itk::LightObject::Pointer> allObjects = itk::ObjectFactoryBase::CreateAllInstance("itkImageIOBase");
+    for (std::list<itk::LightObject::Pointer>::iterator iter = allObjects.begin(); iter != allObjects.end(); ++iter)
+    {
+        itk::ImageIOBase* imageIO = dynamic_cast<itk::ImageIOBase*>(iter->GetPointer());
+        if (imageIO != 0 && className == imageIO->GetNameOfClass())
+            return imageIO;
+    }
+
+    return nullptr;
+}
+
+namespace
+{
+/**
+ * Make an image whose pixels are somebody else's, with the geometry given by an ImageIO
+ * as itk::ImageFileReader would give it.
+ */
+template <typename ImageType>
+typename ImageType::Pointer MakeImageView(const itk::ImageIOBase* imageIO, typename ImageType::PixelType* pixels,
+                                          itk::SizeValueType numberOfPixels, const itk::LightObject* owner)
+{
+    const unsigned Dimension = ImageType::ImageDimension;
+
+    typename ImageType::SizeType size;
+    typename ImageType::SpacingType spacing;
+    typename ImageType::PointType origin;
+    typename ImageType::DirectionType direction;
+    for (unsigned idx = 0; idx < Dimension; ++idx)
+    {
+        size[idx] = imageIO->GetDimensions(idx);
+        spacing[idx] = imageIO->GetSpacing(idx);
+        origin[idx] = imageIO->GetOrigin(idx);
+
+        std::vector<double> axis = imageIO->GetDirection(idx);
+        for (unsigned row = 0; row < Dimension; ++row)
+            direction[row][idx] = axis[row];
+    }
+
+    typename ImageType::IndexType start;
+    start.Fill(0);
+
+    typedef SliceViewContainer<typename ImageType::PixelType> ContainerType;
+    typename ContainerType::Pointer container = ContainerType::New();
+    container->SetView(pixels, numberOfPixels, owner);
+
+    typename ImageType::Pointer image = ImageType::New();
+    image->SetRegions(typename ImageType::RegionType(start, size));
+    image->SetSpacing(spacing);
+    image->SetOrigin(origin);
+    image->SetDirection(direction);
+    image->SetPixelContainer(container);
+
+    return image;
+}
+}
+
+itk::ImageIOBase::IOComponentType NativeComponentType(itk::ImageIOBase::IOPixelType pixelType,
+                                                      itk::ImageIOBase::IOComponentType componentType,
+                                                      unsigned numComponents)
+{
+    if (pixelType == itk::ImageIOBase::SCALAR && numComponents == 1)
+    {
+        switch (componentType)
+        {
+        // These are the types GDCM writes as they are: 8 and 16 bit, signed and unsigned.
+        case itk::ImageIOBase::UCHAR:
+        case itk::ImageIOBase::CHAR:
+        case itk::ImageIOBase::USHORT:
+        case itk::ImageIOBase::SHORT:
+            return componentType;
+        // These do not fit in 16 bits so they are rescaled. See RescaleSlice().
+        case itk::ImageIOBase::UINT:
+        case itk::ImageIOBase::INT:
+        case itk::ImageIOBase::ULONG:
+        case itk::ImageIOBase::LONG:
+        case itk::ImageIOBase::FLOAT:
+        case itk::ImageIOBase::DOUBLE:
+            return itk::ImageIOBase::FLOAT;
+        default:
+            break;
+        }
+    }
+
+    return itk::ImageIOBase::MapPixelType<InternalPixelType>::CType;
+}
+
+itk::ImageIOBase::IOComponentType NativeComponentType(const itk::ImageIOBase* imageIO)
+{
+    return NativeComponentType(imageIO->GetPixelType(), imageIO->GetComponentType(),
+                               imageIO->GetNumberOfComponents());
+}
+
+itk::ImageIOBase::IOComponentType NativeComponentType(const ImageHeader& header)
+{
+    return NativeComponentType(header.pixelType, header.componentType, header.numComponents);
+}
+
 ImageReader::ImageReader()
-    :logger(log4cplus::Logger::getInstance(std::string(LOGGER_NAME) + ".ImageReader"))
+    : progress(0),
+      useSliceViews(true),
+      useMemoryMapping(true),
+      logger(log4cplus::Logger::getInstance(std::string(LOGGER_NAME) + ".ImageReader"))
 {
 }
 
@@ -32,8 +155,7 @@ ImageReader::ImageVector ImageReader::ReadImage(const std::string& fileName)
 {
     LOG4CPLUS_TRACE(logger, "Enter");
 
-    itk::ImageIOBase::Pointer imageIO =
-        itk::ImageIOFactory::CreateImageIO(fileName.c_str(), itk::ImageIOFactory::ReadMode);
+    itk::ImageIOBase::Pointer imageIO = CreateImageIO(fileName, prototype);
 
     // If there s no suitable ITK IO type then quit
     if (imageIO.IsNull())
@@ -43,7 +165,15 @@ ImageReader::ImageVector ImageReader::ReadImage(const std::string& fileName)
     };
 
     imageIO->SetFileName(fileName);
-    imageIO->ReadImageInformation();
+    try
+    {
+        imageIO->ReadImageInformation();
+    }
+    catch (itk::ExceptionObject& ex)
+    {
+        LOG4CPLUS_ERROR(logger, "Exception caught reading image information from " << fileName << ". " << ex.what());
+        return ImageVector();
+    }
 
     LOG4CPLUS_DEBUG(logger, "Image file type: " << imageIO->GetFileTypeAsString(imageIO->GetFileType()));
 
@@ -72,75 +202,191 @@ ImageReader::ImageVector ImageReader::ReadImage(const std::string& fileName)
 
     LOG4CPLUS_DEBUG(logger, str.str());
 
+    switch (NativeComponentType(imageIO))
+    {
+    case itk::ImageIOBase::UCHAR:
+        return ReadImageAs<unsigned char>(fileName, imageIO);
+    case itk::ImageIOBase::CHAR:
+        return ReadImageAs<char>(fileName, imageIO);
+    case itk::ImageIOBase::SHORT:
+        return ReadImageAs<short>(fileName, imageIO);
+    case itk::ImageIOBase::FLOAT:
+        return ReadImageAs<float>(fileName, imageIO);
+    default:
+        return ReadImageAs<InternalPixelType>(fileName, imageIO);
+    }
+}
+
+template <typename TPixel>
+ImageReader::ImageVector ImageReader::ReadImageAs(const std::string& fileName, itk::ImageIOBase* imageIO)
+{
+    typedef itk::Image<TPixel, 2u> SliceType;
+    typedef itk::Image<TPixel, 3u> VolumeType;
+
+    const unsigned numDimensions = imageIO->GetNumberOfDimensions();
+
     ImageVector images;
 
+    if (useMemoryMapping && ReadMapped<TPixel>(fileName, imageIO, images))
+        return images;
+
     if (numDimensions == 2)
     {
-        typedef itk::ImageFileReader<Image2DType> ReaderType;
-        ReaderType::Pointer reader = ReaderType::New();
+        typedef itk::ImageFileReader<SliceType> ReaderType;
+        typename ReaderType::Pointer reader = ReaderType::New();
 
+        // Give the reader our ImageIO so that it does not look for one again.
+        reader->SetImageIO(imageIO);
         reader->SetFileName(fileName);
-        Image2DType::Pointer image = reader->GetOutput();
+        typename SliceType::Pointer image = reader->GetOutput();
 
         try
         {
             reader->Update();
         }
-        catch (itk::ImageFileReaderException& ex)
+        catch (itk::ExceptionObject& ex)
         {
             LOG4CPLUS_ERROR(logger, "Exception caught reading image. " << ex.what());
+            return images;
         }
 
-        images.push_back(image);
+        images.push_back(image.GetPointer());
     }
     else
     {
-        typedef itk::ImageFileReader<Image3DType> ReaderType;
-        ReaderType::Pointer reader = ReaderType::New();
+        typedef itk::ImageFileReader<VolumeType> ReaderType;
+        typename ReaderType::Pointer reader = ReaderType::New();
 
+        reader->SetImageIO(imageIO);
         reader->SetFileName(fileName);
-        reader->Update();
-        Image3DType::Pointer image = reader->GetOutput();
+        typename VolumeType::Pointer image = reader->GetOutput();
 
-        Image3DType::RegionType inputRegion = image->GetLargestPossibleRegion();
-        Image3DType::SizeType size = inputRegion.GetSize();
+        try
+        {
+            reader->Update();
+        }
+        catch (itk::ExceptionObject& ex)
+        {
+            LOG4CPLUS_ERROR(logger, "Exception caught reading image. " << ex.what());
+            return images;
+        }
+
+        typename VolumeType::RegionType inputRegion = image->GetLargestPossibleRegion();
+        typename VolumeType::SizeType size = inputRegion.GetSize();
         unsigned numSlices = static_cast<unsigned>(size[2]);
 
+        if (useSliceViews)
+        {
+            // The slices share the volume's pixels so nothing is copied. The reader is let
+            // go so that the slices hold the only references to the volume.
+            image->DisconnectPipeline();
+            for (unsigned sliceIdx = 0; sliceIdx < numSlices; ++sliceIdx)
+                images.push_back(MakeSliceView<TPixel>(image, sliceIdx).GetPointer());
+
+            return images;
+        }
+
         for (unsigned sliceIdx = 0; sliceIdx < numSlices; ++sliceIdx)
         {
+            if (IsCancelled(progress))
+            {
+                LOG4CPLUS_INFO(logger, "Reading cancelled at slice " << sliceIdx << " of " << fileName);
+                images.clear();
+                return images;
+            }
+
             // Generate the region that we want
-            Image3DType::SizeType sliceSize = size;
+            typename VolumeType::SizeType sliceSize = size;
             sliceSize[2] = 0;
-            Image3DType::IndexType sliceStart = inputRegion.GetIndex();
+            typename VolumeType::IndexType sliceStart = inputRegion.GetIndex();
             sliceStart[2] = sliceIdx;
-            Image3DType::RegionType sliceRegion;
+            typename VolumeType::RegionType sliceRegion;
             sliceRegion.SetIndex(sliceStart);
             sliceRegion.SetSize(sliceSize);
 
             // Create and set up the filter to extract a slice
-            typedef itk::ExtractImageFilter<Image3DType, Image2DType> ExtractFiltertype;
-            ExtractFiltertype::Pointer filter = ExtractFiltertype::New();
+            typedef itk::ExtractImageFilter<VolumeType, SliceType> ExtractFiltertype;
+            typename ExtractFiltertype::Pointer filter = ExtractFiltertype::New();
             filter->SetInput(image);
             filter->SetExtractionRegion(sliceRegion);
             filter->SetDirectionCollapseToIdentity();
 
             // Get the result
-            Image2DType::Pointer slice = filter->GetOutput();
+            typename SliceType::Pointer slice = filter->GetOutput();
             try
             {
                 filter->Update();
             }
-            catch (itk::ImageFileReaderException& ex)
+            catch (itk::ExceptionObject& ex)
             {
                 LOG4CPLUS_ERROR(logger, "Exception caught reading slice " << sliceIdx << ". " << ex.what());
                 images.clear();
                 return images;
             }
 
-            images.push_back(slice);
+            images.push_back(slice.GetPointer());
         }
     }
 
     return images;
 }
 
+template <typename TPixel>
+bool ImageReader::ReadMapped(const std::string& fileName, const itk::ImageIOBase* imageIO, ImageVector& images)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    // A mapped 3D image is only useful if its slices are views of it.
+    unsigned numDimensions = imageIO->GetNumberOfDimensions();
+    if (numDimensions != 2 && !(numDimensions == 3 && useSliceViews))
+        return false;
+
+    // The pixels must be stored exactly as we hold them.
+    if (imageIO->GetPixelType() != itk::ImageIOBase::SCALAR || imageIO->GetNumberOfComponents() != 1
+            || imageIO->GetComponentType() != itk::ImageIOBase::MapPixelType<TPixel>::CType)
+        return false;
+
+    itk::SizeValueType numberOfPixels = 1;
+    for (unsigned idx = 0; idx < numDimensions; ++idx)
+        numberOfPixels *= imageIO->GetDimensions(idx);
+    qint64 numberOfBytes = qint64(numberOfPixels * sizeof(TPixel));
+
+    RawLayout layout;
+    if (!FindRawLayout(fileName, numberOfBytes, layout)
+            || layout.bigEndian != itk::ByteSwapper<TPixel>::SystemIsBigEndian())
+        return false;
+
+    MappedFile::Pointer mapping = MappedFile::New();
+    if (!mapping->Map(layout.dataFileName, layout.offset, numberOfBytes))
+    {
+        LOG4CPLUS_DEBUG(logger, "Could not map " << layout.dataFileName);
+        return false;
+    }
+
+    // The header may leave the pixels at an odd offset.
+    TPixel* pixels = reinterpret_cast<TPixel*>(mapping->GetData());
+    if (reinterpret_cast<quintptr>(pixels) % alignof(TPixel) != 0)
+    {
+        LOG4CPLUS_DEBUG(logger, "Pixels of " << fileName << " are not aligned. Reading them instead.");
+        return false;
+    }
+
+    LOG4CPLUS_DEBUG(logger, "Mapped " << numberOfBytes << " bytes of " << layout.dataFileName
+                    << " at offset " << layout.offset);
+
+    if (numDimensions == 2)
+    {
+        typename itk::Image<TPixel, 2u>::Pointer image =
+                MakeImageView<itk::Image<TPixel, 2u> >(imageIO, pixels, numberOfPixels, mapping.GetPointer());
+        images.push_back(image.GetPointer());
+        return true;
+    }
+
+    typename itk::Image<TPixel, 3u>::Pointer volume =
+            MakeImageView<itk::Image<TPixel, 3u> >(imageIO, pixels, numberOfPixels, mapping.GetPointer());
+    unsigned numSlices = unsigned(imageIO->GetDimensions(2));
+    for (unsigned sliceIdx = 0; sliceIdx < numSlices; ++sliceIdx)
+        images.push_back(MakeSliceView<TPixel>(volume, sliceIdx).GetPointer());
+
+    return true;
+}
@@ -23,18 +23,67 @@
 #define IMAGEREADER_H
 
 #include "itktypedefs.h"
+#include "imageheader.h"
 #include "logger.h"
 
+class ConversionProgress;
+
 #include <vector>
 
 /**
- * Reads an image on disk, creating a std::vector of slices.
+ * Create an ImageIO to read a file. If a prototype is given and it can read the file a new
+ * instance of the prototype's class is made, which saves asking every registered factory.
+ * Otherwise the factories are asked as usual.
+ * @param fileName The name of the file.
+ * @param prototype An ImageIO of the class expected to read the file. May be null.
+ * @return The ImageIO, or a null pointer if no ImageIO can read the file.
+ */
+itk::ImageIOBase::Pointer CreateImageIO(const std::string& fileName, const itk::ImageIOBase* prototype);
+
+/**
+ * Create an ImageIO of a given class from the registered factories.
+ * @param className The name of the class, as given by GetNameOfClass().
+ * @return The ImageIO, or a null pointer if no factory makes that class.
+ */
+itk::ImageIOBase::Pointer CreateImageIOByName(const std::string& className);
+
+/**
+ * Find the pixel type an image is held in after it is read. Scalar images of 8 or 16 bits,
+ * signed or unsigned, keep their own type so that the DICOM files have the same bit depth.
+ * Wider integer and floating point scalars are read as float, to be rescaled to 16 bits
+ * before they are written. Anything else is converted to InternalPixelType.
+ * @param pixelType Scalar, RGB etc.
+ * @param componentType The type of each pixel component in the file.
+ * @param numComponents The number of components in each pixel.
+ * @return The component type of the slices made by ImageReader.
+ */
+itk::ImageIOBase::IOComponentType NativeComponentType(itk::ImageIOBase::IOPixelType pixelType,
+                                                      itk::ImageIOBase::IOComponentType componentType,
+                                                      unsigned numComponents);
+
+/**
+ * Find the pixel type an image is held in after it is read.
+ * @param imageIO An ImageIO which has read the image's header.
+ * @return The component type of the slices made by ImageReader.
+ */
+itk::ImageIOBase::IOComponentType NativeComponentType(const itk::ImageIOBase* imageIO);
+
+/**
+ * Find the pixel type an image is held in after it is read.
+ * @param header The image's header.
+ * @return The component type of the slices made by ImageReader.
+ */
+itk::ImageIOBase::IOComponentType NativeComponentType(const ImageHeader& header);
+
+/**
+ * Reads an image on disk, creating a std::vector of slices. The slices are
+ * itk::Image<TPixel, 2u> for the pixel type given by NativeComponentType().
  */
 class ImageReader
 {
 public:
     /** Used as a return type for ReadImage */
-    typedef std::vector<Image2DType::Pointer> ImageVector;
+    typedef std::vector<AnyImage2DType::Pointer> ImageVector;
 
     /**
      * Default constructor.
@@ -42,13 +91,81 @@ public:
     explicit ImageReader();
 
     /**
-     * Read an image (2D or 3D) on disk.
+     * Read an image (2D or 3D) on disk. This may be called from several threads at once
+     * provided each thread uses its own ImageReader.
      * @param name The name of the file. May be relative or absolute path name.
-     * @return An ImageReader::ImageVector of the image slices.
+     * @return An ImageReader::ImageVector of the image slices. This is empty if the file
+     * could not be read.
      */
     ImageVector ReadImage(const std::string& name);
 
+    /**
+     * Set the progress record to check for cancellation while slices are extracted from
+     * a 3D image.
+     * @param progress Pointer to the ConversionProgress. May be null.
+     */
+    void SetProgress(const ConversionProgress* progress)
+    {
+        this->progress = progress;
+    }
+
+    /**
+     * Set the ImageIO used to find the class for reading each file. All of the files in a
+     * series are normally read by the same class, so this is found once from the first file.
+     * @param prototype The ImageIO. Only its class matters. May be null.
+     */
+    void SetImageIOPrototype(const itk::ImageIOBase* prototype)
+    {
+        this->prototype = prototype;
+    }
+
+    /**
+     * Choose how the slices of a 3D image are made. Views share the 3D image's pixels, which
+     * are kept until the last slice is released. Otherwise each slice is copied out with an
+     * itk::ExtractImageFilter. Views are used by default.
+     * @param useSliceViews true to make views, false to copy.
+     */
+    void SetUseSliceViews(bool useSliceViews)
+    {
+        this->useSliceViews = useSliceViews;
+    }
+
+    /**
+     * Choose whether uncompressed MetaImage, NRRD and NIfTI files whose pixels are stored in
+     * their native type are memory mapped rather than read. The images are then views of the
+     * mapping, so the pixels are never copied and the page cache holds them. For 3D images
+     * this is only done if slice views are used. Mapping is used by default.
+     * @param useMemoryMapping true to map the files which can be mapped.
+     */
+    void SetUseMemoryMapping(bool useMemoryMapping)
+    {
+        this->useMemoryMapping = useMemoryMapping;
+    }
+
 private:
+    /**
+     * Read an image as slices of the given pixel type.
+     * @param fileName The name of the file.
+     * @param imageIO The ImageIO which has read the file's header.
+     * @return The slices. Empty if the file could not be read.
+     */
+    template <typename TPixel>
+    ImageVector ReadImageAs(const std::string& fileName, itk::ImageIOBase* imageIO);
+
+    /**
+     * Make the slices of an image as views of the memory mapped file, if the file allows it.
+     * @param fileName The name of the file.
+     * @param imageIO The ImageIO which has read the file's header.
+     * @param images Filled with the slices.
+     * @return true if the file was mapped, false if it must be read.
+     */
+    template <typename TPixel>
+    bool ReadMapped(const std::string& fileName, const itk::ImageIOBase* imageIO, ImageVector& images);
+
+    const ConversionProgress* progress; ///< Checked for cancellation. May be null.
+    bool useSliceViews;                 ///< Make 3D slices as views rather than copies.
+    bool useMemoryMapping;              ///< Map uncompressed files rather than read them.
+    itk::ImageIOBase::ConstPointer prototype; ///< Class of ImageIO to try first. May be null.
     Logger logger;
 };
 
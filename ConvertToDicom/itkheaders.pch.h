@@ -65,18 +65,30 @@
 #include <itkImage.h>
 #include <itkIntTypes.h>
 #include <itksys/SystemTools.hxx>
-#include <itkImageSeriesWriter.h>
+#include <itkImageFileWriter.h>
 #include <itkVersion.h>
-#include <itkTileImageFilter.h>
 #include <itkGDCMImageIO.h>
 #include <itkGDCMSeriesFileNames.h>
 #include <itkImage.h>
 #include <itkImageIOBase.h>
 #include <itkImageFileReader.h>
 #include <itkExtractImageFilter.h>
+#include <itkImportImageContainer.h>
+#include <itkByteSwapper.h>
 #include <itkMetaDataDictionary.h>
 
 #include <gdcmUIDGenerator.h>
+#include <gdcmReader.h>
+#include <gdcmWriter.h>
+#include <gdcmAttribute.h>
+#include <gdcmFile.h>
+#include <gdcmGlobal.h>
+#include <gdcmDicts.h>
+#include <gdcmMediaStorage.h>
+#include <gdcmStringFilter.h>
+#include <gdcmSequenceOfItems.h>
+#include <gdcmImage.h>
+#include <gdcmImageChangeTransferSyntax.h>
 
 #include <vnl/vnl_vector_fixed.h>
 
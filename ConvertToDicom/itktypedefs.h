@@ -26,8 +26,8 @@
 
 /**
  * @brief InternalPixelType
- * When this program reads in image files they are stored with this canonical pixel type.
- * TODO change this to float.
+ * Images whose pixels are not scalars are converted to this type when they are read. Scalar
+ * images keep their own type or are rescaled to RescalePixelType. See NativeComponentType().
  */
 typedef unsigned short InternalPixelType;
 
@@ -37,6 +37,13 @@ typedef unsigned short InternalPixelType;
  */
 typedef itk::Image<InternalPixelType, 2u> Image2DType;
 
+/**
+ * @brief AnyImage2DType
+ * Base class of 2D images of every pixel type. The slices of a series are passed around as
+ * these. Their actual type is itk::Image<TPixel, 2u> for the pixel type of the input files.
+ */
+typedef itk::ImageBase<2u> AnyImage2DType;
+
 /**
  * @brief Image3DType
  * Canonical type of a 3D image.
@@ -1,27 +1,17 @@
 #include "mainwindow.h"
 #include "logger.h"
-#include "logger.h"
+#include "batchconverter.h"
+#include "settings.h"
+#include "uidgenerator.h"
 #include "itkheaders.pch.h"
 
 #include <QApplication>
+#include <QCoreApplication>
 #include <QStyleFactory>
 
-int main(int argc, char *argv[])
+// Register all of the image I/O factories.
+static void RegisterImageIOFactories()
 {
-    QApplication a(argc, argv);
-
-    QCoreApplication::setOrganizationName("Tim Allman");
-    QCoreApplication::setOrganizationDomain("brasscats.ca");
-    QCoreApplication::setApplicationName("ConvertToDicom-Qt");
-
-    SetupLogger(LOGGER_NAME, LogLevel::LOG_LEVEL_ALL, LogLevel::LOG_LEVEL_ALL);
-
-    // Possible valuse are "Windows", "Fusion", Macintosh"
-    //    a.setStyle(QStyleFactory::create("Windows"));
-    //    a.setStyle(QStyleFactory::create("Fusion"));
-    //    a.setStyle(QStyleFactory::create("Macintosh"));
-
-    // Register all of the image I/O factories.
     itk::BMPImageIOFactory::RegisterOneFactory();
     itk::BYUMeshIOFactory::RegisterOneFactory();
     itk::BioRadImageIOFactory::RegisterOneFactory();
@@ -52,6 +42,52 @@ int main(int argc, char *argv[])
     itk::TxtTransformIOFactory::RegisterOneFactory();
     itk::VTKImageIOFactory::RegisterOneFactory();
     itk::VTKPolyDataMeshIOFactory::RegisterOneFactory();
+}
+
+/**
+ * Use the organisation's UID root if one has been saved in the settings.
+ */
+static void LoadUidRoot()
+{
+    Settings settings;
+    QString root = settings.value(Settings::UidRootKey).toString();
+    if (!root.isEmpty() && !UidGenerator::setRoot(root.toStdString()))
+    {
+        Logger logger = Logger::getInstance(std::string(LOGGER_NAME) + ".main");
+        LOG4CPLUS_WARN(logger, "Ignoring invalid UID root " << root.toStdString());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication::setOrganizationName("Tim Allman");
+    QCoreApplication::setOrganizationDomain("brasscats.ca");
+    QCoreApplication::setApplicationName("ConvertToDicom-Qt");
+
+    // Without a GUI only warnings go to the console so that the job results stand out.
+    if (BatchConverter::isBatchMode(argc, argv))
+    {
+        QCoreApplication a(argc, argv);
+
+        SetupLogger(LOGGER_NAME, LogLevel::LOG_LEVEL_WARN, LogLevel::LOG_LEVEL_ALL);
+        RegisterImageIOFactories();
+        LoadUidRoot();
+
+        BatchConverter converter;
+        return converter.run(a.arguments());
+    }
+
+    QApplication a(argc, argv);
+
+    SetupLogger(LOGGER_NAME, LogLevel::LOG_LEVEL_ALL, LogLevel::LOG_LEVEL_ALL);
+
+    // Possible valuse are "Windows", "Fusion", Macintosh"
+    //    a.setStyle(QStyleFactory::create("Windows"));
+    //    a.setStyle(QStyleFactory::create("Fusion"));
+    //    a.setStyle(QStyleFactory::create("Macintosh"));
+
+    RegisterImageIOFactories();
+    LoadUidRoot();
 
     MainWindow w;
     w.show();
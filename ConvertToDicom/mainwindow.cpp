@@ -2,6 +2,7 @@
 #include "ui_mainwindow.h"
 #include "seriesinfo.h"
 #include "seriesconverter.h"
+#include "conversionjob.h"
 #include "dicomattributesdialog.h"
 #include "logger.h"
 
@@ -12,17 +13,23 @@
 #include <QObject>
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QProgressDialog>
+#include <QtConcurrent>
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
-    seriesInfo(SeriesInfo::getInstance()),
+    seriesInfo(new SeriesInfo()),
     dicomAttributesDialog(0),
-    seriesConverter(new SeriesConverter()),
+    seriesConverter(new SeriesConverter(seriesInfo)),
+    conversionJob(0),
+    progressDialog(0),
     logger(Logger::getInstance(std::string(LOGGER_NAME) + ".MainWindow"))
 {
     ui->setupUi(this);
 
+    seriesInfo->loadSettings();
+
     // Gave the main window's previous size and position
     Settings settings;
     settings.beginGroup("MainWindow");
@@ -49,6 +56,12 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->destDirLineEdit, SIGNAL(editingFinished()), this,
             SLOT(handleDestDirLineEditEditingFinished()));
 
+    // The conversion runs in another thread. We poll its progress rather than being told
+    // about every slice so that the event loop is not flooded.
+    progressTimer.setInterval(100);
+    connect(&progressTimer, SIGNAL(timeout()), this, SLOT(handleProgressTimerTimeout()));
+    connect(&conversionWatcher, SIGNAL(finished()), this, SLOT(handleConversionFinished()));
+
     // Some values to start with
     loadWidgetInfo();
     LOG4CPLUS_INFO(logger, "MainWindow opened.");
@@ -56,6 +69,13 @@ MainWindow::MainWindow(QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
+    // Don't leave a conversion running.
+    if (conversionWatcher.isRunning())
+    {
+        conversionProgress.cancel();
+        conversionWatcher.waitForFinished();
+    }
+
     // Save the main window's size and position
     Settings settings;
     settings.beginGroup("MainWindow");
@@ -68,6 +88,9 @@ MainWindow::~MainWindow()
 
     delete ui;
     delete dicomAttributesDialog;
+    delete seriesConverter;
+    delete conversionJob;
+    delete seriesInfo;
     LOG4CPLUS_DEBUG(logger, "MainWindow closed.");
 }
 
@@ -145,7 +168,7 @@ void MainWindow::handleEditDicomAttributesButtonClicked()
 {
     if (dicomAttributesDialog == 0)
     {
-        dicomAttributesDialog = new DicomAttributesDialog(this);
+        dicomAttributesDialog = new DicomAttributesDialog(seriesInfo, this);
     }
 
 #if defined(Q_OS_MACOS) || defined(Q_OS_IOS)
@@ -241,8 +264,68 @@ void MainWindow::handleConvertButtonClicked()
         return;
     }
 
-    errCode = seriesConverter->convertFiles();
+    // Run the conversion in the background. It works from its own copy of the settings, and
+    // the progress dialog is window modal so the converter is left alone while it runs.
+    conversionProgress.reset();
+    delete conversionJob;
+    conversionJob = new ConversionJob(*seriesInfo, &conversionProgress);
+
+    progressDialog = new QProgressDialog(tr("Converting files..."), tr("Cancel"), 0, 100, this);
+    progressDialog->setWindowModality(Qt::WindowModal);
+    progressDialog->setAutoClose(false);
+    progressDialog->setAutoReset(false);
+    progressDialog->setMinimumDuration(0);
+    progressDialog->setValue(0);
+    connect(progressDialog, SIGNAL(canceled()), this, SLOT(handleProgressDialogCanceled()));
+
+    ui->convertPushButton->setEnabled(false);
+    progressTimer.start();
+    SeriesConverter* converter = seriesConverter;
+    ConversionJob* job = conversionJob;
+    conversionWatcher.setFuture(QtConcurrent::run([converter, job]()
+    {
+        return converter->convertFiles(*job);
+    }));
+}
 
+void MainWindow::handleConversionFinished()
+{
+    progressTimer.stop();
+    progressDialog->deleteLater();
+    progressDialog = 0;
+    ui->convertPushButton->setEnabled(true);
+
+    reportConversionResult(conversionWatcher.result());
+}
+
+void MainWindow::handleProgressTimerTimeout()
+{
+    if (progressDialog == 0 || conversionProgress.isCancelled())
+        return;
+
+    QString text = tr("Read %1 of %2 files.\nWrote %3 of %4 slices.")
+                   .arg(conversionProgress.filesRead())
+                   .arg(conversionProgress.numberOfFiles())
+                   .arg(conversionProgress.slicesWritten())
+                   .arg(conversionProgress.numberOfSlices());
+    progressDialog->setLabelText(text);
+    progressDialog->setValue(conversionProgress.percentDone());
+}
+
+void MainWindow::handleProgressDialogCanceled()
+{
+    LOG4CPLUS_INFO(logger, "Conversion cancelled by user.");
+
+    conversionProgress.cancel();
+    if (progressDialog != 0)
+    {
+        progressDialog->setLabelText(tr("Cancelling..."));
+        progressDialog->setCancelButton(0);
+    }
+}
+
+void MainWindow::reportConversionResult(ErrorCode errCode)
+{
     if (errCode == ErrorCode::SUCCESS)
     {
         QString msg = "Converted files successfully.";
@@ -252,6 +335,18 @@ void MainWindow::handleConvertButtonClicked()
 
         return;
     }
+    else if (errCode == ErrorCode::ERROR_CANCELLED)
+    {
+        QString msg = QString("Conversion cancelled. %1 of %2 slices were written to: %3")
+                      .arg(conversionProgress.slicesWritten())
+                      .arg(conversionProgress.numberOfSlices())
+                      .arg(seriesInfo->outputPath());
+        QMessageBox::information(this, "Conversion Cancelled", msg);
+
+        LOG4CPLUS_INFO(logger, msg.toStdString());
+
+        return;
+    }
     else if (errCode == ErrorCode::ERROR_FILE_NOT_FOUND)
     {
         QString msg = "Could not read files in directory: " + seriesInfo->inputDirStr();
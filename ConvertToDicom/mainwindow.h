@@ -2,12 +2,18 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
+#include <QFutureWatcher>
+#include <QTimer>
 
 #include "logger.h"
 #include "seriesinfo.h"
+#include "errorcodes.h"
+#include "conversionprogress.h"
 
 class DicomAttributesDialog;
 class SeriesConverter;
+class ConversionJob;
+class QProgressDialog;
 
 namespace Ui {
 class MainWindow;
@@ -110,15 +116,43 @@ public slots:
      */
     void handleDestDirLineEditTextEdited();
 
+    /**
+     * The conversion running in the background has finished, successfully or not.
+     */
+    void handleConversionFinished();
+
+    /**
+     * Called periodically during a conversion to show its progress.
+     */
+    void handleProgressTimerTimeout();
+
+    /**
+     * The user has asked to stop the conversion.
+     */
+    void handleProgressDialogCanceled();
+
 private:
+    /**
+     * Tell the user how the conversion went.
+     * @param errCode The value returned by SeriesConverter::convertFiles().
+     */
+    void reportConversionResult(ErrorCode errCode);
+
     Ui::MainWindow *ui;
 
-    SeriesInfo* seriesInfo;
+    SeriesInfo* seriesInfo;                      ///< The settings the user is editing.
 
     DicomAttributesDialog* dicomAttributesDialog;
 
     SeriesConverter* seriesConverter;
 
+    ConversionJob* conversionJob;                ///< The conversion running, 0 if none.
+
+    ConversionProgress conversionProgress;       ///< Shared with the conversion thread.
+    QFutureWatcher<ErrorCode> conversionWatcher; ///< Watches the conversion thread.
+    QProgressDialog* progressDialog;             ///< Shown while converting.
+    QTimer progressTimer;                        ///< Paces updates of progressDialog.
+
     Logger logger;
 
 };
@@ -0,0 +1,292 @@
+//
+//  mappedfile.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "mappedfile.h"
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QFileInfo>
+
+namespace
+{
+// Headers longer than this are not looked at.
+const qint64 MaxHeaderSize = 65536;
+
+QString ResolveDataFile(const QString& headerFileName, const QByteArray& dataFileName)
+{
+    QString name = QString::fromLocal8Bit(dataFileName);
+    if (QFileInfo(name).isAbsolute())
+        return name;
+    return QFileInfo(headerFileName).absolutePath() + "/" + name;
+}
+
+bool FindMetaImageLayout(const QString& fileName, qint64 numberOfBytes, RawLayout& layout)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    bool compressed = false;
+    bool bigEndian = false;
+    qint64 headerSize = 0;
+
+    // ElementDataFile is always the last field of the header.
+    while (!file.atEnd() && file.pos() < MaxHeaderSize)
+    {
+        QByteArray line = file.readLine();
+        int equals = line.indexOf('=');
+        if (equals < 0)
+            continue;
+
+        QByteArray key = line.left(equals).trimmed();
+        QByteArray value = line.mid(equals + 1).trimmed();
+        if (key == "CompressedData")
+        {
+            compressed = (value.toLower() == "true");
+        }
+        else if (key == "BinaryDataByteOrderMSB" || key == "ElementByteOrderMSB")
+        {
+            bigEndian = (value.toLower() == "true");
+        }
+        else if (key == "HeaderSize")
+        {
+            headerSize = value.toLongLong();
+        }
+        else if (key == "ElementDataFile")
+        {
+            if (compressed)
+                return false;
+
+            qint64 offset = 0;
+            if (value == "LOCAL")
+            {
+                if (headerSize != 0)
+                    return false;
+                layout.dataFileName = fileName.toStdString();
+                offset = file.pos();
+            }
+            else if (value.startsWith("LIST") || value.contains('%') || value.contains(' '))
+            {
+                // The pixels are split between several files.
+                return false;
+            }
+            else
+            {
+                layout.dataFileName = ResolveDataFile(fileName, value).toStdString();
+            }
+
+            // A header size of -1 means the pixels are at the end of the file.
+            if (headerSize == -1)
+                offset = QFileInfo(QString::fromStdString(layout.dataFileName)).size() - numberOfBytes;
+            else
+                offset += headerSize;
+
+            layout.offset = offset;
+            layout.bigEndian = bigEndian;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool FindNrrdLayout(const QString& fileName, qint64 numberOfBytes, RawLayout& layout)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    if (!file.readLine().startsWith("NRRD000"))
+        return false;
+
+    bool raw = false;
+    bool endianKnown = false;
+    bool bigEndian = false;
+    QByteArray dataFile;
+    qint64 byteSkip = 0;
+    qint64 offset = -1;
+
+    // The header ends at a blank line, or at the end of a detached header.
+    while (!file.atEnd() && file.pos() < MaxHeaderSize)
+    {
+        QByteArray line = file.readLine();
+        if (line.trimmed().isEmpty())
+        {
+            offset = file.pos();
+            break;
+        }
+
+        // Comments and key/value pairs.
+        if (line.startsWith('#') || line.contains(":="))
+            continue;
+
+        int colon = line.indexOf(':');
+        if (colon < 0)
+            continue;
+
+        QByteArray key = line.left(colon).trimmed().toLower();
+        QByteArray value = line.mid(colon + 1).trimmed();
+        if (key == "encoding")
+        {
+            raw = (value.toLower() == "raw");
+        }
+        else if (key == "endian")
+        {
+            endianKnown = true;
+            bigEndian = (value.toLower() == "big");
+        }
+        else if (key == "data file" || key == "datafile")
+        {
+            if (value.startsWith("LIST") || value.contains(' '))
+                return false;
+            dataFile = value;
+        }
+        else if (key == "byte skip" || key == "byteskip")
+        {
+            byteSkip = value.toLongLong();
+        }
+        else if ((key == "line skip" || key == "lineskip") && value.toLongLong() != 0)
+        {
+            return false;
+        }
+    }
+
+    if (!raw || !endianKnown)
+        return false;
+
+    if (dataFile.isEmpty())
+    {
+        if (offset < 0)
+            return false;
+        layout.dataFileName = fileName.toStdString();
+    }
+    else
+    {
+        layout.dataFileName = ResolveDataFile(fileName, dataFile).toStdString();
+        offset = 0;
+    }
+
+    // A byte skip of -1 means the pixels are at the end of the file.
+    if (byteSkip == -1)
+        offset = QFileInfo(QString::fromStdString(layout.dataFileName)).size() - numberOfBytes;
+    else
+        offset += byteSkip;
+
+    layout.offset = offset;
+    layout.bigEndian = bigEndian;
+    return true;
+}
+
+bool FindNiftiLayout(const QString& fileName, RawLayout& layout)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    // A single file NIfTI-1 header is 348 bytes followed by the magic "n+1".
+    QByteArray header = file.read(352);
+    if (header.size() < 352 || !header.mid(344, 4).startsWith("n+1"))
+        return false;
+
+    QDataStream stream(header);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    qint32 sizeOfHeader;
+    stream >> sizeOfHeader;
+    if (sizeOfHeader != 348)
+    {
+        stream.device()->seek(0);
+        stream.setByteOrder(QDataStream::BigEndian);
+        stream >> sizeOfHeader;
+        if (sizeOfHeader != 348)
+            return false;
+    }
+
+    float voxOffset;
+    float sclSlope;
+    float sclInter;
+    stream.device()->seek(108);
+    stream >> voxOffset >> sclSlope >> sclInter;
+
+    // Scaled pixels are not stored as they are read.
+    if ((sclSlope != 0.0f && sclSlope != 1.0f) || sclInter != 0.0f)
+        return false;
+
+    layout.dataFileName = fileName.toStdString();
+    layout.offset = qint64(voxOffset);
+    layout.bigEndian = (stream.byteOrder() == QDataStream::BigEndian);
+    return true;
+}
+}
+
+MappedFile::MappedFile()
+    : data(0)
+{
+
+}
+
+MappedFile::~MappedFile()
+{
+    if (data != 0)
+        file.unmap(data);
+}
+
+bool MappedFile::Map(const std::string& fileName, qint64 offset, qint64 size)
+{
+    if (data != 0)
+    {
+        file.unmap(data);
+        data = 0;
+    }
+    file.close();
+
+    file.setFileName(QString::fromStdString(fileName));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    // A private mapping can be written to without changing the file. The file is kept open
+    // so that the mapping can be unmapped through it.
+    data = file.map(offset, size, QFileDevice::MapPrivateOption);
+
+    return (data != 0);
+}
+
+bool FindRawLayout(const std::string& fileName, qint64 numberOfBytes, RawLayout& layout)
+{
+    QString name = QString::fromStdString(fileName);
+    QString suffix = QFileInfo(name).suffix().toLower();
+
+    bool found = false;
+    if (suffix == "mha" || suffix == "mhd")
+        found = FindMetaImageLayout(name, numberOfBytes, layout);
+    else if (suffix == "nrrd" || suffix == "nhdr")
+        found = FindNrrdLayout(name, numberOfBytes, layout);
+    else if (suffix == "nii")
+        found = FindNiftiLayout(name, layout);
+
+    if (!found)
+        return false;
+
+    // The pixels must all be in the file.
+    qint64 dataFileSize = QFileInfo(QString::fromStdString(layout.dataFileName)).size();
+    return (layout.offset >= 0) && (layout.offset + numberOfBytes <= dataFileSize);
+}
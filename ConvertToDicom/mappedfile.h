@@ -0,0 +1,98 @@
+//
+//  mappedfile.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include "itkheaders.pch.h"
+
+#include <QFile>
+
+#include <string>
+
+/**
+ * A part of a file mapped into memory. It is an itk::LightObject so that the images whose
+ * pixels are in the mapping can keep it alive through a SliceViewContainer. The mapping is
+ * private: the pixels may be written to but the changes never reach the file.
+ */
+class MappedFile : public itk::LightObject
+{
+public:
+    typedef MappedFile Self;
+    typedef itk::LightObject Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(MappedFile, LightObject);
+
+    /**
+     * Map part of a file.
+     * @param fileName The name of the file.
+     * @param offset The position of the first byte to map.
+     * @param size The number of bytes to map.
+     * @return true if the file was mapped.
+     */
+    bool Map(const std::string& fileName, qint64 offset, qint64 size);
+
+    /**
+     * Get the mapped bytes.
+     * @return Pointer to the first byte. Null if nothing is mapped.
+     */
+    uchar* GetData() const
+    {
+        return data;
+    }
+
+protected:
+    MappedFile();
+    ~MappedFile();
+
+private:
+    ITK_DISALLOW_COPY_AND_ASSIGN(MappedFile);
+
+    QFile file;     ///< The file mapped.
+    uchar* data;    ///< The mapping. Null if nothing is mapped.
+};
+
+/**
+ * Where the pixels of an uncompressed image file are.
+ */
+struct RawLayout
+{
+    std::string dataFileName; ///< The file holding the pixels. May be the header file itself.
+    qint64 offset;            ///< Position of the first pixel in the file.
+    bool bigEndian;           ///< The byte order of the pixels.
+};
+
+/**
+ * Find where the pixels of an image are stored when they are stored uncompressed and
+ * contiguously in one file. MetaImage (.mha, .mhd), NRRD (.nrrd, .nhdr) and NIfTI (.nii)
+ * files are understood.
+ * @param fileName The name of the image file.
+ * @param numberOfBytes The size of the pixel data, from the image's header.
+ * @param layout Filled with the layout.
+ * @return true if the pixels may be read straight from the file. false if the format is
+ * not one of those above, or the pixels are compressed or split up.
+ */
+bool FindRawLayout(const std::string& fileName, qint64 numberOfBytes, RawLayout& layout);
+
+#endif // MAPPEDFILE_H
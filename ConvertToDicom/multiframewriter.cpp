@@ -0,0 +1,435 @@
+//
+//  multiframewriter.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "multiframewriter.h"
+#include "conversionjob.h"
+#include "dicomslicetemplate.h"
+#include "conversionprogress.h"
+
+#include <QElapsedTimer>
+#include <QString>
+
+#include <algorithm>
+#include <sstream>
+
+namespace
+{
+/** The raw frames are copied into the file in blocks of this many bytes. */
+const qint64 CopyBlockSize = 4 * 1024 * 1024;
+
+void AddEntry(gdcm::DataSet& dataSet, const char* key, const std::string& value)
+{
+    gdcm::DataElement element;
+    if (DicomSliceTemplate::makeElement(key, value.c_str(), value.size(), element))
+        dataSet.Replace(element);
+}
+
+gdcm::Item MakeItem(const gdcm::DataSet& nested)
+{
+    gdcm::Item item;
+    item.SetVLToUndefined();
+    item.SetNestedDataSet(nested);
+    return item;
+}
+
+gdcm::DataElement SequenceElement(const gdcm::Tag& tag, const gdcm::SmartPointer<gdcm::SequenceOfItems>& sequence)
+{
+    gdcm::DataElement element(tag);
+    element.SetVR(gdcm::VR::SQ);
+    element.SetValue(*sequence);
+    element.SetVLToUndefined();
+    return element;
+}
+
+gdcm::DataElement MakeSequence(const gdcm::Tag& tag, const gdcm::DataSet& nested)
+{
+    gdcm::SmartPointer<gdcm::SequenceOfItems> sequence = new gdcm::SequenceOfItems;
+    sequence->SetLengthToUndefined();
+    sequence->AddItem(MakeItem(nested));
+    return SequenceElement(tag, sequence);
+}
+}
+
+MultiFrameWriter::MultiFrameWriter(const ConversionJob& job, const std::string& fileName)
+    : job(&job), compression(job.seriesInfo().compression()), fileName(fileName), numberOfFramesWritten(0),
+      columns(0), rows(0), bitsAllocated(0), isSigned(false),
+      logger(Logger::getInstance(std::string(LOGGER_NAME) + ".MultiFrameWriter"))
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    spacing[0] = 0.0;
+    spacing[1] = 0.0;
+}
+
+MultiFrameWriter::~MultiFrameWriter()
+{
+    if (!frameFile.fileName().isEmpty())
+        frameFile.remove();
+}
+
+ErrorCode MultiFrameWriter::begin()
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    columns = 0;
+    numberOfFramesWritten = 0;
+    encodedFrames.clear();
+
+    frameFile.setFileName(QString::fromStdString(fileName) + ".frames");
+    if (!frameFile.open(QIODevice::ReadWrite | QIODevice::Truncate | QIODevice::Unbuffered))
+    {
+        LOG4CPLUS_ERROR(logger, "Could not create " << frameFile.fileName().toStdString());
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    return ErrorCode::SUCCESS;
+}
+
+ErrorCode MultiFrameWriter::writeFrame(int frameIdx, const AnyImage2DType* slice)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    SlicePixels pixels;
+    if (!GetSlicePixels(slice, pixels))
+    {
+        LOG4CPLUS_ERROR(logger, "Frame " << frameIdx << " has a pixel type which cannot be written.");
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    return writeFramePixels(frameIdx, pixels);
+}
+
+ErrorCode MultiFrameWriter::writeFramePixels(int frameIdx, const SlicePixels& slicePixels)
+{
+    const char* pixels = slicePixels.data;
+    qint64 length = slicePixels.length;
+
+    // Frames are compressed before the lock is taken so that the writers compress them concurrently.
+    std::string encoded;
+    if (compression != Compression::NONE)
+    {
+        if (!encodeFrame(pixels, length, slicePixels.columns, slicePixels.rows, slicePixels.bitsAllocated,
+                         slicePixels.isSigned, encoded))
+        {
+            LOG4CPLUS_ERROR(logger, "Could not compress frame " << frameIdx << " with " << CompressionName(compression));
+            return ErrorCode::ERROR_WRITING_FILE;
+        }
+        pixels = encoded.data();
+        length = qint64(encoded.size());
+    }
+
+    QMutexLocker locker(&frameMutex);
+
+    // The first frame to arrive decides what they all must be.
+    if (columns == 0)
+    {
+        columns = slicePixels.columns;
+        rows = slicePixels.rows;
+        spacing[0] = slicePixels.spacing[0];
+        spacing[1] = slicePixels.spacing[1];
+        bitsAllocated = slicePixels.bitsAllocated;
+        isSigned = slicePixels.isSigned;
+    }
+    else if ((columns != slicePixels.columns) || (rows != slicePixels.rows)
+             || (bitsAllocated != slicePixels.bitsAllocated) || (isSigned != slicePixels.isSigned))
+    {
+        LOG4CPLUS_ERROR(logger, "Frame " << frameIdx << " differs in size or pixel type from the frames before it.");
+        return ErrorCode::ERROR_IMAGE_INCONSISTENT;
+    }
+
+    // Native frames are all the same length so each has its own place in the raw file. Compressed
+    // ones go on the end, wherever that is, and where they went is kept.
+    qint64 offset = (compression == Compression::NONE) ? qint64(frameIdx) * length : frameFile.size();
+    if (!frameFile.seek(offset) || (frameFile.write(pixels, length) != length))
+    {
+        LOG4CPLUS_ERROR(logger, "Could not write frame " << frameIdx << " to " << frameFile.fileName().toStdString());
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    if (compression != Compression::NONE)
+    {
+        if (std::size_t(frameIdx) >= encodedFrames.size())
+            encodedFrames.resize(std::size_t(frameIdx) + 1, std::make_pair(qint64(0), qint64(0)));
+        encodedFrames[std::size_t(frameIdx)] = std::make_pair(offset, length);
+    }
+
+    ++numberOfFramesWritten;
+    return ErrorCode::SUCCESS;
+}
+
+ErrorCode MultiFrameWriter::finish(const SliceDictionary::SeriesLayer& seriesLayer,
+                                   const std::vector<SliceDictionary>& frames)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    int numberOfFrames = int(frames.size());
+    if ((numberOfFrames == 0) || (numberOfFramesWritten != numberOfFrames))
+    {
+        LOG4CPLUS_ERROR(logger, numberOfFramesWritten << " of " << numberOfFrames << " frames were written for "
+                        << fileName);
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    // Native pixel data has a 32 bit length.
+    quint64 pixelLength = quint64(numberOfFrames) * columns * rows * (bitsAllocated / 8);
+    if ((compression == Compression::NONE) && (pixelLength >= 0xfffffffeULL))
+    {
+        LOG4CPLUS_ERROR(logger, "The series is too large for one file: " << pixelLength << " bytes of pixels.");
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    gdcm::SmartPointer<gdcm::File> file = new gdcm::File;
+    gdcm::DataSet& dataSet = file->GetDataSet();
+
+    // The orientation and position are in the functional groups instead of the top level.
+    std::string orientation;
+    if (!seriesLayer.isNull())
+    {
+        typedef itk::MetaDataObject<std::string> MetaDataStringType;
+        itk::MetaDataDictionary::ConstIterator end = seriesLayer->End();
+        for (itk::MetaDataDictionary::ConstIterator iter = seriesLayer->Begin(); iter != end; ++iter)
+        {
+            const MetaDataStringType* entry = dynamic_cast<const MetaDataStringType*>(iter->second.GetPointer());
+            if (entry == 0)
+                continue;
+
+            const std::string& key = iter->first;
+            if (key == "0020|0037")
+                orientation = entry->GetMetaDataObjectValue();
+            else if ((key != "0020|0032") && (key != "0020|1041"))
+                AddEntry(dataSet, key.c_str(), entry->GetMetaDataObjectValue());
+        }
+    }
+
+    // The frames may be from any modality so the object is a secondary capture.
+    gdcm::MediaStorage::MSType sopClass = (bitsAllocated == 8)
+            ? gdcm::MediaStorage::MultiframeGrayscaleByteSecondaryCaptureImageStorage
+            : gdcm::MediaStorage::MultiframeGrayscaleWordSecondaryCaptureImageStorage;
+    AddEntry(dataSet, "0008|0016", gdcm::MediaStorage::GetMSString(sopClass));
+    AddEntry(dataSet, "0008|0018", job->uidGenerator().generate());
+    AddEntry(dataSet, "0020|0013", "1");
+
+    std::ostringstream frameCount;
+    frameCount << numberOfFrames;
+    AddEntry(dataSet, "0028|0008", frameCount.str());
+
+    // The Frame Increment Pointer points at the per-frame functional groups.
+    const char framePointer[4] = { 0x00, 0x52, 0x30, char(0x92) };
+    gdcm::DataElement framePointerElement(gdcm::Tag(0x0028, 0x0009));
+    framePointerElement.SetVR(gdcm::VR::AT);
+    framePointerElement.SetByteValue(framePointer, gdcm::VL(4));
+    dataSet.Replace(framePointerElement);
+
+    AddEntry(dataSet, "0028|0002", "1");
+    AddEntry(dataSet, "0028|0004", "MONOCHROME2");
+    DicomSliceTemplate::addPixelModule(dataSet, columns, rows, spacing, bitsAllocated, isSigned);
+
+    // Every frame has the same orientation and pixel measures.
+    gdcm::DataSet planeOrientation;
+    AddEntry(planeOrientation, "0020|0037", orientation);
+
+    gdcm::DataSet pixelMeasures;
+    AddEntry(pixelMeasures, "0028|0030", (QString::number(spacing[1]) + "\\" + QString::number(spacing[0])).toStdString());
+    AddEntry(pixelMeasures, "0018|0050", QString::number(job->seriesInfo().imageSliceSpacing()).toStdString());
+
+    gdcm::DataSet sharedGroups;
+    sharedGroups.Replace(MakeSequence(gdcm::Tag(0x0020, 0x9116), planeOrientation));
+    sharedGroups.Replace(MakeSequence(gdcm::Tag(0x0028, 0x9110), pixelMeasures));
+    dataSet.Replace(MakeSequence(gdcm::Tag(0x5200, 0x9229), sharedGroups));
+
+    gdcm::SmartPointer<gdcm::SequenceOfItems> perFrameGroups = new gdcm::SequenceOfItems;
+    perFrameGroups->SetLengthToUndefined();
+    for (int frameIdx = 0; frameIdx < numberOfFrames; ++frameIdx)
+        perFrameGroups->AddItem(makeFrameItem(frames[std::size_t(frameIdx)], frameIdx));
+    dataSet.Replace(SequenceElement(gdcm::Tag(0x5200, 0x9230), perFrameGroups));
+
+    // Everything but the pixel data is written by gdcm.
+    file->GetHeader().SetDataSetTransferSyntax(CompressionTransferSyntax(compression));
+    gdcm::Writer writer;
+    writer.SetFile(*file);
+    writer.SetFileName(fileName.c_str());
+    if (!writer.Write())
+    {
+        LOG4CPLUS_ERROR(logger, "Could not write " << fileName);
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    return appendPixelData(numberOfFrames);
+}
+
+gdcm::Item MultiFrameWriter::makeFrameItem(const SliceDictionary& frame, int frameIdx)
+{
+    std::string value;
+    std::string date;
+
+    gdcm::DataSet frameContent;
+    if (frame.find("0008|0032", value) && frame.find("0008|0020", date))
+        AddEntry(frameContent, "0018|9074", date + value);
+    if (frame.find("0020|0100", value))
+        AddEntry(frameContent, "0020|9128", value);
+
+    // Each image of the series is a stack.
+    std::ostringstream stackPosition;
+    stackPosition << (frameIdx % std::max(1, job->slicesPerImage())) + 1;
+    AddEntry(frameContent, "0020|9056", "1");
+    AddEntry(frameContent, "0020|9057", stackPosition.str());
+
+    gdcm::DataSet groups;
+    groups.Replace(MakeSequence(gdcm::Tag(0x0020, 0x9111), frameContent));
+
+    if (frame.find("0020|0032", value))
+    {
+        gdcm::DataSet planePosition;
+        AddEntry(planePosition, "0020|0032", value);
+        groups.Replace(MakeSequence(gdcm::Tag(0x0020, 0x9113), planePosition));
+    }
+
+    // Rescaled floating point images have their own rescale in a hot folder.
+    if (frame.find("0028|1053", value))
+    {
+        gdcm::DataSet transformation;
+        AddEntry(transformation, "0028|1053", value);
+        if (frame.find("0028|1052", value))
+            AddEntry(transformation, "0028|1052", value);
+        AddEntry(transformation, "0028|1054", "US");
+        groups.Replace(MakeSequence(gdcm::Tag(0x0028, 0x9145), transformation));
+    }
+
+    return MakeItem(groups);
+}
+
+bool MultiFrameWriter::encodeFrame(const char* pixels, qint64 length, unsigned frameColumns, unsigned frameRows,
+                                   unsigned short frameBits, bool frameIsSigned, std::string& encoded)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    gdcm::DataElement pixelData(gdcm::Tag(0x7fe0, 0x0010));
+    pixelData.SetVR((frameBits == 8) ? gdcm::VR::OB : gdcm::VR::OW);
+    pixelData.SetByteValue(pixels, gdcm::VL(static_cast<uint32_t>(length)));
+
+    gdcm::DataElement compressed;
+    if (!CompressPixels(compression, pixelData, frameColumns, frameRows, frameBits, frameIsSigned, compressed))
+        return false;
+
+    // Each frame is one fragment of the multi-frame file.
+    const gdcm::SequenceOfFragments* fragments = compressed.GetSequenceOfFragments();
+    encoded.clear();
+    for (gdcm::SequenceOfFragments::SizeType idx = 0; idx < fragments->GetNumberOfFragments(); ++idx)
+    {
+        const gdcm::ByteValue* fragment = fragments->GetFragment(idx).GetByteValue();
+        if (fragment != 0)
+            encoded.append(fragment->GetPointer(), fragment->GetLength());
+    }
+    if (encoded.size() % 2 != 0)
+        encoded += '\0';
+
+    if (job->progress() != 0)
+        job->progress()->pixelsCompressed(length, qint64(encoded.size()), timer.nsecsElapsed());
+
+    return true;
+}
+
+ErrorCode MultiFrameWriter::appendPixelData(int numberOfFrames)
+{
+    QFile outFile(QString::fromStdString(fileName));
+    if (!outFile.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        LOG4CPLUS_ERROR(logger, "Could not open " << fileName << " to add the pixel data.");
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    bool ok;
+    if (compression != Compression::NONE)
+    {
+        ok = appendEncapsulatedPixelData(outFile, numberOfFrames);
+    }
+    else
+    {
+        // Explicit VR little endian: the tag, the VR, two reserved bytes and a 32 bit even length.
+        qint64 pixelLength = qint64(numberOfFrames) * columns * rows * (bitsAllocated / 8);
+        quint32 valueLength = quint32(pixelLength + (pixelLength % 2));
+        const char header[12] = { char(0xe0), 0x7f, 0x10, 0x00, 'O', (bitsAllocated == 8) ? 'B' : 'W', 0x00, 0x00,
+                                  char(valueLength & 0xff), char((valueLength >> 8) & 0xff),
+                                  char((valueLength >> 16) & 0xff), char((valueLength >> 24) & 0xff) };
+        ok = (outFile.write(header, sizeof(header)) == qint64(sizeof(header)))
+                && copyFrames(outFile, 0, pixelLength);
+        if (ok && (pixelLength % 2 != 0))
+            ok = outFile.putChar(0);
+    }
+
+    outFile.close();
+    if (!ok || (outFile.error() != QFileDevice::NoError))
+    {
+        LOG4CPLUS_ERROR(logger, "Could not write the pixel data to " << fileName);
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    frameFile.remove();
+    return ErrorCode::SUCCESS;
+}
+
+bool MultiFrameWriter::appendEncapsulatedPixelData(QFile& outFile, int numberOfFrames)
+{
+    // The pixel data has an undefined length and starts with an empty basic offset table.
+    const char header[20] = { char(0xe0), 0x7f, 0x10, 0x00, 'O', 'B', 0x00, 0x00,
+                              char(0xff), char(0xff), char(0xff), char(0xff),
+                              char(0xfe), char(0xff), 0x00, char(0xe0), 0x00, 0x00, 0x00, 0x00 };
+    if (outFile.write(header, sizeof(header)) != qint64(sizeof(header)))
+        return false;
+
+    if (int(encodedFrames.size()) != numberOfFrames)
+        return false;
+
+    for (int frameIdx = 0; frameIdx < numberOfFrames; ++frameIdx)
+    {
+        // The frames were padded to an even length when they were compressed.
+        qint64 offset = encodedFrames[std::size_t(frameIdx)].first;
+        quint32 length = quint32(encodedFrames[std::size_t(frameIdx)].second);
+        const char item[8] = { char(0xfe), char(0xff), 0x00, char(0xe0),
+                               char(length & 0xff), char((length >> 8) & 0xff),
+                               char((length >> 16) & 0xff), char((length >> 24) & 0xff) };
+        if ((length == 0) || (outFile.write(item, sizeof(item)) != qint64(sizeof(item)))
+                || !copyFrames(outFile, offset, length))
+            return false;
+    }
+
+    const char delimiter[8] = { char(0xfe), char(0xff), char(0xdd), char(0xe0), 0x00, 0x00, 0x00, 0x00 };
+    return outFile.write(delimiter, sizeof(delimiter)) == qint64(sizeof(delimiter));
+}
+
+bool MultiFrameWriter::copyFrames(QFile& outFile, qint64 offset, qint64 length)
+{
+    if (!frameFile.seek(offset))
+        return false;
+
+    std::vector<char> block(std::size_t(std::min(CopyBlockSize, std::max(length, qint64(1)))));
+    for (qint64 copied = 0; copied < length; )
+    {
+        qint64 blockLength = std::min(qint64(block.size()), length - copied);
+        if ((frameFile.read(&block[0], blockLength) != blockLength)
+                || (outFile.write(&block[0], blockLength) != blockLength))
+            return false;
+        copied += blockLength;
+    }
+
+    return true;
+}
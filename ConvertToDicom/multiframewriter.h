@@ -0,0 +1,174 @@
+//
+//  multiframewriter.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MULTIFRAMEWRITER_H
+#define MULTIFRAMEWRITER_H
+
+#include "logger.h"
+#include "errorcodes.h"
+#include "itktypedefs.h"
+#include "slicedictionary.h"
+#include "pixelcodec.h"
+
+#include "itkheaders.pch.h"
+
+#include <QFile>
+#include <QMutex>
+
+#include <string>
+#include <vector>
+
+class ConversionJob;
+
+/**
+ * Writes a whole series as one multi-frame Grayscale Byte or Word Secondary Capture file.
+ * The attributes of each slice go into the per-frame functional groups, taken from the same
+ * SliceDictionary array a series written as single slices is. The orientation and pixel
+ * measures are shared by all of the frames.
+ *
+ * The per-frame functional groups come before the pixel data in the file and, in a hot
+ * folder, the number of frames is not known until the series is finished. So the frames are
+ * kept in a raw file beside the output as they arrive, in any order, and copied after the
+ * attributes by finish(). Compressed frames are compressed by the threads which write them,
+ * before they go into the raw file.
+ */
+class MultiFrameWriter
+{
+public:
+    /**
+     * Constructor.
+     * @param job The conversion the series belongs to. It must outlive the writer.
+     * @param fileName The name of the multi-frame file.
+     */
+    MultiFrameWriter(const ConversionJob& job, const std::string& fileName);
+
+    /**
+     * Destructor. The raw frames are removed.
+     */
+    ~MultiFrameWriter();
+
+    /**
+     * Get ready for the frames.
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode begin();
+
+    /**
+     * Set the compression of the frames in place of the one in the settings of the job, as
+     * when it is chosen for the series. It must be set before the first frame is kept.
+     * @param frameCompression The compression.
+     */
+    void setCompression(Compression frameCompression)
+    {
+        compression = frameCompression;
+    }
+
+    /**
+     * Keep a frame. This may be called from several threads at once and the frames may come
+     * in any order.
+     * @param frameIdx The index of the frame in the series.
+     * @param slice The slice which is the frame. Every frame must have the same size and pixel type.
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode writeFrame(int frameIdx, const AnyImage2DType* slice);
+
+    /**
+     * Write the file. Every frame must have been given to writeFrame().
+     * @param seriesLayer The attributes of the series.
+     * @param frames The attributes of each frame, in frame order.
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode finish(const SliceDictionary::SeriesLayer& seriesLayer, const std::vector<SliceDictionary>& frames);
+
+private:
+    /**
+     * Keep the pixels of a frame.
+     * @param frameIdx The index of the frame in the series.
+     * @param pixels The native pixels of the frame.
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode writeFramePixels(int frameIdx, const SlicePixels& pixels);
+
+    /**
+     * Compress a frame.
+     * @param pixels The native pixels.
+     * @param length The length of the pixels in bytes.
+     * @param frameColumns The number of columns.
+     * @param frameRows The number of rows.
+     * @param frameBits The number of bits per pixel.
+     * @param frameIsSigned Whether the pixels are signed.
+     * @param encoded Set to the compressed frame, padded to an even length.
+     * @return true if the frame was compressed.
+     */
+    bool encodeFrame(const char* pixels, qint64 length, unsigned frameColumns, unsigned frameRows,
+                     unsigned short frameBits, bool frameIsSigned, std::string& encoded);
+
+    /**
+     * Make the per-frame functional groups item of one frame.
+     * @param frame The attributes of the frame.
+     * @param frameIdx The index of the frame in the series.
+     * @return The item.
+     */
+    gdcm::Item makeFrameItem(const SliceDictionary& frame, int frameIdx);
+
+    /**
+     * Append the pixel data element to the file written by gdcm, copying the frames into it.
+     * @param numberOfFrames The number of frames.
+     * @return Suitable value in ErrorCode enum.
+     */
+    ErrorCode appendPixelData(int numberOfFrames);
+
+    /**
+     * Append the compressed frames to the file written by gdcm, as encapsulated pixel data
+     * with one fragment for each frame.
+     * @param outFile The file, open for appending.
+     * @param numberOfFrames The number of frames.
+     * @return true if the frames were written.
+     */
+    bool appendEncapsulatedPixelData(QFile& outFile, int numberOfFrames);
+
+    /**
+     * Copy part of the raw frames file to the output.
+     * @param outFile The file, open for appending.
+     * @param offset Where to start in the raw file.
+     * @param length How many bytes to copy.
+     * @return true if the bytes were copied.
+     */
+    bool copyFrames(QFile& outFile, qint64 offset, qint64 length);
+
+    const ConversionJob* job;        ///< The job passed in the constructor.
+    Compression compression;         ///< The compression of the frames.
+    std::string fileName;            ///< The name of the multi-frame file.
+    QFile frameFile;                 ///< The raw frames, in frame order.
+    QMutex frameMutex;               ///< Guards frameFile and the frame format.
+    int numberOfFramesWritten;       ///< Frames given to writeFrame().
+    std::vector<std::pair<qint64, qint64> > encodedFrames; ///< Offset and length of each compressed frame.
+
+    unsigned columns;                ///< Columns of every frame. 0 until the first frame.
+    unsigned rows;                   ///< Rows of every frame.
+    double spacing[2];               ///< Pixel spacing of every frame, column spacing first.
+    unsigned short bitsAllocated;    ///< Bits per pixel of every frame.
+    bool isSigned;                   ///< Whether the pixels are signed.
+
+    Logger logger; ///< Logger for this class.
+};
+
+#endif // MULTIFRAMEWRITER_H
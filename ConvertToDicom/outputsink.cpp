@@ -0,0 +1,445 @@
+//
+//  outputsink.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "outputsink.h"
+
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QTextStream>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+const std::size_t TarBlockSize = 512;
+
+/**
+ * Put a number into a tar header as zero padded octal digits followed by a NUL.
+ */
+void PutOctal(std::string& header, std::size_t offset, std::size_t width, qint64 value)
+{
+    for (std::size_t idx = width - 1; idx > 0; --idx)
+    {
+        header[offset + idx - 1] = char('0' + (value & 7));
+        value >>= 3;
+    }
+    header[offset + width - 1] = '\0';
+}
+
+void PutField(std::string& header, std::size_t offset, const char* value)
+{
+    header.replace(offset, std::strlen(value), value);
+}
+
+void AppendLE16(std::string& out, quint16 value)
+{
+    out += char(value & 0xff);
+    out += char((value >> 8) & 0xff);
+}
+
+void AppendLE32(std::string& out, quint32 value)
+{
+    AppendLE16(out, quint16(value & 0xffff));
+    AppendLE16(out, quint16((value >> 16) & 0xffff));
+}
+
+/**
+ * The CRC-32 zip keeps for each entry.
+ */
+quint32 Crc32(const std::string& data)
+{
+    struct Table
+    {
+        quint32 values[256];
+        Table()
+        {
+            for (quint32 idx = 0; idx < 256; ++idx)
+            {
+                quint32 value = idx;
+                for (int bit = 0; bit < 8; ++bit)
+                    value = (value & 1) ? (0xedb88320U ^ (value >> 1)) : (value >> 1);
+                values[idx] = value;
+            }
+        }
+    };
+    static const Table table;
+
+    quint32 crc = 0xffffffffU;
+    for (std::size_t idx = 0; idx < data.size(); ++idx)
+        crc = table.values[(crc ^ quint8(data[idx])) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffU;
+}
+
+}
+
+const char* OutputFormatName(OutputFormat format)
+{
+    switch (format)
+    {
+        case OutputFormat::TAR:
+            return "tar";
+        case OutputFormat::ZIP:
+            return "zip";
+        case OutputFormat::FILES:
+        default:
+            return "files";
+    };
+}
+
+bool OutputFormatFromName(const QString& name, OutputFormat& format)
+{
+    const OutputFormat formats[] = { OutputFormat::FILES, OutputFormat::TAR, OutputFormat::ZIP };
+    for (std::size_t idx = 0; idx < sizeof(formats) / sizeof(formats[0]); ++idx)
+    {
+        if (name.compare(OutputFormatName(formats[idx]), Qt::CaseInsensitive) == 0)
+        {
+            format = formats[idx];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+OutputSink::~OutputSink()
+{
+}
+
+OutputSink* OutputSink::create(OutputFormat format, const QString& outputDirectory, const QString& archiveName)
+{
+    switch (format)
+    {
+        case OutputFormat::TAR:
+            return new TarSink(outputDirectory + "/" + archiveName + ".tar");
+        case OutputFormat::ZIP:
+            return new ZipSink(outputDirectory + "/" + archiveName + ".zip");
+        case OutputFormat::FILES:
+        default:
+            return new DirectorySink(outputDirectory);
+    };
+}
+
+DirectorySink::DirectorySink(const QString& outputDirectory)
+    : outputDirectory(outputDirectory),
+      logger(Logger::getInstance(std::string(LOGGER_NAME) + ".DirectorySink"))
+{
+}
+
+ErrorCode DirectorySink::begin()
+{
+    return ErrorCode::SUCCESS;
+}
+
+ErrorCode DirectorySink::write(const std::string& name, const std::string& data)
+{
+    QFile file(outputDirectory + "/" + QString::fromStdString(name));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            || (file.write(data.data(), qint64(data.size())) != qint64(data.size())))
+    {
+        LOG4CPLUS_ERROR(logger, "Could not write " << file.fileName().toStdString());
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    return ErrorCode::SUCCESS;
+}
+
+ErrorCode DirectorySink::finish()
+{
+    return ErrorCode::SUCCESS;
+}
+
+ArchiveSink::ArchiveSink(const QString& archivePath)
+    : archive(archivePath),
+      logger(Logger::getInstance(std::string(LOGGER_NAME) + ".ArchiveSink")),
+      archiveLength(0)
+{
+}
+
+ArchiveSink::~ArchiveSink()
+{
+    if (archive.isOpen())
+    {
+        LOG4CPLUS_WARN(logger, "The archive " << archive.fileName().toStdString() << " was not finished.");
+        archive.close();
+    }
+}
+
+ErrorCode ArchiveSink::begin()
+{
+    QMutexLocker locker(&archiveMutex);
+
+    entries.clear();
+    archiveLength = 0;
+    if (!archive.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        LOG4CPLUS_ERROR(logger, "Could not create " << archive.fileName().toStdString());
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    return ErrorCode::SUCCESS;
+}
+
+ErrorCode ArchiveSink::write(const std::string& name, const std::string& data)
+{
+    // The header, and for zip the checksum, is made by the thread which made the instance.
+    Entry entry;
+    entry.name = name;
+    entry.headerOffset = 0;
+    entry.dataOffset = 0;
+    entry.length = qint64(data.size());
+    entry.crc = 0;
+    std::string header;
+    if (!makeHeader(entry, data, header))
+    {
+        LOG4CPLUS_ERROR(logger, "Cannot store " << name << " in " << archive.fileName().toStdString());
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+    std::string padding = makePadding(entry);
+
+    QMutexLocker locker(&archiveMutex);
+
+    qint64 endOffset = archiveLength + qint64(header.size()) + entry.length + qint64(padding.size());
+    if (!fits(endOffset, entries.size() + 1))
+    {
+        LOG4CPLUS_ERROR(logger, "The archive " << archive.fileName().toStdString() << " is too large for "
+                        << name << " to be added.");
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    entry.headerOffset = archiveLength;
+    entry.dataOffset = archiveLength + qint64(header.size());
+    if ((archive.write(header.data(), qint64(header.size())) != qint64(header.size()))
+            || (archive.write(data.data(), entry.length) != entry.length)
+            || (archive.write(padding.data(), qint64(padding.size())) != qint64(padding.size())))
+    {
+        LOG4CPLUS_ERROR(logger, "Could not add " << name << " to " << archive.fileName().toStdString());
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    archiveLength = endOffset;
+    entries.push_back(entry);
+    return ErrorCode::SUCCESS;
+}
+
+ErrorCode ArchiveSink::finish()
+{
+    QMutexLocker locker(&archiveMutex);
+
+    // A write which failed part way leaves bytes after the last entry, which are cut off.
+    std::string trailer;
+    bool ok = archive.resize(archiveLength) && archive.seek(archiveLength)
+            && makeTrailer(entries, archiveLength, trailer)
+            && (archive.write(trailer.data(), qint64(trailer.size())) == qint64(trailer.size()));
+    archive.close();
+    if (!ok || (archive.error() != QFileDevice::NoError))
+    {
+        LOG4CPLUS_ERROR(logger, "Could not finish " << archive.fileName().toStdString());
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    LOG4CPLUS_DEBUG(logger, "Wrote " << entries.size() << " instances to " << archive.fileName().toStdString());
+    return writeIndex(entries);
+}
+
+bool ArchiveSink::fits(qint64 endOffset, std::size_t numEntries) const
+{
+    Q_UNUSED(endOffset);
+    Q_UNUSED(numEntries);
+    return true;
+}
+
+ErrorCode ArchiveSink::writeIndex(const std::vector<Entry>& entries)
+{
+    Q_UNUSED(entries);
+    return ErrorCode::SUCCESS;
+}
+
+TarSink::TarSink(const QString& archivePath)
+    : ArchiveSink(archivePath),
+      modificationTime(QDateTime::currentDateTimeUtc().toMSecsSinceEpoch() / 1000)
+{
+}
+
+bool TarSink::makeHeader(Entry& entry, const std::string& data, std::string& header)
+{
+    Q_UNUSED(data);
+
+    // The ustar name field holds 100 characters and the size field 11 octal digits.
+    if ((entry.name.size() > 100) || (entry.length >= (qint64(1) << 33)))
+        return false;
+
+    header.assign(TarBlockSize, '\0');
+    PutField(header, 0, entry.name.c_str());
+    PutOctal(header, 100, 8, 0644);
+    PutOctal(header, 108, 8, 0);
+    PutOctal(header, 116, 8, 0);
+    PutOctal(header, 124, 12, entry.length);
+    PutOctal(header, 136, 12, modificationTime);
+    header[156] = '0';
+    PutField(header, 257, "ustar");
+    PutField(header, 263, "00");
+
+    // The checksum is taken with its own field as spaces.
+    PutField(header, 148, "        ");
+    qint64 checksum = 0;
+    for (std::size_t idx = 0; idx < header.size(); ++idx)
+        checksum += quint8(header[idx]);
+    PutOctal(header, 148, 7, checksum);
+    header[155] = ' ';
+
+    return true;
+}
+
+std::string TarSink::makePadding(const Entry& entry)
+{
+    return std::string((TarBlockSize - std::size_t(entry.length % qint64(TarBlockSize))) % TarBlockSize, '\0');
+}
+
+bool TarSink::makeTrailer(const std::vector<Entry>& entries, qint64 endOffset, std::string& trailer)
+{
+    Q_UNUSED(entries);
+    Q_UNUSED(endOffset);
+
+    // Two empty blocks end the archive.
+    trailer.assign(2 * TarBlockSize, '\0');
+    return true;
+}
+
+ErrorCode TarSink::writeIndex(const std::vector<Entry>& entries)
+{
+    QFile indexFile(archive.fileName() + ".index");
+    if (!indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        LOG4CPLUS_ERROR(logger, "Could not write " << indexFile.fileName().toStdString());
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    // One line per instance: its name, where it starts in the archive and its length.
+    QTextStream index(&indexFile);
+    for (std::size_t idx = 0; idx < entries.size(); ++idx)
+    {
+        index << QString::fromStdString(entries[idx].name) << "\t" << entries[idx].dataOffset << "\t"
+              << entries[idx].length << "\n";
+    }
+    index.flush();
+
+    if (indexFile.error() != QFileDevice::NoError)
+    {
+        LOG4CPLUS_ERROR(logger, "Could not write " << indexFile.fileName().toStdString());
+        return ErrorCode::ERROR_WRITING_FILE;
+    }
+
+    return ErrorCode::SUCCESS;
+}
+
+ZipSink::ZipSink(const QString& archivePath)
+    : ArchiveSink(archivePath)
+{
+    // MS-DOS times are local, in two second steps, and start in 1980.
+    QDateTime now = QDateTime::currentDateTime();
+    dosTime = quint16((now.time().hour() << 11) | (now.time().minute() << 5) | (now.time().second() / 2));
+    dosDate = quint16(((std::max(now.date().year(), 1980) - 1980) << 9) | (now.date().month() << 5)
+                      | now.date().day());
+}
+
+bool ZipSink::makeHeader(Entry& entry, const std::string& data, std::string& header)
+{
+    if ((entry.name.size() > 0xffff) || (entry.length > qint64(0xffffffffU)))
+        return false;
+
+    entry.crc = Crc32(data);
+
+    // The local file header. The instances are stored as they are.
+    header.clear();
+    AppendLE32(header, 0x04034b50U);
+    AppendLE16(header, 10);
+    AppendLE16(header, 0);
+    AppendLE16(header, 0);
+    AppendLE16(header, dosTime);
+    AppendLE16(header, dosDate);
+    AppendLE32(header, entry.crc);
+    AppendLE32(header, quint32(entry.length));
+    AppendLE32(header, quint32(entry.length));
+    AppendLE16(header, quint16(entry.name.size()));
+    AppendLE16(header, 0);
+    header += entry.name;
+
+    return true;
+}
+
+std::string ZipSink::makePadding(const Entry& entry)
+{
+    Q_UNUSED(entry);
+    return std::string();
+}
+
+bool ZipSink::makeTrailer(const std::vector<Entry>& entries, qint64 endOffset, std::string& trailer)
+{
+    trailer.clear();
+    for (std::size_t idx = 0; idx < entries.size(); ++idx)
+    {
+        const Entry& entry = entries[idx];
+        AppendLE32(trailer, 0x02014b50U);
+        AppendLE16(trailer, 20);
+        AppendLE16(trailer, 10);
+        AppendLE16(trailer, 0);
+        AppendLE16(trailer, 0);
+        AppendLE16(trailer, dosTime);
+        AppendLE16(trailer, dosDate);
+        AppendLE32(trailer, entry.crc);
+        AppendLE32(trailer, quint32(entry.length));
+        AppendLE32(trailer, quint32(entry.length));
+        AppendLE16(trailer, quint16(entry.name.size()));
+        AppendLE16(trailer, 0);
+        AppendLE16(trailer, 0);
+        AppendLE16(trailer, 0);
+        AppendLE16(trailer, 0);
+        AppendLE32(trailer, 0);
+        AppendLE32(trailer, quint32(entry.headerOffset));
+        trailer += entry.name;
+    }
+
+    // The end of central directory record.
+    qint64 directoryLength = qint64(trailer.size());
+    if (!fits(endOffset + directoryLength, entries.size()))
+        return false;
+
+    AppendLE32(trailer, 0x06054b50U);
+    AppendLE16(trailer, 0);
+    AppendLE16(trailer, 0);
+    AppendLE16(trailer, quint16(entries.size()));
+    AppendLE16(trailer, quint16(entries.size()));
+    AppendLE32(trailer, quint32(directoryLength));
+    AppendLE32(trailer, quint32(endOffset));
+    AppendLE16(trailer, 0);
+
+    return true;
+}
+
+bool ZipSink::fits(qint64 endOffset, std::size_t numEntries) const
+{
+    return (endOffset <= qint64(0xffffffffU)) && (numEntries <= 0xffff);
+}
@@ -0,0 +1,259 @@
+//
+//  outputsink.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OUTPUTSINK_H
+#define OUTPUTSINK_H
+
+#include "logger.h"
+#include "errorcodes.h"
+
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QtGlobal>
+
+#include <string>
+#include <vector>
+
+/**
+ * Where the DICOM instances of a series go.
+ */
+enum struct OutputFormat
+{
+    FILES,  ///< One file per instance in the output directory.
+    TAR,    ///< One tar archive in the output directory.
+    ZIP     ///< One zip archive, stored without compression, in the output directory.
+};
+
+/**
+ * Get the name of an output format, as it is given on the command line and saved in the settings.
+ * @param format The output format.
+ * @return The name.
+ */
+const char* OutputFormatName(OutputFormat format);
+
+/**
+ * Find an output format from its name.
+ * @param name The name, as OutputFormatName() gives it.
+ * @param format Set to the output format if the name is known.
+ * @return true if the name is known.
+ */
+bool OutputFormatFromName(const QString& name, OutputFormat& format);
+
+/**
+ * Receives the encoded DICOM instances of a series. The instances are named as files in the
+ * output directory would be, and a sink may store them as such files or stream them into a
+ * single container. Instances may be written from several threads at once.
+ */
+class OutputSink
+{
+public:
+    /**
+     * Destructor.
+     */
+    virtual ~OutputSink();
+
+    /**
+     * Get ready for the instances. The output directory must already exist.
+     * @return Suitable value in ErrorCode enum.
+     */
+    virtual ErrorCode begin() = 0;
+
+    /**
+     * Store one instance. This may be called from several threads at once.
+     * @param name The name of the instance, as a file name in the output directory.
+     * @param data The encoded instance.
+     * @return Suitable value in ErrorCode enum.
+     */
+    virtual ErrorCode write(const std::string& name, const std::string& data) = 0;
+
+    /**
+     * Finish the output after the last instance.
+     * @return Suitable value in ErrorCode enum.
+     */
+    virtual ErrorCode finish() = 0;
+
+    /**
+     * Make a sink.
+     * @param format The output format.
+     * @param outputDirectory The output directory.
+     * @param archiveName The file name of the archive in the output directory, without its
+     * extension. Not used for OutputFormat::FILES.
+     * @return The sink. The caller owns it.
+     */
+    static OutputSink* create(OutputFormat format, const QString& outputDirectory, const QString& archiveName);
+};
+
+/**
+ * Writes each instance as a file in the output directory.
+ */
+class DirectorySink : public OutputSink
+{
+public:
+    /**
+     * Constructor.
+     * @param outputDirectory The output directory.
+     */
+    explicit DirectorySink(const QString& outputDirectory);
+
+    ErrorCode begin();
+    ErrorCode write(const std::string& name, const std::string& data);
+    ErrorCode finish();
+
+private:
+    QString outputDirectory;    ///< The output directory.
+    Logger logger;              ///< Logger for this class.
+};
+
+/**
+ * Streams the instances into one archive file as they come, in the order they come. An index
+ * of the entries, with the offset and length of each instance, is kept as they are written so
+ * that an instance can be found without reading the archive through.
+ */
+class ArchiveSink : public OutputSink
+{
+public:
+    /**
+     * Constructor.
+     * @param archivePath The path of the archive.
+     */
+    explicit ArchiveSink(const QString& archivePath);
+
+    /**
+     * Destructor. An archive which was not finished is closed as it is.
+     */
+    ~ArchiveSink();
+
+    ErrorCode begin();
+    ErrorCode write(const std::string& name, const std::string& data);
+    ErrorCode finish();
+
+protected:
+    /** An instance in the archive. */
+    struct Entry
+    {
+        std::string name;       ///< The name of the instance.
+        qint64 headerOffset;    ///< Where the entry's header starts in the archive.
+        qint64 dataOffset;      ///< Where the instance starts in the archive.
+        qint64 length;          ///< The length of the instance.
+        quint32 crc;            ///< The CRC-32 of the instance, if the format needs it.
+    };
+
+    /**
+     * Make the header which goes before an instance. This is called before the instance has
+     * its place in the archive, so that the headers of several instances can be made at once.
+     * @param entry The entry. Its offsets are not yet known.
+     * @param data The instance.
+     * @param header Set to the header.
+     * @return false if the instance cannot be stored in the format.
+     */
+    virtual bool makeHeader(Entry& entry, const std::string& data, std::string& header) = 0;
+
+    /**
+     * Make the padding which goes after an instance.
+     * @param entry The entry.
+     * @return The padding.
+     */
+    virtual std::string makePadding(const Entry& entry) = 0;
+
+    /**
+     * Make what goes at the end of the archive.
+     * @param entries Every entry of the archive, in order.
+     * @param endOffset Where the end starts in the archive.
+     * @param trailer Set to the end of the archive.
+     * @return false if the archive is too large for the format.
+     */
+    virtual bool makeTrailer(const std::vector<Entry>& entries, qint64 endOffset, std::string& trailer) = 0;
+
+    /**
+     * Check that the archive can grow as far as it would with another entry.
+     * @param endOffset The length the archive would have.
+     * @param numEntries The number of entries it would have.
+     * @return false if the format cannot hold that much.
+     */
+    virtual bool fits(qint64 endOffset, std::size_t numEntries) const;
+
+    /**
+     * Write the index of the archive somewhere other than the archive itself, if the format
+     * has nowhere for it.
+     * @param entries Every entry of the archive, in order.
+     * @return Suitable value in ErrorCode enum.
+     */
+    virtual ErrorCode writeIndex(const std::vector<Entry>& entries);
+
+    QFile archive;              ///< The archive.
+    Logger logger;              ///< Logger for this class.
+
+private:
+    QMutex archiveMutex;        ///< Guards archive, archiveLength and entries.
+    qint64 archiveLength;       ///< The length of the archive so far.
+    std::vector<Entry> entries; ///< The index of the instances written.
+};
+
+/**
+ * Writes the instances into a POSIX (ustar) tar archive. Tar has no index of its own, so the
+ * index is written as text beside the archive, in the file with ".index" added to its name.
+ */
+class TarSink : public ArchiveSink
+{
+public:
+    /**
+     * Constructor.
+     * @param archivePath The path of the archive.
+     */
+    explicit TarSink(const QString& archivePath);
+
+protected:
+    bool makeHeader(Entry& entry, const std::string& data, std::string& header);
+    std::string makePadding(const Entry& entry);
+    bool makeTrailer(const std::vector<Entry>& entries, qint64 endOffset, std::string& trailer);
+    ErrorCode writeIndex(const std::vector<Entry>& entries);
+
+private:
+    qint64 modificationTime;    ///< The time given to every entry, in seconds since the epoch.
+};
+
+/**
+ * Writes the instances into a zip archive without compressing them. The central directory
+ * at the end of the archive is its index. The archive is limited to what zip holds without
+ * its 64 bit extensions: 65535 instances and 4 GB.
+ */
+class ZipSink : public ArchiveSink
+{
+public:
+    /**
+     * Constructor.
+     * @param archivePath The path of the archive.
+     */
+    explicit ZipSink(const QString& archivePath);
+
+protected:
+    bool makeHeader(Entry& entry, const std::string& data, std::string& header);
+    std::string makePadding(const Entry& entry);
+    bool makeTrailer(const std::vector<Entry>& entries, qint64 endOffset, std::string& trailer);
+    bool fits(qint64 endOffset, std::size_t numEntries) const;
+
+private:
+    quint16 dosTime;            ///< The time given to every entry, as MS-DOS has it.
+    quint16 dosDate;            ///< The date given to every entry, as MS-DOS has it.
+};
+
+#endif // OUTPUTSINK_H
@@ -0,0 +1,109 @@
+//
+//  parallel.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <QAtomicInt>
+#include <QFuture>
+#include <QThreadPool>
+#include <QVector>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <exception>
+
+/**
+ * Get the number of worker threads to use for a task.
+ * @param requested The number of threads asked for. Values less than 1 mean one thread per core.
+ * @return The number of threads to use. This is always at least 1.
+ */
+int EffectiveThreadCount(int requested);
+
+/**
+ * Call <code>func(idx)</code> for every <code>idx</code> in [0, count) using at most
+ * <code>numThreads</code> worker threads. The indices are handed out in increasing order so
+ * the work proceeds roughly from front to back. Results must be stored by index by the caller,
+ * which keeps them in their original order. This returns when every index has been processed.
+ * If <code>func</code> throws, no more indices are handed out and the first exception is
+ * thrown again once every worker has stopped.
+ * @param count The number of work items.
+ * @param numThreads The maximum number of worker threads. See EffectiveThreadCount().
+ * @param func The function to call.
+ */
+template <typename Func>
+void ParallelFor(int count, int numThreads, Func func)
+{
+    int numWorkers = std::min(EffectiveThreadCount(numThreads), count);
+
+    // Not worth the trouble of starting threads.
+    if (numWorkers <= 1)
+    {
+        for (int idx = 0; idx < count; ++idx)
+            func(idx);
+        return;
+    }
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(numWorkers);
+
+    QAtomicInt nextIdx(0);
+    QVector<QFuture<void> > futures;
+    for (int worker = 0; worker < numWorkers; ++worker)
+    {
+        futures.append(QtConcurrent::run(&pool, [&nextIdx, &func, count]()
+        {
+            int idx;
+            while ((idx = nextIdx.fetchAndAddOrdered(1)) < count)
+            {
+                try
+                {
+                    func(idx);
+                }
+                catch (...)
+                {
+                    nextIdx.storeRelease(count);
+                    throw;
+                }
+            }
+        }));
+    }
+
+    // Every worker must be done with nextIdx and func before they go, so an exception waits.
+    std::exception_ptr firstException;
+    for (int worker = 0; worker < futures.size(); ++worker)
+    {
+        try
+        {
+            futures[worker].waitForFinished();
+        }
+        catch (...)
+        {
+            if (!firstException)
+                firstException = std::current_exception();
+        }
+    }
+
+    if (firstException)
+        std::rethrow_exception(firstException);
+}
+
+#endif // PARALLEL_H
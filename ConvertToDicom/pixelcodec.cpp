@@ -0,0 +1,182 @@
+//
+//  pixelcodec.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "pixelcodec.h"
+
+#include <sstream>
+#include <iomanip>
+
+namespace
+{
+template <typename TPixel>
+bool GetTypedSlicePixels(const AnyImage2DType* slice, bool isSigned, SlicePixels& pixels)
+{
+    typedef itk::Image<TPixel, 2u> SliceType;
+    const SliceType* typedSlice = dynamic_cast<const SliceType*>(slice);
+    if (typedSlice == 0)
+        return false;
+
+    typename SliceType::SizeType size = typedSlice->GetBufferedRegion().GetSize();
+    typename SliceType::SpacingType sliceSpacing = typedSlice->GetSpacing();
+    pixels.data = reinterpret_cast<const char*>(typedSlice->GetBufferPointer());
+    pixels.length = qint64(size[0]) * qint64(size[1]) * qint64(sizeof(TPixel));
+    pixels.columns = unsigned(size[0]);
+    pixels.rows = unsigned(size[1]);
+    pixels.spacing[0] = sliceSpacing[0];
+    pixels.spacing[1] = sliceSpacing[1];
+    pixels.bitsAllocated = static_cast<unsigned short>(8 * sizeof(TPixel));
+    pixels.isSigned = isSigned;
+    return true;
+}
+}
+
+bool GetSlicePixels(const AnyImage2DType* slice, SlicePixels& pixels)
+{
+    // ITK writes char pixels as signed, whatever the platform's char is, so we do too.
+    return GetTypedSlicePixels<unsigned char>(slice, false, pixels)
+            || GetTypedSlicePixels<char>(slice, true, pixels)
+            || GetTypedSlicePixels<unsigned short>(slice, false, pixels)
+            || GetTypedSlicePixels<short>(slice, true, pixels);
+}
+
+const char* CompressionName(Compression compression)
+{
+    switch (compression)
+    {
+        case Compression::RLE:
+            return "rle";
+        case Compression::JPEG_LS:
+            return "jpeg-ls";
+        case Compression::JPEG_2000:
+            return "jpeg2000";
+        case Compression::AUTO:
+            return "auto";
+        case Compression::NONE:
+        default:
+            return "none";
+    };
+}
+
+bool CompressionFromName(const QString& name, Compression& compression)
+{
+    const Compression compressions[] = { Compression::NONE, Compression::RLE, Compression::JPEG_LS,
+                                         Compression::JPEG_2000, Compression::AUTO };
+    for (std::size_t idx = 0; idx < sizeof(compressions) / sizeof(compressions[0]); ++idx)
+    {
+        if (name.compare(CompressionName(compressions[idx]), Qt::CaseInsensitive) == 0)
+        {
+            compression = compressions[idx];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+gdcm::TransferSyntax::TSType CompressionTransferSyntax(Compression compression)
+{
+    switch (compression)
+    {
+        case Compression::RLE:
+            return gdcm::TransferSyntax::RLELossless;
+        case Compression::JPEG_LS:
+            return gdcm::TransferSyntax::JPEGLSLossless;
+        case Compression::JPEG_2000:
+            return gdcm::TransferSyntax::JPEG2000Lossless;
+        case Compression::NONE:
+        case Compression::AUTO:
+        default:
+            return gdcm::TransferSyntax::ExplicitVRLittleEndian;
+    };
+}
+
+std::vector<Compression> CompressionCandidates()
+{
+    std::vector<Compression> candidates;
+    candidates.push_back(Compression::RLE);
+    candidates.push_back(Compression::JPEG_LS);
+    candidates.push_back(Compression::JPEG_2000);
+    return candidates;
+}
+
+Compression ChooseCompression(const std::vector<CompressionTrial>& trials, double minimumRate)
+{
+    const double megabyte = 1024.0 * 1024.0;
+
+    Compression choice = Compression::NONE;
+    double bestRatio = 1.0;
+    for (std::size_t idx = 0; idx < trials.size(); ++idx)
+    {
+        const CompressionTrial& trial = trials[idx];
+        if ((trial.rawBytes <= 0) || (trial.storedBytes <= 0))
+            continue;
+
+        // A trial too quick to time is as fast as it need be.
+        double rate = (trial.nanoseconds > 0) ? (trial.rawBytes / megabyte) / (trial.nanoseconds * 1e-9) : minimumRate;
+        double ratio = double(trial.rawBytes) / double(trial.storedBytes);
+        if ((rate >= minimumRate) && (ratio > bestRatio))
+        {
+            choice = trial.compression;
+            bestRatio = ratio;
+        }
+    }
+
+    return choice;
+}
+
+bool CompressPixels(Compression compression, const gdcm::DataElement& pixelData, unsigned columns, unsigned rows,
+                    unsigned short bitsAllocated, bool isSigned, gdcm::DataElement& compressed)
+{
+    gdcm::Image image;
+    image.SetNumberOfDimensions(2);
+    image.SetDimension(0, columns);
+    image.SetDimension(1, rows);
+    image.SetPixelFormat(gdcm::PixelFormat(1, bitsAllocated, bitsAllocated, static_cast<unsigned short>(bitsAllocated - 1),
+                                           isSigned ? 1 : 0));
+    image.SetPhotometricInterpretation(gdcm::PhotometricInterpretation::MONOCHROME2);
+    image.SetTransferSyntax(gdcm::TransferSyntax::ExplicitVRLittleEndian);
+    image.SetDataElement(pixelData);
+
+    // The codec is chosen from the transfer syntax, and for these it is always lossless.
+    gdcm::ImageChangeTransferSyntax change;
+    change.SetTransferSyntax(CompressionTransferSyntax(compression));
+    change.SetInput(image);
+    if (!change.Change())
+        return false;
+
+    compressed = change.GetOutput().GetDataElement();
+    return compressed.GetSequenceOfFragments() != 0;
+}
+
+std::string CompressionReport(Compression compression, qint64 rawBytes, qint64 storedBytes, qint64 nanoseconds)
+{
+    const double megabyte = 1024.0 * 1024.0;
+
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(1) << CompressionName(compression) << ": "
+           << rawBytes / megabyte << " MB to " << storedBytes / megabyte << " MB";
+    if (storedBytes > 0)
+        report << std::setprecision(2) << ", ratio " << double(rawBytes) / double(storedBytes);
+    if (nanoseconds > 0)
+        report << std::setprecision(1) << ", " << (rawBytes / megabyte) / (nanoseconds * 1e-9) << " MB/s per thread";
+
+    return report.str();
+}
@@ -0,0 +1,143 @@
+//
+//  pixelcodec.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PIXELCODEC_H
+#define PIXELCODEC_H
+
+#include "itktypedefs.h"
+
+#include "itkheaders.pch.h"
+
+#include <QString>
+
+#include <string>
+#include <vector>
+
+/**
+ * The lossless compression of the pixels of the DICOM output.
+ */
+enum struct Compression
+{
+    NONE,       ///< Explicit VR little endian, uncompressed.
+    RLE,        ///< RLE Lossless.
+    JPEG_LS,    ///< JPEG-LS Lossless.
+    JPEG_2000,  ///< JPEG 2000 Lossless.
+    AUTO        ///< Chosen for each series by trying the others on a few of its slices.
+};
+
+/**
+ * How one compression did on a sample of the pixels of a series.
+ */
+struct CompressionTrial
+{
+    Compression compression;    ///< The compression tried.
+    qint64 rawBytes;            ///< The size of the sample before compression.
+    qint64 storedBytes;         ///< The size of the sample after compression.
+    qint64 nanoseconds;         ///< Time spent compressing the sample, summed over the threads.
+};
+
+/**
+ * The native pixels of a slice, as the DICOM output has them.
+ */
+struct SlicePixels
+{
+    const char* data;               ///< The pixels, in the slice's own buffer.
+    qint64 length;                  ///< The length of the pixels in bytes.
+    unsigned columns;               ///< The number of columns.
+    unsigned rows;                  ///< The number of rows.
+    double spacing[2];              ///< The pixel spacing, column spacing first as ITK has it.
+    unsigned short bitsAllocated;   ///< The number of bits per pixel, 8 or 16.
+    bool isSigned;                  ///< Whether the pixels are signed.
+};
+
+/**
+ * Get the native pixels of a slice and how they are written. Every writer of the DICOM
+ * output goes through this so that they agree on the pixel types and their representation.
+ * @param slice The slice.
+ * @param pixels Set to the pixels. They stay in the slice's buffer.
+ * @return false if the slice has none of the pixel types of the DICOM output.
+ */
+bool GetSlicePixels(const AnyImage2DType* slice, SlicePixels& pixels);
+
+/**
+ * Get the name of a compression, as it is given on the command line and saved in the settings.
+ * @param compression The compression.
+ * @return The name.
+ */
+const char* CompressionName(Compression compression);
+
+/**
+ * Find a compression from its name.
+ * @param name The name, as CompressionName() gives it.
+ * @param compression Set to the compression if the name is known.
+ * @return true if the name is known.
+ */
+bool CompressionFromName(const QString& name, Compression& compression);
+
+/**
+ * Get the transfer syntax the pixels are written in.
+ * @param compression The compression.
+ * @return The transfer syntax.
+ */
+gdcm::TransferSyntax::TSType CompressionTransferSyntax(Compression compression);
+
+/**
+ * Get the compressions tried for Compression::AUTO.
+ * @return The lossless codecs.
+ */
+std::vector<Compression> CompressionCandidates();
+
+/**
+ * Choose the compression of a series from trials on a sample of it. The choice is the codec
+ * with the best ratio of those which compress at least minimumRate megabytes a second in one
+ * thread. Not compressing is a candidate too, with a ratio of 1, so it is the choice if no codec
+ * is fast enough or saves any space.
+ * @param trials The trials. Those with no raw bytes are passed over.
+ * @param minimumRate The throughput floor in megabytes a second per thread.
+ * @return The compression.
+ */
+Compression ChooseCompression(const std::vector<CompressionTrial>& trials, double minimumRate);
+
+/**
+ * Compress the native pixels of one frame.
+ * @param compression The compression. It must not be NONE.
+ * @param pixelData The pixel data element, in explicit VR little endian.
+ * @param columns The number of columns.
+ * @param rows The number of rows.
+ * @param bitsAllocated The number of bits per pixel, 8 or 16.
+ * @param isSigned Whether the pixels are signed.
+ * @param compressed Set to the encapsulated pixel data element.
+ * @return true if the pixels were compressed.
+ */
+bool CompressPixels(Compression compression, const gdcm::DataElement& pixelData, unsigned columns, unsigned rows,
+                    unsigned short bitsAllocated, bool isSigned, gdcm::DataElement& compressed);
+
+/**
+ * Describe how well a compression did, for the log and the batch summary.
+ * @param compression The compression.
+ * @param rawBytes The size of the pixels before compression.
+ * @param storedBytes The size of the pixels after compression.
+ * @param nanoseconds The time spent compressing, summed over the threads.
+ * @return The description.
+ */
+std::string CompressionReport(Compression compression, qint64 rawBytes, qint64 storedBytes, qint64 nanoseconds);
+
+#endif // PIXELCODEC_H
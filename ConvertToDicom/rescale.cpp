@@ -0,0 +1,317 @@
+//
+//  rescale.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "rescale.h"
+
+#include "itkheaders.pch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <iomanip>
+
+// AVX2 is chosen at run time so the program still runs on older x86 processors. Every
+// AArch64 processor has NEON. Anything else uses the scalar code.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define RESCALE_AVX2
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define RESCALE_NEON
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+typedef itk::Image<float, 2u> FloatSliceType;
+typedef itk::Image<RescalePixelType, 2u> StoredSliceType;
+
+const float MaxStored = float(std::numeric_limits<RescalePixelType>::max());
+
+/**
+ * Format a number as a DICOM decimal string, which may be at most 16 characters long.
+ * The C locale is used whatever the user's locale is.
+ */
+std::string DecimalString(double value)
+{
+    std::string result;
+    for (int precision = 10; precision > 0; --precision)
+    {
+        std::ostringstream sstr;
+        sstr.imbue(std::locale::classic());
+        sstr << std::setprecision(precision) << value;
+        result = sstr.str();
+        if (result.length() <= 16)
+            break;
+    }
+
+    return result;
+}
+
+double ParseDecimalString(const std::string& str)
+{
+    std::istringstream sstr(str);
+    sstr.imbue(std::locale::classic());
+    double value = 0.0;
+    sstr >> value;
+    return value;
+}
+
+void FloatRangeScalar(const float* pixels, std::size_t count, float& minValue, float& maxValue)
+{
+    for (std::size_t idx = 0; idx < count; ++idx)
+    {
+        // v - v is 0 for finite values and NaN for the rest.
+        float value = pixels[idx];
+        if (value - value == 0.0f)
+        {
+            minValue = std::min(minValue, value);
+            maxValue = std::max(maxValue, value);
+        }
+    }
+}
+
+inline RescalePixelType QuantizeScalar(float value, float intercept, float inverseSlope)
+{
+    float stored = (value - intercept) * inverseSlope;
+
+    // NaN fails both tests and becomes 0, as in the vector code.
+    stored = stored > 0.0f ? stored : 0.0f;
+    stored = stored < MaxStored ? stored : MaxStored;
+
+    // Round to nearest even, as the vector conversions do.
+    return RescalePixelType(std::nearbyint(stored));
+}
+
+void QuantizeScalar(const float* pixels, std::size_t count, float intercept, float inverseSlope,
+                    RescalePixelType* stored)
+{
+    for (std::size_t idx = 0; idx < count; ++idx)
+        stored[idx] = QuantizeScalar(pixels[idx], intercept, inverseSlope);
+}
+
+#if defined(RESCALE_AVX2)
+bool HaveAvx2()
+{
+    static const bool haveAvx2 = __builtin_cpu_supports("avx2");
+    return haveAvx2;
+}
+
+__attribute__((target("avx2")))
+void FloatRangeAvx2(const float* pixels, std::size_t count, float& minValue, float& maxValue)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 plusInfinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    const __m256 minusInfinity = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    __m256 lows = _mm256_set1_ps(minValue);
+    __m256 highs = _mm256_set1_ps(maxValue);
+
+    std::size_t idx = 0;
+    for (; idx + 8 <= count; idx += 8)
+    {
+        __m256 values = _mm256_loadu_ps(pixels + idx);
+        __m256 finite = _mm256_cmp_ps(_mm256_sub_ps(values, values), zero, _CMP_EQ_OQ);
+        lows = _mm256_min_ps(lows, _mm256_blendv_ps(plusInfinity, values, finite));
+        highs = _mm256_max_ps(highs, _mm256_blendv_ps(minusInfinity, values, finite));
+    }
+
+    float laneLows[8];
+    float laneHighs[8];
+    _mm256_storeu_ps(laneLows, lows);
+    _mm256_storeu_ps(laneHighs, highs);
+    for (int lane = 0; lane < 8; ++lane)
+    {
+        minValue = std::min(minValue, laneLows[lane]);
+        maxValue = std::max(maxValue, laneHighs[lane]);
+    }
+
+    FloatRangeScalar(pixels + idx, count - idx, minValue, maxValue);
+}
+
+__attribute__((target("avx2")))
+void QuantizeAvx2(const float* pixels, std::size_t count, float intercept, float inverseSlope,
+                  RescalePixelType* stored)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 maxStored = _mm256_set1_ps(MaxStored);
+    const __m256 offset = _mm256_set1_ps(intercept);
+    const __m256 scale = _mm256_set1_ps(inverseSlope);
+
+    std::size_t idx = 0;
+    for (; idx + 16 <= count; idx += 16)
+    {
+        __m256 low = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(pixels + idx), offset), scale);
+        __m256 high = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(pixels + idx + 8), offset), scale);
+
+        // max returns its second operand for NaN, so NaN becomes 0.
+        low = _mm256_min_ps(_mm256_max_ps(low, zero), maxStored);
+        high = _mm256_min_ps(_mm256_max_ps(high, zero), maxStored);
+
+        // The pack works within each 128 bit lane, so the 64 bit quarters are put back in order.
+        __m256i packed = _mm256_packus_epi32(_mm256_cvtps_epi32(low), _mm256_cvtps_epi32(high));
+        packed = _mm256_permute4x64_epi64(packed, 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(stored + idx), packed);
+    }
+
+    QuantizeScalar(pixels + idx, count - idx, intercept, inverseSlope, stored + idx);
+}
+#endif
+
+#if defined(RESCALE_NEON)
+void FloatRangeNeon(const float* pixels, std::size_t count, float& minValue, float& maxValue)
+{
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t plusInfinity = vdupq_n_f32(std::numeric_limits<float>::infinity());
+    const float32x4_t minusInfinity = vdupq_n_f32(-std::numeric_limits<float>::infinity());
+    float32x4_t lows = vdupq_n_f32(minValue);
+    float32x4_t highs = vdupq_n_f32(maxValue);
+
+    std::size_t idx = 0;
+    for (; idx + 4 <= count; idx += 4)
+    {
+        float32x4_t values = vld1q_f32(pixels + idx);
+        uint32x4_t finite = vceqq_f32(vsubq_f32(values, values), zero);
+        lows = vminq_f32(lows, vbslq_f32(finite, values, plusInfinity));
+        highs = vmaxq_f32(highs, vbslq_f32(finite, values, minusInfinity));
+    }
+
+    minValue = std::min(minValue, vminvq_f32(lows));
+    maxValue = std::max(maxValue, vmaxvq_f32(highs));
+
+    FloatRangeScalar(pixels + idx, count - idx, minValue, maxValue);
+}
+
+void QuantizeNeon(const float* pixels, std::size_t count, float intercept, float inverseSlope,
+                  RescalePixelType* stored)
+{
+    const float32x4_t offset = vdupq_n_f32(intercept);
+    const float32x4_t scale = vdupq_n_f32(inverseSlope);
+
+    std::size_t idx = 0;
+    for (; idx + 8 <= count; idx += 8)
+    {
+        float32x4_t low = vmulq_f32(vsubq_f32(vld1q_f32(pixels + idx), offset), scale);
+        float32x4_t high = vmulq_f32(vsubq_f32(vld1q_f32(pixels + idx + 4), offset), scale);
+
+        // The conversion rounds to nearest even, saturates and turns NaN into 0. The
+        // narrowing saturates too, so together they clamp as QuantizeScalar() does.
+        uint16x8_t packed = vcombine_u16(vqmovn_u32(vcvtnq_u32_f32(low)), vqmovn_u32(vcvtnq_u32_f32(high)));
+        vst1q_u16(stored + idx, packed);
+    }
+
+    QuantizeScalar(pixels + idx, count - idx, intercept, inverseSlope, stored + idx);
+}
+#endif
+}
+
+RescaleParameters::RescaleParameters()
+    : slope(1.0),
+      intercept(0.0),
+      slopeString("1"),
+      interceptString("0")
+{
+}
+
+void FloatRange(const float* pixels, std::size_t count, float& minValue, float& maxValue)
+{
+#if defined(RESCALE_AVX2)
+    if (HaveAvx2())
+    {
+        FloatRangeAvx2(pixels, count, minValue, maxValue);
+        return;
+    }
+    FloatRangeScalar(pixels, count, minValue, maxValue);
+#elif defined(RESCALE_NEON)
+    FloatRangeNeon(pixels, count, minValue, maxValue);
+#else
+    FloatRangeScalar(pixels, count, minValue, maxValue);
+#endif
+}
+
+bool SliceRange(const AnyImage2DType* slice, float& minValue, float& maxValue)
+{
+    const FloatSliceType* floatSlice = dynamic_cast<const FloatSliceType*>(slice);
+    if (floatSlice == 0)
+        return false;
+
+    FloatRange(floatSlice->GetBufferPointer(), floatSlice->GetBufferedRegion().GetNumberOfPixels(),
+               minValue, maxValue);
+    return true;
+}
+
+RescaleParameters MakeRescale(float minValue, float maxValue)
+{
+    RescaleParameters rescale;
+    if (!(minValue <= maxValue))
+        return rescale;
+
+    // The numbers are read back from the strings so that quantizing uses what is written.
+    rescale.interceptString = DecimalString(minValue);
+    rescale.intercept = ParseDecimalString(rescale.interceptString);
+
+    double slope = (double(maxValue) - double(minValue)) / MaxStored;
+    if (slope > 0.0)
+    {
+        rescale.slopeString = DecimalString(slope);
+        rescale.slope = ParseDecimalString(rescale.slopeString);
+    }
+
+    return rescale;
+}
+
+void QuantizeFloats(const float* pixels, std::size_t count, const RescaleParameters& rescale,
+                    RescalePixelType* stored)
+{
+    float intercept = float(rescale.intercept);
+    float inverseSlope = float(1.0 / rescale.slope);
+
+#if defined(RESCALE_AVX2)
+    if (HaveAvx2())
+    {
+        QuantizeAvx2(pixels, count, intercept, inverseSlope, stored);
+        return;
+    }
+    QuantizeScalar(pixels, count, intercept, inverseSlope, stored);
+#elif defined(RESCALE_NEON)
+    QuantizeNeon(pixels, count, intercept, inverseSlope, stored);
+#else
+    QuantizeScalar(pixels, count, intercept, inverseSlope, stored);
+#endif
+}
+
+AnyImage2DType::Pointer RescaleSlice(const AnyImage2DType::Pointer& slice, const RescaleParameters& rescale)
+{
+    const FloatSliceType* floatSlice = dynamic_cast<const FloatSliceType*>(slice.GetPointer());
+    if (floatSlice == 0)
+        return slice;
+
+    StoredSliceType::Pointer stored = StoredSliceType::New();
+    stored->CopyInformation(floatSlice);
+    stored->SetBufferedRegion(floatSlice->GetBufferedRegion());
+    stored->SetRequestedRegion(floatSlice->GetBufferedRegion());
+    stored->Allocate();
+
+    QuantizeFloats(floatSlice->GetBufferPointer(), floatSlice->GetBufferedRegion().GetNumberOfPixels(),
+                   rescale, stored->GetBufferPointer());
+
+    return stored.GetPointer();
+}
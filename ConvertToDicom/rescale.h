@@ -0,0 +1,100 @@
+//
+//  rescale.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RESCALE_H
+#define RESCALE_H
+
+#include "itktypedefs.h"
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief RescalePixelType
+ * The pixel type floating point images are quantized to. The stored values map back to the
+ * original ones through the Rescale Slope and Rescale Intercept.
+ */
+typedef unsigned short RescalePixelType;
+
+/**
+ * The linear map from stored pixel values to real ones: real = stored * slope + intercept.
+ * The strings are what is written to Rescale Slope (0028|1053) and Rescale Intercept
+ * (0028|1052) and the numbers are read back from them, so the pixels are quantized with
+ * exactly the values a DICOM reader will use.
+ */
+struct RescaleParameters
+{
+    RescaleParameters();
+
+    double slope;
+    double intercept;
+    std::string slopeString;
+    std::string interceptString;
+};
+
+/**
+ * Widen a range to include the finite values of an array of floats. NaN and infinite
+ * values are ignored. AVX2 or NEON is used where the processor has it.
+ * @param pixels The values.
+ * @param count The number of values.
+ * @param minValue The lower end of the range. Start with +infinity.
+ * @param maxValue The upper end of the range. Start with -infinity.
+ */
+void FloatRange(const float* pixels, std::size_t count, float& minValue, float& maxValue);
+
+/**
+ * Widen a range to include the pixels of a floating point slice.
+ * @param slice The slice.
+ * @param minValue The lower end of the range.
+ * @param maxValue The upper end of the range.
+ * @return true if the slice has float pixels, false if it is left alone.
+ */
+bool SliceRange(const AnyImage2DType* slice, float& minValue, float& maxValue);
+
+/**
+ * Find the rescale which spreads a range of values over every RescalePixelType value.
+ * @param minValue The smallest value.
+ * @param maxValue The largest value. If the range is empty the identity is used.
+ * @return The rescale.
+ */
+RescaleParameters MakeRescale(float minValue, float maxValue);
+
+/**
+ * Quantize floats to stored values: the nearest of (value - intercept) / slope, clamped to
+ * the range of RescalePixelType. NaN becomes 0. AVX2 or NEON is used where the processor has it.
+ * @param pixels The values.
+ * @param count The number of values.
+ * @param rescale The rescale to invert.
+ * @param stored Filled with count stored values.
+ */
+void QuantizeFloats(const float* pixels, std::size_t count, const RescaleParameters& rescale,
+                    RescalePixelType* stored);
+
+/**
+ * Quantize a floating point slice.
+ * @param slice The slice.
+ * @param rescale The rescale to invert.
+ * @return A new slice of RescalePixelType with the same geometry, or the slice itself
+ * if it does not have float pixels.
+ */
+AnyImage2DType::Pointer RescaleSlice(const AnyImage2DType::Pointer& slice, const RescaleParameters& rescale);
+
+#endif // RESCALE_H
@@ -23,46 +23,100 @@
 #include "logger.h"
 #include "imagereader.h"
 #include "seriesinfo.h"
+#include "conversionjob.h"
 #include "dicomserieswriter.h"
 #include "imageinfo.h"
+#include "imageprobe.h"
+#include "imageheader.h"
+#include "headerindex.h"
+#include "parallel.h"
+#include "slicequeue.h"
+#include "conversionprogress.h"
+#include "rescale.h"
 #include "itkheaders.pch.h"
 
 #include <vector>
 #include <sstream>
+#include <algorithm>
+#include <limits>
 
 #include <QDir>
 #include <QStringList>
+#include <QMutex>
 
-SeriesConverter::SeriesConverter()
-    : seriesInfo(SeriesInfo::getInstance()),
+namespace
+{
+/**
+ * Find out whether the series is read as floating point, and so must be rescaled.
+ */
+bool HasFloatPixels(const ConversionJob& job)
+{
+    return !job.fileHeaders().isEmpty()
+            && NativeComponentType(job.fileHeaders().at(0)) == itk::ImageIOBase::FLOAT;
+}
+
+/**
+ * Make the rescale for the union of several ranges.
+ */
+RescaleParameters RescaleForRanges(const std::vector<float>& lows, const std::vector<float>& highs)
+{
+    float minValue = std::numeric_limits<float>::infinity();
+    float maxValue = -std::numeric_limits<float>::infinity();
+    for (std::size_t idx = 0; idx < lows.size(); ++idx)
+    {
+        minValue = std::min(minValue, lows[idx]);
+        maxValue = std::max(maxValue, highs[idx]);
+    }
+
+    return MakeRescale(minValue, maxValue);
+}
+}
+
+SeriesConverter::SeriesConverter(SeriesInfo* seriesInfo)
+    : seriesInfo(seriesInfo),
       logger(log4cplus::Logger::getInstance(std::string(LOGGER_NAME) + ".SeriesConverter"))
 {
 
 }
 
-ErrorCode SeriesConverter::convertFiles()
+ErrorCode SeriesConverter::convertFiles(ConversionJob& job)
 {
-    inputDir = seriesInfo->inputDir();
-    outputDir = seriesInfo->outputDir();
+    const SeriesInfo& info = job.seriesInfo();
+    ConversionProgress* progress = job.progress();
+
+    inputDir = info.inputDir();
+    outputDir = info.outputDir();
 
     /*
-     * There are three steps here.
+     * There are four steps here.
      *
      * 1) Get the names of the files in this directory.
-     * 2) Read in the files and store them in memory as a series of slices
-     * 3) Write out the images as a series of DICOM images.
+     * 2) Check that the files' headers agree with each other.
+     * 3) Read in the files and store them in memory as a series of slices
+     * 4) Write out the images as a series of DICOM images.
      *
-     * We fail if any step is not successful.
+     * We fail if any step is not successful. When streaming, steps 3 and 4 are
+     * done together by streamFiles().
      */
     ErrorCode errCode = loadFileNames();
     if (errCode != ErrorCode::SUCCESS)
         return errCode;
 
-    errCode = readFiles();
+    if (progress != 0)
+        progress->setNumberOfFiles(fileNames.length());
+
+    errCode = inputImagesConsistent(job);
     if (errCode != ErrorCode::SUCCESS)
         return errCode;
 
-    errCode = writeFiles();
+    if (info.streamSlices())
+        return streamFiles(job);
+
+    errCode = readFiles(job);
+    if (errCode != ErrorCode::SUCCESS)
+        return errCode;
+
+    errCode = writeFiles(job);
     if (errCode != ErrorCode::SUCCESS)
         return errCode;
 
@@ -95,48 +149,35 @@ ErrorCode SeriesConverter::extractImageParameters()
     LOG4CPLUS_TRACE(logger, "Enter");
 
     // Take the information we need from the first image
-    if (loadFileNames() == ErrorCode::ERROR_FILE_NOT_FOUND)
+    ImageInfo info;
+    ErrorCode errCode = ImageProbe::getInstance()->imageInfo(inputDir.absolutePath(), info);
+    if (errCode == ErrorCode::ERROR_FILE_NOT_FOUND)
     {
-        LOG4CPLUS_ERROR(logger, "Could not find files in " << seriesInfo->inputDir().path().toStdString());
+        LOG4CPLUS_ERROR(logger, "Could not find files in " << inputDir.path().toStdString());
         return ErrorCode::ERROR_FILE_NOT_FOUND;
     }
-
-    std::string firstFileName(fileNames[0].toStdString());
-    itk::ImageIOBase::Pointer imageIO =
-        itk::ImageIOFactory::CreateImageIO(firstFileName.c_str(), itk::ImageIOFactory::ReadMode);
-
-    // If there is a problem, catch it
-    if (imageIO.IsNull())
+    else if (errCode != ErrorCode::SUCCESS)
     {
-        LOG4CPLUS_ERROR(logger, "Could not get metadata from file: " << firstFileName);
+        LOG4CPLUS_ERROR(logger, "Could not get metadata from first file in " << inputDir.path().toStdString());
         return ErrorCode::ERROR_READING_FILE;
-    };
-
-    imageIO->SetFileName(firstFileName);
-    imageIO->ReadImageInformation();
-
-    std::string nameOfClass = imageIO->GetNameOfClass();
-    LOG4CPLUS_DEBUG(logger, "ImageIO class name = " << imageIO->GetNameOfClass());
-
-    //    if (std::string(imageIO->GetNameOfClass()) == std::string("GDCMImageIO"))
-    //    {
+    }
 
-    //        itk::GDCMImageIO::Pointer& p = reinterpret_cast<itk::GDCMImageIO::Pointer&>(imageIO);
-    //        itk::MetaDataDictionary seriesDict = p->GetMetaDataDictionary();
+    return extractImageParameters(info);
+}
 
-    //    }
+ErrorCode SeriesConverter::extractImageParameters(const ImageInfo& info)
+{
+    LOG4CPLUS_DEBUG(logger, "Image type = " << info.imageTypeName());
 
     // Get the number of dimensions.
-    unsigned numDims = imageIO->GetNumberOfDimensions();
+    unsigned numDims = info.numDims();
     LOG4CPLUS_DEBUG(logger, "dimensions = " << numDims);
 
-    int numFiles = fileNames.length();
-
     if (numDims == 3)
     {
-        seriesInfo->setImageSlicesPerImage(int(imageIO->GetDimensions(2)));
-        seriesInfo->setImageSliceSpacing(int(imageIO->GetSpacing(2)));
-        seriesInfo->setSeriesNumberOfSlices(numFiles * seriesInfo->imageSlicesPerImage());
+        seriesInfo->setImageSlicesPerImage(info.slicesPerImage());
+        seriesInfo->setImageSliceSpacing(info.spacing(2));
+        seriesInfo->setSeriesNumberOfSlices(info.numberOfSlices());
     }
     else
     {
@@ -145,34 +186,26 @@ ErrorCode SeriesConverter::extractImageParameters()
         // If we have a value use it, otherwise set to 1.0 mm
         if (seriesInfo->imageSliceSpacing() == 0.0)
             seriesInfo->setImageSliceSpacing(1.0);
-        seriesInfo->setSeriesNumberOfSlices(numFiles);
+        seriesInfo->setSeriesNumberOfSlices(info.numberOfSlices());
     }
 
-    seriesInfo->setImageNumberOfImages(numFiles / seriesInfo->imageSlicesPerImage());
+    seriesInfo->setImageNumberOfImages(info.numberOfImages());
 
     LOG4CPLUS_DEBUG(logger, "slicesPerImage = " << seriesInfo->imageSlicesPerImage());
     LOG4CPLUS_DEBUG(logger, "imageSliceSpacing = " << seriesInfo->imageSliceSpacing());
     LOG4CPLUS_DEBUG(logger, "numberOfImages = " << seriesInfo->imageNumberOfImages());
 
-    // use for creating strings below.
-    std::ostringstream value;
-
     // Set the Image Orientation Patient attribute from the image direction info.
-    std::vector<double> dir = imageIO->GetDirection(0);
-    value << dir[0] << "\\" << dir[1] << "\\" << dir[2] << "\\";
-    dir = imageIO->GetDirection(1);
-    value << dir[0] << "\\" << dir[1] << "\\" << dir[2];
-    std::string imageOrientationPatient = value.str();
-    seriesInfo->setImagePatientOrientation(imageOrientationPatient.c_str());
+    seriesInfo->setImagePatientOrientation(QString::fromStdString(info.imageOrientationPatient()));
 
     LOG4CPLUS_DEBUG(logger, "imagePatientOrientation = "
                     << seriesInfo->imagePatientOrientation().toStdString());
 
     // Image Position Patient
-    seriesInfo->setImagePositionPatientX(imageIO->GetOrigin(0));
-    seriesInfo->setImagePositionPatientY(imageIO->GetOrigin(1));
+    seriesInfo->setImagePositionPatientX(info.origin(0));
+    seriesInfo->setImagePositionPatientY(info.origin(1));
     if (numDims == 3)
-        seriesInfo->setImagePositionPatientZ(imageIO->GetOrigin(2));
+        seriesInfo->setImagePositionPatientZ(info.origin(2));
     else
         seriesInfo->setImagePositionPatientZ(0.0);
 
@@ -182,84 +215,11 @@ ErrorCode SeriesConverter::extractImageParameters()
     return ErrorCode::SUCCESS;
 }
 
-ErrorCode SeriesConverter::getImageInfo(ImageInfo& info)
+ErrorCode SeriesConverter::getImageInfo(const QString& inputDirPath, ImageInfo& info)
 {
     LOG4CPLUS_TRACE(logger, "Enter");
 
-    info.init();
-    std::string inDir = seriesInfo->inputDir().path().toStdString();
-
-    // Take the information we need from the first image
-    //if (loadFileNames() == ErrorCode::ERROR_FILE_NOT_FOUND)
-    {
-        LOG4CPLUS_ERROR(logger, "Could not find files in " << intDir().path().toStdString());
-        return ErrorCode::ERROR;
-    }
-
-    std::string firstFileName(fileNames[0].toStdString());
-    itk::ImageIOBase::Pointer imageIO =
-        itk::ImageIOFactory::CreateImageIO(firstFileName.c_str(), itk::ImageIOFactory::ReadMode);
-
-    // If there is a problem, catch it
-    if (imageIO.IsNull())
-    {
-        LOG4CPLUS_ERROR(logger, "Could not get metadata from file: " << firstFileName);
-        return ErrorCode::ERROR;
-    };
-
-    imageIO->SetFileName(firstFileName);
-    imageIO->ReadImageInformation();
-
-    std::string nameOfClass = imageIO->GetNameOfClass();
-    info.setImageTypeName(nameOfClass);
-    LOG4CPLUS_DEBUG(logger, "ImageIO class name = " << imageIO->GetNameOfClass());
-
-    //    if (std::string(imageIO->GetNameOfClass()) == std::string("GDCMImageIO"))
-    //    {
-
-    //        itk::GDCMImageIO::Pointer& p = reinterpret_cast<itk::GDCMImageIO::Pointer&>(imageIO);
-    //        itk::MetaDataDictionary seriesDict = p->GetMetaDataDictionary();
-
-    //    }
-
-    // Get the number of dimensions.
-    unsigned numDims = imageIO->GetNumberOfDimensions();
-    info.setNumDims(numDims);
-    LOG4CPLUS_DEBUG(logger, "dimensions = " << numDims);
-
-    int numFiles = fileNames.length();
-
-    for (unsigned int idx = 0; idx < numDims; ++idx)
-    {
-        info.setSpacing(idx, imageIO->GetSpacing(idx));
-    }
-
-    if (numDims == 3)
-        info.setSlicesPerImage(int(imageIO->GetDimensions(2)));
-    else
-        info.setSlicesPerImage(1);
-
-    info.setNumberOfSlices(numFiles * info.slicesPerImage());
-    info.setNumberOfImages(numFiles / info.slicesPerImage());
-
-    LOG4CPLUS_DEBUG(logger, "slicesPerImage = " << info.slicesPerImage());
-    LOG4CPLUS_DEBUG(logger, "imageSliceSpacing = " << info.spacingStr());
-    LOG4CPLUS_DEBUG(logger, "numberOfImages = " << info.numberOfImages());
-
-    // use for creating strings below.
-    std::ostringstream value;
-
-    // Set the Image Orientation Patient attribute from the image direction info.
-    std::vector<double> dir = imageIO->GetDirection(0);
-    value << dir[0] << "\\" << dir[1] << "\\" << dir[2] << "\\";
-    dir = imageIO->GetDirection(1);
-    value << dir[0] << "\\" << dir[1] << "\\" << dir[2];
-    std::string imageOrientationPatient = value.str();
-    info.setImageOrientationPatient(imageOrientationPatient);
-
-    LOG4CPLUS_DEBUG(logger, "imagePatientOrientation = " << info.imageOrientationPatient());
-
-    return ErrorCode::SUCCESS;
+    return ImageProbe::getInstance()->imageInfo(inputDirPath, info);
 }
 
 bool SeriesConverter::isValidSourceDir(const QString& dirPath)
@@ -299,35 +259,36 @@ ErrorCode SeriesConverter::loadFileNames()
 {
     LOG4CPLUS_TRACE(logger, "Enter");
 
-    // If the array is not empty, empty it
-    fileNames.clear();
-
-    QStringList fNames = inputDir.entryList(QDir::Files | QDir::Readable, QDir::Name);
-
-    // we have to prepend the directory path to the file names
-    int len = fNames.length();
-    for (int idx = 0; idx < len; ++idx)
-    {
-        QString path = inputDir.absolutePath() + "/" + fNames[idx];
-        LOG4CPLUS_DEBUG(logger, fNames[idx].toStdString());
-        fileNames.append(path);
-    }
+    // The probe has usually seen this directory already, when it was chosen.
+    ImageProbe* probe = ImageProbe::getInstance();
+    ErrorCode errCode = probe->fileNames(inputDir.absolutePath(), fileNames);
 
     LOG4CPLUS_INFO(logger, "Loading " << fileNames.length() << " files from directory: "
                    << inputDir.absolutePath().toStdString());
 
     if (fileNames.isEmpty())
         return ErrorCode::ERROR_FILE_NOT_FOUND;
-    else
-        return ErrorCode::SUCCESS;
+
+    // The class of ImageIO which read the first file. The rest of the series is expected to
+    // use the same class and only falls back to the factories if it cannot.
+    imageIOPrototype = nullptr;
+    if (errCode == ErrorCode::SUCCESS)
+    {
+        imageIOPrototype = probe->imageIOPrototype(inputDir.absolutePath());
+        if (imageIOPrototype.IsNotNull())
+            LOG4CPLUS_DEBUG(logger, "Reading series with " << imageIOPrototype->GetNameOfClass());
+    }
+
+    return ErrorCode::SUCCESS;
 }
 
-void SeriesConverter::createTimesArray()
+void SeriesConverter::createTimesArray(ConversionJob& job)
 {
     LOG4CPLUS_TRACE(logger, "Enter");
 
     // Here we create an array of DICOM acquisition times as time strings
-    seriesInfo->acqTimes().clear();
+    QList<QTime>& acqTimes = job.acqTimes();
+    acqTimes.clear();
 
     // Get the starting time (NSTimeinterval is a typedef for double)
     //    NSDateFormatter* df = [[NSDateFormatter alloc]init];
@@ -336,98 +297,105 @@ void SeriesConverter::createTimesArray()
     // We create a list of incremented times. We may need fewer than the number of slices of these
     // times but we will never need more. This saves modifying the list if we change the number
     // of slices per image later.
-    QTime acqTime = seriesInfo->studyDateTime().time();
-    double timeIncr = seriesInfo->seriesTimeIncrement();
-    int numSlices = seriesInfo->imageNumberOfSlices();
+    QTime acqTime = job.seriesInfo().studyDateTime().time();
+    double timeIncr = job.seriesInfo().seriesTimeIncrement();
+    int numSlices = job.numberOfSlices();
     for (int sliceIdx = 0; sliceIdx < numSlices; ++sliceIdx)
     {
-        seriesInfo->acqTimes().append(acqTime);
+        acqTimes.append(acqTime);
         acqTime = acqTime.addMSecs(int(std::round(timeIncr * 1000.0)));
     }
 
     std::stringstream stream;
-    for (int idx = 0; idx < seriesInfo->acqTimes().length(); ++idx)
-        stream << seriesInfo->acqTimes()[idx].toString(Qt::ISODateWithMs).toStdString() << "\n";
+    for (int idx = 0; idx < acqTimes.length(); ++idx)
+        stream << acqTimes[idx].toString(Qt::ISODateWithMs).toStdString() << "\n";
     LOG4CPLUS_DEBUG(logger, "acqTimes = " << stream.str());
 }
 
-ErrorCode SeriesConverter::inputImagesConsistent()
+ErrorCode SeriesConverter::inputImagesConsistent(ConversionJob& job)
 {
-    // Get the image info from the first file
-    std::string fileName = fileNames[0].toStdString();
-    itk::ImageIOBase::Pointer imageIO =
-            itk::ImageIOFactory::CreateImageIO(fileName.c_str(), itk::ImageIOFactory::ReadMode);
-
-    // If there is a problem, catch it
-    if (imageIO.IsNull())
-    {
-        LOG4CPLUS_ERROR(logger, "Could not get metadata from file: " << fileName.c_str());
-        return ErrorCode::ERROR_READING_FILE;
-    };
+    LOG4CPLUS_TRACE(logger, "Enter");
 
+    ConversionProgress* progress = job.progress();
+    int numFiles = fileNames.length();
 
-    imageIO->SetFileName(fileName);
-    imageIO->ReadImageInformation();
+    std::vector<std::string> paths;
+    for (auto iter = fileNames.begin(); iter != fileNames.end(); ++iter)
+        paths.push_back(iter->toStdString());
 
-    unsigned numDims_1 = imageIO->GetNumberOfDimensions();
-    LOG4CPLUS_INFO(logger, "Input file number of dimensions = " << numDims_1);
+    std::vector<ImageHeader> headers(std::size_t(numFiles), ImageHeader());
 
-    unsigned long dim0_1 = imageIO->GetDimensions(0);
-    unsigned long dim1_1 = imageIO->GetDimensions(1);
-    unsigned long dim2_1 = 0;
-    if (numDims_1 == 2)
+    // Headers read before, in this run or an earlier one, are taken from the index.
+    HeaderIndex* index = HeaderIndex::getInstance();
+    QString dirPath = inputDir.absolutePath();
+    const QStringList& names = fileNames;
+    auto readHeader = [index, &names, &paths](int fileIdx, const itk::ImageIOBase* prototype, ImageHeader& header)
     {
-        LOG4CPLUS_INFO(logger, "Input file dimensions = " << dim0_1 << ", " << dim1_1);
-    }
-    else // must be 3
+        if (index->header(names.at(fileIdx), header))
+            return true;
+        if (!ReadImageHeader(paths[std::size_t(fileIdx)], prototype, header))
+            return false;
+        index->setHeader(names.at(fileIdx), header);
+        return true;
+    };
+
+    // Everything is compared with the first file.
+    const itk::ImageIOBase* prototype = imageIOPrototype.GetPointer();
+    if (!readHeader(0, prototype, headers[0]))
     {
-        dim2_1 = imageIO->GetDimensions(2);
-        LOG4CPLUS_INFO(logger, "Input file dimensions = " << dim0_1 << ", " << dim1_1 << ", " << dim2_1);
+        LOG4CPLUS_ERROR(logger, "Could not get metadata from file: " << paths[0]);
+        return ErrorCode::ERROR_READING_FILE;
     }
 
-    for (int idx = 1; idx < fileNames.length(); ++idx)
+    const ImageHeader& reference = headers[0];
+    if (reference.numDims == 2)
+        LOG4CPLUS_INFO(logger, "Input file dimensions = " << reference.dimensions[0] << ", "
+                       << reference.dimensions[1]);
+    else
+        LOG4CPLUS_INFO(logger, "Input file dimensions = " << reference.dimensions[0] << ", "
+                       << reference.dimensions[1] << ", " << reference.dimensions[2]);
+
+    // Read the rest of the headers in parallel. The indices are handed out in increasing order
+    // so once a bad file is found any later file can be skipped: every earlier file has already
+    // been started. The bad file reported is therefore always the first one in the series.
+    QAtomicInt firstBadIdx(numFiles);
+    std::vector<std::string> differences(std::size_t(numFiles));
+    ParallelFor(numFiles - 1, job.seriesInfo().numberOfThreads(),
+                [&, prototype](int idx)
     {
-        std::string fileName = fileNames[idx].toStdString();
+        int fileIdx = idx + 1;
+        if (fileIdx > firstBadIdx.loadAcquire() || IsCancelled(progress))
+            return;
 
-        imageIO->SetFileName(fileName);
-        imageIO->ReadImageInformation();
+        ImageHeader& header = headers[std::size_t(fileIdx)];
+        std::string& difference = differences[std::size_t(fileIdx)];
+        if (!readHeader(fileIdx, prototype, header))
+            difference = "could not read header";
+        else if (HeadersConsistent(reference, header, difference))
+            return;
 
-        unsigned numDims = imageIO->GetNumberOfDimensions();
-        if (numDims != numDims_1)
-        {
-            LOG4CPLUS_ERROR(logger, "File " << fileName.c_str()
-                            << ": inconsistent number of dimension: " << numDims);
-            return ErrorCode::ERROR_IMAGE_INCONSISTENT;
-        }
+        int badIdx = firstBadIdx.loadAcquire();
+        while (fileIdx < badIdx && !firstBadIdx.testAndSetOrdered(badIdx, fileIdx))
+            badIdx = firstBadIdx.loadAcquire();
+    });
 
-        unsigned long dim0 = imageIO->GetDimensions(0);
-        unsigned long dim1 = imageIO->GetDimensions(1);
-        if (dim0 != dim0_1)
-        {
-            LOG4CPLUS_ERROR(logger, "File " <<  fileName.c_str()
-                            << ": inconsistent dimension 0: %d" << dim0_1);
-            return ErrorCode::ERROR_IMAGE_INCONSISTENT;
-        }
+    index->save(dirPath);
 
-        if (dim1 != dim1_1)
-        {
-            LOG4CPLUS_ERROR(logger, "File " <<  fileName.c_str()
-                            << ": inconsistent dimension 1: %d" << dim1_1);
-            return ErrorCode::ERROR_IMAGE_INCONSISTENT;
-        }
+    if (IsCancelled(progress))
+        return ErrorCode::ERROR_CANCELLED;
 
-        if (numDims_1 == 3)
-        {
-            unsigned long dim2 = imageIO->GetDimensions(2);
-            if (dim2 != dim2_1)
-            {
-                LOG4CPLUS_ERROR(logger, "File " <<  fileName.c_str()
-                                << ": inconsistent dimension 2: %d" << dim2_1);
-                return ErrorCode::ERROR_IMAGE_INCONSISTENT;
-            }
-        }
+    int badIdx = firstBadIdx.loadAcquire();
+    if (badIdx < numFiles)
+    {
+        LOG4CPLUS_ERROR(logger, "File " << paths[std::size_t(badIdx)] << ": " << differences[std::size_t(badIdx)]);
+        if (headers[std::size_t(badIdx)].numDims == 0)
+            return ErrorCode::ERROR_READING_FILE;
+        else
+            return ErrorCode::ERROR_IMAGE_INCONSISTENT;
     }
 
+    job.setFileHeaders(QVector<ImageHeader>::fromStdVector(headers));
+
     return ErrorCode::SUCCESS;
 }
 
@@ -445,7 +413,7 @@ QString SeriesConverter::makeOutputPathName(const QString& dirName)
     return path;
 }
 
-ErrorCode SeriesConverter::readFiles()
+ErrorCode SeriesConverter::readFiles(ConversionJob& job)
 {
     LOG4CPLUS_TRACE(logger, "Enter");
 
@@ -458,80 +426,356 @@ ErrorCode SeriesConverter::readFiles()
         paths.push_back(filePath.toStdString());
     }
 
-    // Read in all of the slices
-    imageStack.clear();
-    ImageReader reader;
+    // Read the files in parallel. Each file's slices are kept at the file's index so that
+    // the order of the stack does not depend on which thread finishes first.
     int numberOfImages = fileNames.length();
+    std::vector<ImageReader::ImageVector> fileSlices(paths.size());
+    ConversionProgress* progress = job.progress();
+    bool sliceViews = job.seriesInfo().sliceViews();
+    const itk::ImageIOBase* prototype = imageIOPrototype.GetPointer();
+    ParallelFor(numberOfImages, job.seriesInfo().numberOfThreads(),
+                [progress, sliceViews, prototype, &paths, &fileSlices](int fileIdx)
+    {
+        if (IsCancelled(progress))
+            return;
+
+        ImageReader reader;
+        reader.SetProgress(progress);
+        reader.SetUseSliceViews(sliceViews);
+        reader.SetImageIOPrototype(prototype);
+        fileSlices[std::size_t(fileIdx)] = reader.ReadImage(paths[std::size_t(fileIdx)]);
+
+        if (progress != 0)
+            progress->fileRead();
+    });
+
+    if (IsCancelled(progress))
+    {
+        LOG4CPLUS_INFO(logger, "Reading cancelled.");
+        return ErrorCode::ERROR_CANCELLED;
+    }
+
+    // Now put all of the slices into the stack in file order.
+    imageStack.clear();
     int slicesPerImage = 0;
     int numberOfSlices = 0;
-    for (auto iter = paths.begin(); iter != paths.end(); ++iter)
+    for (std::size_t fileIdx = 0; fileIdx < fileSlices.size(); ++fileIdx)
     {
+        const ImageReader::ImageVector& imageVec = fileSlices[fileIdx];
+        if (imageVec.empty())
+        {
+            LOG4CPLUS_ERROR(logger, "No slices read from file: " << paths[fileIdx]);
+            imageStack.clear();
+            return ErrorCode::ERROR_READING_FILE;
+        }
+
         slicesPerImage = 0;
-        ImageReader::ImageVector imageVec = reader.ReadImage(*iter);
         for (ImageReader::ImageVector::const_iterator iter = imageVec.begin(); iter != imageVec.end(); ++iter)
         {
-            Image2DType::Pointer image = *iter;
             imageStack.push_back(*iter);
             ++slicesPerImage;
             ++numberOfSlices;
         }
     }
 
-    // Fix up some series information that may not be set yet. If it hasn't been set
-    // we use some defaults.
-    if (seriesInfo->imageNumberOfImages() == 0)
+    fixUpImageCounts(job, numberOfImages, slicesPerImage, numberOfSlices);
+
+    LOG4CPLUS_DEBUG(logger, "Read " << imageStack.size() << " slices into image stack.");
+
+    if (HasFloatPixels(job))
+        return rescaleImageStack(job);
+
+    return ErrorCode::SUCCESS;
+}
+
+ErrorCode SeriesConverter::rescaleImageStack(ConversionJob& job)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    ConversionProgress* progress = job.progress();
+    int numThreads = job.seriesInfo().numberOfThreads();
+    int numSlices = imageStack.size();
+
+    // Taking the data pointer here detaches the stack once, before the threads use it.
+    AnyImage2DType::Pointer* slices = imageStack.data();
+
+    // Each slice's range is kept at its index and they are combined afterwards.
+    std::vector<float> lows(std::size_t(numSlices), std::numeric_limits<float>::infinity());
+    std::vector<float> highs(std::size_t(numSlices), -std::numeric_limits<float>::infinity());
+    ParallelFor(numSlices, numThreads, [slices, &lows, &highs](int sliceIdx)
     {
-        seriesInfo->setImageNumberOfImages(numberOfImages);
-        seriesInfo->setImageSlicesPerImage(slicesPerImage);
-        seriesInfo->setSeriesNumberOfSlices(numberOfSlices);
+        SliceRange(slices[sliceIdx].GetPointer(), lows[std::size_t(sliceIdx)], highs[std::size_t(sliceIdx)]);
+    });
+
+    job.setRescale(RescaleForRanges(lows, highs));
+    const RescaleParameters& rescale = job.rescale();
+
+    LOG4CPLUS_INFO(logger, "Rescaling " << numSlices << " slices with slope " << rescale.slopeString
+                   << " and intercept " << rescale.interceptString);
+
+    ParallelFor(numSlices, numThreads, [progress, slices, &rescale](int sliceIdx)
+    {
+        if (IsCancelled(progress))
+            return;
+
+        slices[sliceIdx] = RescaleSlice(slices[sliceIdx], rescale);
+    });
+
+    if (IsCancelled(progress))
+    {
+        LOG4CPLUS_INFO(logger, "Rescaling cancelled.");
+        return ErrorCode::ERROR_CANCELLED;
     }
 
-    if (seriesInfo->imageSliceSpacing() == 0.0)
-        seriesInfo->setImageSliceSpacing(1.0);
+    return ErrorCode::SUCCESS;
+}
 
-    //    if (seriesInfo->imagePatientPositionX == nil)
-    //    {
-    //        seriesInfo->imagePatientPositionX = [NSNumber numberWithDouble:0.0];
-    //        seriesInfo->imagePatientPositionY = [NSNumber numberWithDouble:0.0];
-    //        seriesInfo->imagePatientPositionZ = [NSNumber numberWithDouble:0.0];
-    //    }
+ErrorCode SeriesConverter::findSeriesRescale(ConversionJob& job, const std::vector<std::string>& paths)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
 
-    if (seriesInfo->imagePatientOrientation() == "")
-        seriesInfo->setImagePatientOrientation("1\\0\\0\\0\\1\\0");
+    ConversionProgress* progress = job.progress();
+    const itk::ImageIOBase* prototype = imageIOPrototype.GetPointer();
+    int numberOfImages = int(paths.size());
 
-    LOG4CPLUS_DEBUG(logger, "Read" << imageStack.size() << " slices into image stack.");
+    std::vector<float> lows(paths.size(), std::numeric_limits<float>::infinity());
+    std::vector<float> highs(paths.size(), -std::numeric_limits<float>::infinity());
+    std::vector<char> fileRead(paths.size(), 0);
+    ParallelFor(numberOfImages, job.seriesInfo().numberOfThreads(),
+                [progress, prototype, &paths, &lows, &highs, &fileRead](int fileIdx)
+    {
+        if (IsCancelled(progress))
+            return;
+
+        // Slice views save copying pixels which are only looked at.
+        ImageReader reader;
+        reader.SetProgress(progress);
+        reader.SetUseSliceViews(true);
+        reader.SetImageIOPrototype(prototype);
+        ImageReader::ImageVector slices = reader.ReadImage(paths[std::size_t(fileIdx)]);
+        for (std::size_t idx = 0; idx < slices.size(); ++idx)
+            SliceRange(slices[idx].GetPointer(), lows[std::size_t(fileIdx)], highs[std::size_t(fileIdx)]);
+
+        fileRead[std::size_t(fileIdx)] = !slices.empty();
+    });
+
+    if (IsCancelled(progress))
+    {
+        LOG4CPLUS_INFO(logger, "Reading cancelled.");
+        return ErrorCode::ERROR_CANCELLED;
+    }
 
-    if (int(imageStack.size()) != fileNames.length())
-        return ErrorCode::ERROR_READING_FILE;
-    else
-        return ErrorCode::SUCCESS;
+    for (std::size_t fileIdx = 0; fileIdx < fileRead.size(); ++fileIdx)
+    {
+        if (!fileRead[fileIdx])
+        {
+            LOG4CPLUS_ERROR(logger, "No slices read from file: " << paths[fileIdx]);
+            return ErrorCode::ERROR_READING_FILE;
+        }
+    }
+
+    job.setRescale(RescaleForRanges(lows, highs));
+
+    LOG4CPLUS_INFO(logger, "Rescaling series with slope " << job.rescale().slopeString
+                   << " and intercept " << job.rescale().interceptString);
+
+    return ErrorCode::SUCCESS;
 }
 
-ErrorCode SeriesConverter::writeFiles()
+void SeriesConverter::fixUpImageCounts(ConversionJob& job, int numberOfImages, int slicesPerImage,
+                                       int numberOfSlices)
+{
+    // Use what was found in the files if the counts were not set beforehand. The
+    // ConversionJob has already filled in the slice spacing and orientation if need be.
+    if (job.numberOfImages() == 0)
+        job.setImageCounts(numberOfImages, slicesPerImage, numberOfSlices);
+}
+
+ErrorCode SeriesConverter::prepareOutputDir(ConversionJob& job)
 {
     LOG4CPLUS_TRACE(logger, "Enter");
 
-    createTimesArray();
+    const SeriesInfo& info = job.seriesInfo();
+
+    createTimesArray(job);
 
     // Create the directory
-    bool err = seriesInfo->outputDir().mkpath(seriesInfo->outputPath());
+    bool err = info.outputDir().mkpath(info.outputPath());
     if (err == false)
         return ErrorCode::ERROR_CREATING_DIRECTORY;
 
-    QDir outputPath = QDir(seriesInfo->outputPath());
+    QDir outputPath = QDir(info.outputPath());
     outputPath.setFilter(QDir::Files);
     if (outputPath.entryList().count() != 0)
     {
-        if (seriesInfo->overwriteFiles() == false)
+        if (info.overwriteFiles() == false)
             return ErrorCode::ERROR_DIRECTORY_NOT_EMPTY;
     }
 
+    return ErrorCode::SUCCESS;
+}
+
+ErrorCode SeriesConverter::writeFiles(ConversionJob& job)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    ErrorCode errCode = prepareOutputDir(job);
+    if (errCode != ErrorCode::SUCCESS)
+        return errCode;
+
     // Now write them out
-    DicomSeriesWriter writer(imageStack, seriesInfo->outputPath());
-    return writer.WriteFileSeries();
+    DicomSeriesWriter writer(job, imageStack, job.seriesInfo().outputPath());
+    errCode = writer.WriteFileSeries();
+
+    if (errCode == ErrorCode::ERROR_CANCELLED)
+        LOG4CPLUS_INFO(logger, "Writing cancelled.");
+
+    return errCode;
 }
 
+ErrorCode SeriesConverter::streamFiles(ConversionJob& job)
+{
+    LOG4CPLUS_TRACE(logger, "Enter");
+
+    const SeriesInfo& info = job.seriesInfo();
+    ConversionProgress* progress = job.progress();
 
+    // The number of slices must be known before anything is written. The headers have
+    // already been checked so every file has as many slices as the first.
+    int numberOfImages = fileNames.length();
+    int slicesPerImage = job.fileHeaders().at(0).slicesPerImage();
+    int numberOfSlices = numberOfImages * slicesPerImage;
 
+    fixUpImageCounts(job, numberOfImages, slicesPerImage, numberOfSlices);
 
+    std::vector<std::string> paths;
+    for (auto iter = fileNames.begin(); iter != fileNames.end(); ++iter)
+        paths.push_back(iter->toStdString());
+
+    // The rescale must be known before the first slice is written.
+    bool rescaled = HasFloatPixels(job);
+    if (rescaled)
+    {
+        ErrorCode errCode = findSeriesRescale(job, paths);
+        if (errCode != ErrorCode::SUCCESS)
+            return errCode;
+    }
 
+    ErrorCode errCode = prepareOutputDir(job);
+    if (errCode != ErrorCode::SUCCESS)
+        return errCode;
+
+    DicomSeriesWriter writer(job, info.outputPath());
+    errCode = writer.PrepareSeries(numberOfSlices);
+    if (errCode != ErrorCode::SUCCESS)
+        return errCode;
+
+    // Split the threads between the readers and the writers. There is always at least one of each.
+    int numThreads = EffectiveThreadCount(info.numberOfThreads());
+    int numReaders = std::max(1, std::min(numThreads / 2, numberOfImages));
+    int numWriters = std::max(1, numThreads - numReaders);
+
+    LOG4CPLUS_INFO(logger, "Streaming " << numberOfSlices << " slices with " << numReaders
+                   << " readers, " << numWriters << " writers and at most "
+                   << info.maxSlicesInFlight() << " slices queued.");
+
+    SliceQueue queue(info.maxSlicesInFlight());
+    QAtomicInt nextFileIdx(0);
+
+    // The first error stops everything.
+    QMutex errorMutex;
+    ErrorCode firstError = ErrorCode::SUCCESS;
+    auto fail = [&](ErrorCode code)
+    {
+        QMutexLocker locker(&errorMutex);
+        if (firstError == ErrorCode::SUCCESS)
+            firstError = code;
+        queue.abort();
+    };
+
+    auto readFile = [&]()
+    {
+        ImageReader reader;
+        reader.SetProgress(progress);
+        reader.SetUseSliceViews(info.sliceViews());
+        reader.SetImageIOPrototype(imageIOPrototype);
+        int fileIdx;
+        while ((fileIdx = nextFileIdx.fetchAndAddOrdered(1)) < numberOfImages)
+        {
+            if (IsCancelled(progress))
+            {
+                fail(ErrorCode::ERROR_CANCELLED);
+                return;
+            }
+
+            ImageReader::ImageVector slices = reader.ReadImage(paths[std::size_t(fileIdx)]);
+            if (IsCancelled(progress))
+            {
+                fail(ErrorCode::ERROR_CANCELLED);
+                return;
+            }
+
+            if (int(slices.size()) != slicesPerImage)
+            {
+                LOG4CPLUS_ERROR(logger, "File " << paths[std::size_t(fileIdx)] << " has " << slices.size()
+                                << " slices, expected " << slicesPerImage);
+                fail(slices.empty() ? ErrorCode::ERROR_READING_FILE : ErrorCode::ERROR_IMAGE_INCONSISTENT);
+                return;
+            }
+
+            for (int idx = 0; idx < slicesPerImage; ++idx)
+            {
+                // Hand the slice over so that only the queue holds it.
+                AnyImage2DType::Pointer slice = slices[std::size_t(idx)];
+                slices[std::size_t(idx)] = nullptr;
+                if (rescaled)
+                    slice = RescaleSlice(slice, job.rescale());
+                if (!queue.push(fileIdx * slicesPerImage + idx, slice))
+                    return;
+            }
+
+            if (progress != 0)
+                progress->fileRead();
+        }
+    };
+
+    auto writeSlices = [&]()
+    {
+        int sliceIdx;
+        AnyImage2DType::Pointer slice;
+        while (queue.pop(sliceIdx, slice))
+        {
+            ErrorCode code = writer.WriteSlice(sliceIdx, slice);
+            slice = nullptr;
+            if (code != ErrorCode::SUCCESS)
+            {
+                fail(code);
+                return;
+            }
+        }
+    };
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(numReaders + numWriters);
+
+    QVector<QFuture<void> > readers;
+    QVector<QFuture<void> > writers;
+    for (int idx = 0; idx < numReaders; ++idx)
+        readers.append(QtConcurrent::run(&pool, readFile));
+    for (int idx = 0; idx < numWriters; ++idx)
+        writers.append(QtConcurrent::run(&pool, writeSlices));
+
+    // When all of the readers are done the writers can finish off what is in the queue.
+    for (int idx = 0; idx < readers.size(); ++idx)
+        readers[idx].waitForFinished();
+    queue.close();
+    for (int idx = 0; idx < writers.size(); ++idx)
+        writers[idx].waitForFinished();
+
+    if (firstError == ErrorCode::SUCCESS)
+        firstError = writer.FinishSeries();
+    else
+        writer.AbandonSeries();
+
+    return firstError;
+}
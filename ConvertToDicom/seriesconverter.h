@@ -29,15 +29,21 @@
 #include <QDir>
 #include <QVector>
 
+#include <string>
+#include <vector>
+
 class SeriesInfo;
 class ImageInfo;
+class ConversionJob;
 
 /**
  * @brief The SeriesConverter class
  *
  * Class to do the conversion of one series.
  * It reads the image files, converts them to DICOM
- * and writes them out as DICOM files.
+ * and writes them out as DICOM files. The SeriesInfo given to the constructor is filled in
+ * by extractImageParameters() and makeFullOutputPathDir(); the conversion itself uses only
+ * the ConversionJob passed to convertFiles().
  */
 class SeriesConverter
 {
@@ -45,15 +51,21 @@ public:
     /**
      * @brief SeriesConverter
      * Constructor.
+     * @param seriesInfo The settings which extractImageParameters() and makeFullOutputPathDir()
+     * fill in. Not owned by this class.
      */
-    SeriesConverter();
+    explicit SeriesConverter(SeriesInfo* seriesInfo);
 
     /**
      * Read the input files and write the DICOM files to the output directory. A directory tree is
      * formed like this: patientsName/studyDescription - studyID/seriesDescription - seriesNumber.
-     * @return Suitable code in ErrorCode enum.
+     * This may be run in a worker thread. If the job has a ConversionProgress it is updated
+     * as the work proceeds and the conversion stops within a slice of it being cancelled.
+     * The caller should reset the progress before each conversion.
+     * @param job The settings and state of this conversion.
+     * @return Suitable code in ErrorCode enum. ERROR_CANCELLED if the conversion was cancelled.
      */
-    ErrorCode convertFiles();
+    ErrorCode convertFiles(ConversionJob& job);
 
     /**
      * Make the full output directory path. This is the directory into which the DICOM series will be placed.
@@ -76,11 +88,19 @@ public:
     /**
      * Tries to get as many metadata from the input image files as possible. If the image is a DICOM
      * series the metadata dictionary will be queried. Otherwise the data will likely be limited to
-     * dimensions and slice spacing. This must be called after readFiles().
+     * dimensions and slice spacing. The header is read through the ImageProbe so it is only read
+     * again if the directory has changed.
      * @return Suitable code in ErrorCode enum.
      */
     ErrorCode extractImageParameters();
 
+    /**
+     * Fill in the settings from information already read from the first image.
+     * @param info The information.
+     * @return Suitable code in ErrorCode enum.
+     */
+    ErrorCode extractImageParameters(const ImageInfo& info);
+
     /**
      * Extract the information in an image or series. This is intended to be a read only operation
      * intended to support the preview widget in the GUI.
@@ -101,21 +121,27 @@ private:
     /**
       * @brief loadFileNames
       * Load all of the names within the input directory. Assumes that these are all suitable
-      * image files.
+      * image files. The ImageIO class for the series is found from the first file.
       * @return Suitable code in ErrorCode enum.
       */
     ErrorCode loadFileNames();
 
     /**
      * Create and store the acquisition times of the output files.
+     * @param job The job to store them in.
      */
-    void createTimesArray();
+    void createTimesArray(ConversionJob& job);
 
     /**
-     * Checks the consistency of the dimensionality of each image and number of slices.
-     * @return SUCCESS if all is well.
+     * Checks that every input file can be stacked with the first: the same dimensions, spacing,
+     * direction and pixel type, and an origin offset only along the slice normal. The headers
+     * are read by SeriesInfo::numberOfThreads() worker threads and kept in the job.
+     * Must be called after loadFileNames().
+     * @param job The job being converted.
+     * @return SUCCESS if all is well, otherwise ERROR_READING_FILE or ERROR_IMAGE_INCONSISTENT
+     * for the first bad file in the series, or ERROR_CANCELLED.
      */
-    ErrorCode inputImagesConsistent();
+    ErrorCode inputImagesConsistent(ConversionJob& job);
 
     /**
      * Make the full path directory name.
@@ -127,24 +153,76 @@ private:
 
     /**
      * Read in all of the image files in the input directory. Must be called after loadFileNames().
+     * The files are read by SeriesInfo::numberOfThreads() worker threads but the slices are
+     * placed into imageStack in the order of fileNames.
+     * @param job The job being converted.
      * @return Suitable code in ErrorCode enum.
      */
-    ErrorCode readFiles();
+    ErrorCode readFiles(ConversionJob& job);
+
+    /**
+     * Rescale the floating point slices in imageStack to 16 bits. The rescale spreads the
+     * range of the whole series over the stored values and is kept in the job so that it is
+     * written with the images.
+     * @param job The job being converted.
+     * @return Suitable code in ErrorCode enum.
+     */
+    ErrorCode rescaleImageStack(ConversionJob& job);
+
+    /**
+     * Find the rescale of a floating point series by reading every file once to get the
+     * range of the pixels, and keep it in the job. Used when streaming, as the slices are
+     * written before the whole series has been read.
+     * @param job The job being converted.
+     * @param paths The names of the files.
+     * @return Suitable code in ErrorCode enum.
+     */
+    ErrorCode findSeriesRescale(ConversionJob& job, const std::vector<std::string>& paths);
+
+    /**
+     * Fill in the image counts in the job if they have not already been set.
+     * @param job The job being converted.
+     * @param numberOfImages The number of image files.
+     * @param slicesPerImage The number of slices in each image file.
+     * @param numberOfSlices The total number of slices.
+     */
+    void fixUpImageCounts(ConversionJob& job, int numberOfImages, int slicesPerImage, int numberOfSlices);
+
+    /**
+     * Create the output directory and check that we may write into it. This also creates the
+     * acquisition times.
+     * @param job The job being converted.
+     * @return Suitable code in ErrorCode enum.
+     */
+    ErrorCode prepareOutputDir(ConversionJob& job);
 
     /**
      * Write the DICOM files to the output directory. A directory tree is formed like this:
      * patientsName/studyDescription - studyID/seriesDescription - seriesNumber.
+     * @param job The job being converted.
      * return Suitable code in ErrorCode enum.
      */
-    ErrorCode writeFiles();
+    ErrorCode writeFiles(ConversionJob& job);
+
+    /**
+     * Read and write the series at the same time. Reader threads put slices into a bounded
+     * queue and writer threads write and release them, so no more than
+     * SeriesInfo::maxSlicesInFlight() slices wait in memory (plus those being read or written).
+     * Used instead of readFiles() and writeFiles() when SeriesInfo::streamSlices() is true.
+     * Must be called after loadFileNames().
+     * @param job The job being converted.
+     * @return Suitable code in ErrorCode enum.
+     */
+    ErrorCode streamFiles(ConversionJob& job);
 
     QStringList fileNames;     ///< The list of input file names.
+    itk::ImageIOBase::ConstPointer imageIOPrototype; ///< ImageIO which read the first file. May be null.
 
     QDir inputDir;            ///< Where the input files are found.
     QDir outputDir;           ///< Where to put the output file tree.
-    SeriesInfo* seriesInfo;   ///< Information about the series.
+    SeriesInfo* seriesInfo;   ///< Settings filled in before a conversion. Not owned.
 
-    QVector<Image2DType::Pointer> imageStack;
+    QVector<AnyImage2DType::Pointer> imageStack;
 
     Logger logger;           ///< Logger for this class.
 };
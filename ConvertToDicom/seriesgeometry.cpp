@@ -0,0 +1,165 @@
+//
+//  seriesgeometry.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "seriesgeometry.h"
+#include "seriesinfo.h"
+#include "logger.h"
+
+#include <QStringList>
+
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+/**
+ * Append a number in fixed point with one or two decimals, exactly as "%.1f" or "%.2f"
+ * would give it in the C locale, without the cost of printf.
+ */
+void AppendFixed(std::string& str, double value, int decimals)
+{
+    const double scale = (decimals == 1) ? 10.0 : 100.0;
+
+    // Positions are in millimetres so this only guards against nonsense.
+    double scaled = std::fabs(value) * scale;
+    if (!(scaled < 1e15))
+    {
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+        str += buffer;
+        return;
+    }
+
+    // Round as printf does, from the exact value: the error of the multiplication decides
+    // the apparent ties and true ties go to even.
+    double error = std::fma(std::fabs(value), scale, -scaled);
+    double whole = std::floor(scaled);
+    double fraction = scaled - whole;
+    if (fraction > 0.5 || (fraction == 0.5 && (error > 0.0 || (error == 0.0 && std::fmod(whole, 2.0) != 0.0))))
+        whole += 1.0;
+    long long rounded = static_cast<long long>(whole);
+
+    if (std::signbit(value))
+        str += '-';
+
+    char digits[24];
+    int numDigits = 0;
+    long long integerPart = rounded / static_cast<long long>(scale);
+    do
+    {
+        digits[numDigits++] = char('0' + integerPart % 10);
+        integerPart /= 10;
+    } while (integerPart != 0);
+
+    while (numDigits > 0)
+        str += digits[--numDigits];
+
+    str += '.';
+    long long decimalPart = rounded % static_cast<long long>(scale);
+    if (decimals == 2)
+        str += char('0' + decimalPart / 10);
+    str += char('0' + decimalPart % 10);
+}
+}
+
+SeriesGeometry::SeriesGeometry(const SeriesInfo& seriesInfo)
+    : spacing(seriesInfo.imageSliceSpacing())
+{
+    // The first two rows of the rotation matrix are the row and column directions. Anything
+    // after the sixth value, such as a trailing backslash, is ignored.
+    double rot[3][3] = { { 1.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, { 0.0, 0.0, 1.0 } };
+    double directions[6];
+    QStringList values = seriesInfo.imagePatientOrientation().split('\\');
+    bool isValid = (values.size() >= 6);
+    for (int idx = 0; isValid && (idx < 6); ++idx)
+        directions[idx] = values[idx].trimmed().toDouble(&isValid);
+
+    if (isValid)
+    {
+        for (int idx = 0; idx < 6; ++idx)
+            rot[idx / 3][idx % 3] = directions[idx];
+    }
+    else
+    {
+        Logger logger = Logger::getInstance(std::string(LOGGER_NAME) + ".SeriesGeometry");
+        LOG4CPLUS_WARN(logger, "Image Orientation (Patient) \"" << seriesInfo.imagePatientOrientation().toStdString()
+                       << "\" does not start with six numbers. The slices are placed as if it were 1\\0\\0\\0\\1\\0.");
+    }
+
+    // The third row is the normal to the slices.
+    rot[2][0] = rot[0][1] * rot[1][2] - rot[0][2] * rot[1][1];
+    rot[2][1] = rot[0][2] * rot[1][0] - rot[0][0] * rot[1][2];
+    rot[2][2] = rot[0][0] * rot[1][1] - rot[0][1] * rot[1][0];
+
+    // The position is rotated into image coordinates, moved along z and rotated back with
+    // the transpose. That is the same as applying rot' * rot to the position and adding
+    // the spacing times the normal, which is done here once.
+    double ipp[3] = { seriesInfo.imagePositionPatientX(), seriesInfo.imagePositionPatientY(),
+                      seriesInfo.imagePositionPatientZ() };
+    double rotated[3];
+    for (int row = 0; row < 3; ++row)
+        rotated[row] = rot[row][0] * ipp[0] + rot[row][1] * ipp[1] + rot[row][2] * ipp[2];
+    for (int col = 0; col < 3; ++col)
+    {
+        origin[col] = rot[0][col] * rotated[0] + rot[1][col] * rotated[1] + rot[2][col] * rotated[2];
+        step[col] = rot[2][col] * spacing;
+    }
+}
+
+void SeriesGeometry::position(int sliceIdx, double position[3]) const
+{
+    for (int axis = 0; axis < 3; ++axis)
+        position[axis] = origin[axis] + step[axis] * sliceIdx;
+}
+
+std::string SeriesGeometry::positionString(int sliceIdx) const
+{
+    double pos[3];
+    position(sliceIdx, pos);
+
+    std::string str;
+    str.reserve(32);
+    AppendFixed(str, pos[0], 2);
+    str += '\\';
+    AppendFixed(str, pos[1], 2);
+    str += '\\';
+    AppendFixed(str, pos[2], 2);
+    return str;
+}
+
+std::string SeriesGeometry::locationString(int sliceIdx) const
+{
+    std::string str;
+    AppendFixed(str, spacing * sliceIdx, 1);
+    return str;
+}
+
+void SeriesGeometry::sliceStrings(int numSlices, std::vector<std::string>& positions,
+                                  std::vector<std::string>& locations) const
+{
+    positions.resize(std::size_t(numSlices));
+    locations.resize(std::size_t(numSlices));
+    for (int sliceIdx = 0; sliceIdx < numSlices; ++sliceIdx)
+    {
+        positions[std::size_t(sliceIdx)] = positionString(sliceIdx);
+        locations[std::size_t(sliceIdx)] = locationString(sliceIdx);
+    }
+}
@@ -0,0 +1,81 @@
+//
+//  seriesgeometry.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SERIESGEOMETRY_H
+#define SERIESGEOMETRY_H
+
+#include <string>
+#include <vector>
+
+class SeriesInfo;
+
+/**
+ * The positions of the slices of an image, worked out once for a series. The slices are
+ * stacked along the normal of the image orientation, a slice spacing apart, starting at the
+ * image position of the series. Every image of the series has the same slice positions.
+ */
+class SeriesGeometry
+{
+public:
+    /**
+     * Constructor. The orientation is parsed here and not again.
+     * @param seriesInfo Gives the image position, orientation and slice spacing.
+     */
+    explicit SeriesGeometry(const SeriesInfo& seriesInfo);
+
+    /**
+     * Get the position of a slice.
+     * @param sliceIdx The index of the slice in its image.
+     * @param position Filled with the x, y and z of the slice's first pixel.
+     */
+    void position(int sliceIdx, double position[3]) const;
+
+    /**
+     * Get the Image Position (Patient) of a slice as a DICOM string.
+     * @param sliceIdx The index of the slice in its image.
+     * @return The position with two decimals, as "x\y\z".
+     */
+    std::string positionString(int sliceIdx) const;
+
+    /**
+     * Get the Slice Location of a slice as a DICOM string. This is the distance from the
+     * first slice.
+     * @param sliceIdx The index of the slice in its image.
+     * @return The location with one decimal.
+     */
+    std::string locationString(int sliceIdx) const;
+
+    /**
+     * Work out the Image Position (Patient) and Slice Location of several slices at once.
+     * @param numSlices The number of slices, starting with the first.
+     * @param positions Filled with the position of each slice. See positionString().
+     * @param locations Filled with the location of each slice. See locationString().
+     */
+    void sliceStrings(int numSlices, std::vector<std::string>& positions,
+                      std::vector<std::string>& locations) const;
+
+private:
+    double origin[3];   ///< Position of the first slice.
+    double step[3];     ///< Offset from one slice to the next.
+    double spacing;     ///< Distance from one slice to the next.
+};
+
+#endif // SERIESGEOMETRY_H
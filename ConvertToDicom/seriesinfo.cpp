@@ -24,7 +24,7 @@
 #include "seriesinfo.h"
 #include "settings.h"
 #include "dumpmetadatadictionary.h"
-#include "dicomattributesdialog.h"
+#include "seriesgeometry.h"
 
 #include <QDir>
 
@@ -43,18 +43,19 @@ SeriesInfo::SeriesInfo()
       m_imageNumberOfImages(0),
       m_imageSliceSpacing(0.0),
       m_imageNumberOfSlices(0),
-      m_imageOrientationPatient("1\\0\\0\\0\\1\\0")
+      m_imageOrientationPatient("1\\0\\0\\0\\1\\0"),
+      m_numberOfThreads(0),
+      m_streamSlices(false),
+      m_maxSlicesInFlight(64),
+      m_sliceViews(true),
+      m_multiFrame(false),
+      m_compression(Compression::NONE),
+      m_minCompressionRate(50.0),
+      m_outputFormat(OutputFormat::FILES)
 {
      m_imagePositionPatient[0] = 0.0;
      m_imagePositionPatient[1] = 0.0;
      m_imagePositionPatient[2] = 0.0;
-
-     loadSettings();
-};
-
-SeriesInfo::~SeriesInfo()
-{
-    saveSettings();
 }
 
 void SeriesInfo::loadSettings()
@@ -91,6 +92,21 @@ void SeriesInfo::loadSettings()
     setSeriesNumber(settings.value(Settings::SeriesNumberKey, 0).toInt());
     setSeriesPositionPatient(settings.value(Settings::SeriesPatientPositionKey, "FFS").toString());
 
+    setNumberOfThreads(settings.value(Settings::NumberOfThreadsKey, 0).toInt());
+    setStreamSlices(settings.value(Settings::StreamSlicesKey, false).toBool());
+    setMaxSlicesInFlight(settings.value(Settings::MaxSlicesInFlightKey, 64).toInt());
+    setSliceViews(settings.value(Settings::SliceViewsKey, true).toBool());
+    setMultiFrame(settings.value(Settings::MultiFrameKey, false).toBool());
+    Compression compression = Compression::NONE;
+    CompressionFromName(settings.value(Settings::CompressionKey, CompressionName(Compression::NONE)).toString(),
+                        compression);
+    setCompression(compression);
+    setMinCompressionRate(settings.value(Settings::MinCompressionRateKey, 50.0).toDouble());
+    OutputFormat outputFormat = OutputFormat::FILES;
+    OutputFormatFromName(settings.value(Settings::OutputFormatKey, OutputFormatName(OutputFormat::FILES)).toString(),
+                         outputFormat);
+    setOutputFormat(outputFormat);
+
 
     LOG4CPLUS_DEBUG(m_logger, "Loaded current settings and set default settings.");
 }
@@ -119,6 +135,14 @@ void SeriesInfo::saveSettings()
     settings.setValue(Settings::StudyModalityKey, studyModality());
     settings.setValue(Settings::StudyDateTimeKey, studyDateTime());
     settings.setValue(Settings::StudyInstanceUIDKey, studyInstanceUID());
+    settings.setValue(Settings::NumberOfThreadsKey, numberOfThreads());
+    settings.setValue(Settings::StreamSlicesKey, streamSlices());
+    settings.setValue(Settings::MaxSlicesInFlightKey, maxSlicesInFlight());
+    settings.setValue(Settings::SliceViewsKey, sliceViews());
+    settings.setValue(Settings::MultiFrameKey, multiFrame());
+    settings.setValue(Settings::CompressionKey, CompressionName(compression()));
+    settings.setValue(Settings::MinCompressionRateKey, minCompressionRate());
+    settings.setValue(Settings::OutputFormatKey, OutputFormatName(outputFormat()));
     //    settings.setValue(Settings::ImageSliceSpacingKey, imageSliceSpacing());
     //    settings.setValue(Settings::ImagePatientPositionXKey, imagePositionPatientX());
     //    settings.setValue(Settings::ImagePatientPositionYKey, imagePositionPatientY());
@@ -130,59 +154,50 @@ void SeriesInfo::saveSettings()
     LOG4CPLUS_DEBUG(m_logger, "Saved settings.");
 }
 
-itk::MetaDataDictionary SeriesInfo::makeMetaDataDictionary() const
+itk::MetaDataDictionary SeriesInfo::metaDataDictionary(UidGenerator& uids) const
 {
     LOG4CPLUS_TRACE(m_logger, "Enter");
 
     // fill the dictionary from our Dicom
-    if (dict.GetKeys().size() == 0)
-    {
-        std::string studyDate = m_studyDateTime.toString(DicomDateFormat).toStdString();
-        std::string studyTime = m_studyDateTime.toString(DicomTimeFormat).toStdString();
-        std::string dobDate = m_patientDOB.toString(DicomDateFormat).toStdString();
-
-        itk::EncapsulateMetaData<std::string>(dict, "0010|0010", m_patientName.toStdString());
-        itk::EncapsulateMetaData<std::string>(dict, "0010|0020", m_patientID.toStdString());
-        itk::EncapsulateMetaData<std::string>(dict, "0010|0030", dobDate);
-        itk::EncapsulateMetaData<std::string>(dict, "0010|0040", m_patientSex.toStdString());
-
-        itk::EncapsulateMetaData<std::string>(dict, "0008|1030", m_studyDescription.toStdString());
-        itk::EncapsulateMetaData<std::string>(dict, "0020|0010", m_studyID.toStdString());
-        itk::EncapsulateMetaData<std::string>(dict, "0008|0060", m_studyModality.toStdString());
-
-        itk::EncapsulateMetaData<std::string>(dict, "0008|0020", studyDate);
-        itk::EncapsulateMetaData<std::string>(dict, "0008|0031", studyTime);
-        itk::EncapsulateMetaData<std::string>(dict, "0020|000d", m_StudyInstanceUID.toStdString());
-
-        gdcm::UIDGenerator suidGen;
-        std::string seriesUID = suidGen.Generate();
-        gdcm::UIDGenerator fuidGen;
-        std::string frameOfReferenceUID = fuidGen.Generate();
-        itk::EncapsulateMetaData<std::string>(dict, "0020|000e", seriesUID);
-        itk::EncapsulateMetaData<std::string>(dict, "0020|0052", frameOfReferenceUID);
-        itk::EncapsulateMetaData<std::string>(dict, "0020|0011", seriesNumberStr().toStdString());
-        itk::EncapsulateMetaData<std::string>(dict, "0008|103e", m_seriesDescription.toStdString());
-        itk::EncapsulateMetaData<std::string>(dict, "0018|5100", m_seriesPositionPatient.toStdString());
-        itk::EncapsulateMetaData<std::string>(dict, "0008|0021", studyDate); // just use study date
-        itk::EncapsulateMetaData<std::string>(dict, "0008|0030", studyTime); // just use study time
-
-        QString spacing;
-        spacing.setNum(m_imageSliceSpacing, 'f', 2);
-        //itk::EncapsulateMetaData<std::string>(dict, "0018|0050", spacing.toStdString());
-        itk::EncapsulateMetaData<std::string>(dict, "0020|0037", m_imageOrientationPatient.toStdString());
-        itk::EncapsulateMetaData<std::string>(dict, "0020|0032", imagePositionPatientString().toStdString());
-    }
+    itk::MetaDataDictionary dict;
+    std::string studyDate = m_studyDateTime.toString(DicomDateFormat).toStdString();
+    std::string studyTime = m_studyDateTime.toString(DicomTimeFormat).toStdString();
+    std::string dobDate = m_patientDOB.toString(DicomDateFormat).toStdString();
+
+    itk::EncapsulateMetaData<std::string>(dict, "0010|0010", m_patientName.toStdString());
+    itk::EncapsulateMetaData<std::string>(dict, "0010|0020", m_patientID.toStdString());
+    itk::EncapsulateMetaData<std::string>(dict, "0010|0030", dobDate);
+    itk::EncapsulateMetaData<std::string>(dict, "0010|0040", m_patientSex.toStdString());
+
+    itk::EncapsulateMetaData<std::string>(dict, "0008|1030", m_studyDescription.toStdString());
+    itk::EncapsulateMetaData<std::string>(dict, "0020|0010", m_studyID.toStdString());
+    itk::EncapsulateMetaData<std::string>(dict, "0008|0060", m_studyModality.toStdString());
+
+    itk::EncapsulateMetaData<std::string>(dict, "0008|0020", studyDate);
+    itk::EncapsulateMetaData<std::string>(dict, "0008|0031", studyTime);
+    itk::EncapsulateMetaData<std::string>(dict, "0020|000d", m_StudyInstanceUID.toStdString());
+
+    std::string seriesUID = uids.generate();
+    std::string frameOfReferenceUID = uids.generate();
+    itk::EncapsulateMetaData<std::string>(dict, "0020|000e", seriesUID);
+    itk::EncapsulateMetaData<std::string>(dict, "0020|0052", frameOfReferenceUID);
+    itk::EncapsulateMetaData<std::string>(dict, "0020|0011", seriesNumberStr().toStdString());
+    itk::EncapsulateMetaData<std::string>(dict, "0008|103e", m_seriesDescription.toStdString());
+    itk::EncapsulateMetaData<std::string>(dict, "0018|5100", m_seriesPositionPatient.toStdString());
+    itk::EncapsulateMetaData<std::string>(dict, "0008|0021", studyDate); // just use study date
+    itk::EncapsulateMetaData<std::string>(dict, "0008|0030", studyTime); // just use study time
+
+    QString spacing;
+    spacing.setNum(m_imageSliceSpacing, 'f', 2);
+    //itk::EncapsulateMetaData<std::string>(dict, "0018|0050", spacing.toStdString());
+    itk::EncapsulateMetaData<std::string>(dict, "0020|0037", m_imageOrientationPatient.toStdString());
+    itk::EncapsulateMetaData<std::string>(dict, "0020|0032", imagePositionPatientString().toStdString());
 
     LOG4CPLUS_TRACE(m_logger, "Initial MetaDataDictionary:\n" << DumpDicomMetaDataDictionary(dict));
 
     return dict;
 }
 
-itk::MetaDataDictionary SeriesInfo::metaDataDictionary() const
-{
-    return dict;
-}
-
 QString SeriesInfo::imagePositionPatientString() const
 {
     std::stringstream sstr;
@@ -193,43 +208,6 @@ QString SeriesInfo::imagePositionPatientString() const
 
 QString SeriesInfo::imagePositionPatientString(int sliceIdx) const
 {
-    //LOG4CPLUS_TRACE(logger_, "Enter");
-
-    vnl_matrix_fixed<double, 3, 3> rot;   // the rotation matrix
-    vnl_vector_fixed<double, 3> ipp;      // the IPP (column) vector
-
-    // Create the rotation matrix from IOP
-    sscanf(m_imageOrientationPatient.toStdString().c_str(), "%lf\\%lf\\%lf\\%lf\\%lf\\%lf",
-           &rot(0, 0), &rot(0, 1), &rot(0, 2), &rot(1, 0), &rot(1, 1), &rot(1, 2));
-
-    // Compute the remaining orthogonal vector to complete the matrix
-    rot(2,0) = rot(0, 1) * rot(1, 2) - rot(0, 2) * rot(1, 1);
-    rot(2,1) = rot(0, 2) * rot(1, 0) - rot(0, 0) * rot(1, 2);
-    rot(2,2) = rot(0, 0) * rot(1, 1) - rot(0, 1) * rot(1, 0);
-
-    // IPP as a vector
-    ipp[0] =  imagePositionPatientX();
-    ipp[1] =  imagePositionPatientY();
-    ipp[2] =  imagePositionPatientZ();
-
-    LOG4CPLUS_DEBUG(m_logger, "Initial IPP = " << imagePositionPatientString().toStdString());
-
-    ipp = rot * ipp;                            // rotate ipp into image coordinates
-    ipp[2] += m_imageSliceSpacing * sliceIdx;    // increment Z component
-    ipp = rot.inplace_transpose() * ipp;        // rotate back into patient coordinates
-
-    char ippStr[30];
-    sprintf(ippStr, "%.2f\\%.2f\\%.2f", ipp(0), ipp(1), ipp(2));
-    LOG4CPLUS_DEBUG(m_logger, "Incremented IPP = " << ippStr);
-
-    return ippStr;
-
-    /* extracted from osirix, reflected in above code
-     float vec[3];
-     vec[0] = iop[1]*iop[5] - iop[2]*iop[4];
-     vec[1] = iop[2]*iop[3] - iop[0]*iop[5];
-     vec[2] = iop[0]*iop[4] - iop[1]*iop[3];
-     */
-
+    return QString::fromStdString(SeriesGeometry(*this).positionString(sliceIdx));
 }
 
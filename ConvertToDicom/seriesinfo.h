@@ -23,6 +23,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "logger.h"
+#include "uidgenerator.h"
+#include "pixelcodec.h"
+#include "outputsink.h"
 
 #include "itkheaders.pch.h"
 
@@ -35,14 +38,14 @@
 /**
  * @brief The SeriesInfo class
  * This class contains all of the DICOM and other information needed to do the conversions.
- * It is set up as a singleton class because only one should ever be created and it allows
- * the instance to be accessed globally.
+ * It is an ordinary value class. The GUI keeps one which the user edits and each conversion
+ * works from its own copy, held by a ConversionJob, so several series may be converted at once.
  */
 class SeriesInfo
 {
-    const Qt::DateFormat TimeFormat = Qt::ISODateWithMs;      //< Format used in program for times
-    const Qt::DateFormat DateFormat = Qt::ISODate;            //< Format used in program for dates
-    const Qt::DateFormat DateTimeFormat = Qt::ISODateWithMs;  //< Format used in program for datetimes
+    static const Qt::DateFormat TimeFormat = Qt::ISODateWithMs;      //< Format used in program for times
+    static const Qt::DateFormat DateFormat = Qt::ISODate;            //< Format used in program for dates
+    static const Qt::DateFormat DateTimeFormat = Qt::ISODateWithMs;  //< Format used in program for datetimes
 
     const char* DicomTimeFormat = "HHmmss.zzz";               //< Format used to format DICOM times
     const char* DicomDateFormat = "YYYYMMdd";                 //< Format used to format DICOM dates
@@ -200,11 +203,6 @@ public:
         return locale.toString(m_seriesTimeIncrement, 'f', 3);
     }
 
-    QList<QTime>& acqTimes()
-    {
-        return m_acqTimes;
-    }
-
     int imageNumberOfImages() const
     {
         return m_imageNumberOfImages;
@@ -280,6 +278,89 @@ public:
         return m_imageOrientationPatient;
     }
 
+    /**
+     * @brief numberOfThreads
+     * Get the number of worker threads used to read and write the files.
+     * @return The number of threads. 0 means one per core.
+     */
+    int numberOfThreads() const
+    {
+        return m_numberOfThreads;
+    }
+
+    /**
+     * @brief streamSlices
+     * Get flag which indicates whether slices are written while the series is being read
+     * instead of after all of it has been read.
+     * @return true if the series is streamed, false otherwise.
+     */
+    bool streamSlices() const
+    {
+        return m_streamSlices;
+    }
+
+    /**
+     * @brief maxSlicesInFlight
+     * When streaming, the maximum number of slices waiting to be written.
+     * @return The maximum number of slices.
+     */
+    int maxSlicesInFlight() const
+    {
+        return m_maxSlicesInFlight;
+    }
+
+    /**
+     * @brief sliceViews
+     * Get flag which indicates whether the slices of 3D images share the image's pixels
+     * instead of being copied.
+     * @return true if slices are views, false if they are copies.
+     */
+    bool sliceViews() const
+    {
+        return m_sliceViews;
+    }
+
+    /**
+     * @brief multiFrame
+     * Get flag which indicates whether the series is written as a single multi-frame file
+     * instead of a file for each slice.
+     * @return true if the series is written as one file.
+     */
+    bool multiFrame() const
+    {
+        return m_multiFrame;
+    }
+
+    /**
+     * @brief compression
+     * Get the lossless compression of the pixels of the DICOM files.
+     * @return The compression.
+     */
+    Compression compression() const
+    {
+        return m_compression;
+    }
+
+    /**
+     * @brief minCompressionRate
+     * Get the slowest a codec may compress and still be chosen by Compression::AUTO.
+     * @return The rate in megabytes a second per thread.
+     */
+    double minCompressionRate() const
+    {
+        return m_minCompressionRate;
+    }
+
+    /**
+     * @brief outputFormat
+     * Get whether the DICOM files are written one by one or into an archive.
+     * @return The output format.
+     */
+    OutputFormat outputFormat() const
+    {
+        return m_outputFormat;
+    }
+
     /**
      * @brief setOverwriteFiles
      * Set flag which indicates whether generated files will overwrite existing files.
@@ -424,6 +505,79 @@ public:
         m_imageOrientationPatient = imageOrientationPatient;
     }
 
+    /**
+     * @brief setNumberOfThreads
+     * @param numberOfThreads The number of worker threads to use. 0 means one per core.
+     */
+    void setNumberOfThreads(int numberOfThreads)
+    {
+        m_numberOfThreads = numberOfThreads;
+    }
+
+    /**
+     * @brief setStreamSlices
+     * @param streamSlices true to write slices while the series is being read.
+     */
+    void setStreamSlices(bool streamSlices)
+    {
+        m_streamSlices = streamSlices;
+    }
+
+    /**
+     * @brief setMaxSlicesInFlight
+     * @param maxSlicesInFlight When streaming, the maximum number of slices waiting to be written.
+     */
+    void setMaxSlicesInFlight(int maxSlicesInFlight)
+    {
+        m_maxSlicesInFlight = maxSlicesInFlight;
+    }
+
+    /**
+     * @brief setSliceViews
+     * @param sliceViews true to make the slices of 3D images views of the image's pixels.
+     */
+    void setSliceViews(bool sliceViews)
+    {
+        m_sliceViews = sliceViews;
+    }
+
+    /**
+     * @brief setMultiFrame
+     * @param multiFrame true to write the series as a single multi-frame file.
+     */
+    void setMultiFrame(bool multiFrame)
+    {
+        m_multiFrame = multiFrame;
+    }
+
+    /**
+     * @brief setCompression
+     * @param compression The lossless compression of the pixels of the DICOM files.
+     */
+    void setCompression(Compression compression)
+    {
+        m_compression = compression;
+    }
+
+    /**
+     * @brief setMinCompressionRate
+     * @param rate The slowest a codec may compress, in megabytes a second per thread, and still
+     * be chosen by Compression::AUTO.
+     */
+    void setMinCompressionRate(double rate)
+    {
+        m_minCompressionRate = rate;
+    }
+
+    /**
+     * @brief setOutputFormat
+     * @param outputFormat Whether the DICOM files are written one by one or into an archive.
+     */
+    void setOutputFormat(OutputFormat outputFormat)
+    {
+        m_outputFormat = outputFormat;
+    }
+
     /**
      * @brief loadSettings
      * Fills a data structure using the saved settings.
@@ -450,8 +604,6 @@ private:
     QDir m_outputDir;
     QString m_outputPath;
 
-    QList<QTime> m_acqTimes;
-
     QString m_patientName;
     QString m_patientID;
     QDate m_patientDOB;
@@ -475,33 +627,21 @@ private:
     vnl_vector_fixed<double, 3> m_imagePositionPatient;
     QString m_imageOrientationPatient;
 
-    mutable itk::MetaDataDictionary dict;
+    int m_numberOfThreads;
+    bool m_streamSlices;
+    int m_maxSlicesInFlight;
+    bool m_sliceViews;
+    bool m_multiFrame;
+    Compression m_compression;
+    double m_minCompressionRate;
+    OutputFormat m_outputFormat;
 
 public:
     /**
-     * Get the global instance of this class.
-     * @return Pointer to single instance of this class.
+     * Default constructor. Sets initial values of members. The saved settings are not
+     * loaded; call loadSettings() for that.
      */
-    static SeriesInfo* getInstance()
-    {
-        static SeriesInfo instance;
-        return &instance;
-    }
-
-    /**
-     * Get a tempory instance of this class. The new instance is a copy of the global
-     * instance.
-     * @return Pointer to a temporary instance of this class. It must be <code>delete</code>d
-     * when no longer needed.
-     */
-    static SeriesInfo* getTempInstance()
-    {
-        SeriesInfo *instance = getInstance();
-        SeriesInfo *tempInstance = new SeriesInfo;
-
-        *tempInstance = *instance;
-        return tempInstance;
-    }
+    SeriesInfo();
 
     /**
      * Check for internal completeness and conistency.
@@ -511,10 +651,12 @@ public:
     bool isConistent();
 
     /**
-     * Get the parameters as a DICOM dictionary.
+     * Get the parameters as a DICOM dictionary. A new dictionary, with new series and frame
+     * of reference UIDs, is made on each call.
+     * @param uids Makes the series and frame of reference UIDs.
      * @return The dictionary.
      */
-    itk::MetaDataDictionary metaDataDictionary() const;
+    itk::MetaDataDictionary metaDataDictionary(UidGenerator& uids) const;
 
     /**
      * @brief imagePositionPatientString
@@ -524,35 +666,12 @@ public:
 
     /**
      * @brief imagePositionPatientString
+     * The orientation is parsed on each call. Use a SeriesGeometry for the slices of a series.
      * @param sliceIdx The slice whose position we want.
      * @return The ImagePositionPatient for this slice as a DICOM compatible string.
      */
     QString imagePositionPatientString(int sliceIdx) const;
 
-private:
-    /**
-     * Default constructor. Sets initial values of members.
-     */
-    SeriesInfo();
-
-    /**
-     * @brief SeriesInfo
-     * Copy constructor private and unimplemented.
-     */
-    SeriesInfo(const SeriesInfo&);
-
-    /**
-     * Destructor
-     */
-    ~SeriesInfo();
-
-    /**
-     * @brief SeriesInfo
-     * Assignment operator private and unimplemented.
-     */
-    SeriesInfo& operator=(const SeriesInfo&);
-
-    itk::MetaDataDictionary makeMetaDataDictionary() const;
 };
 
 #endif // SERIESINFO_H
@@ -47,6 +47,15 @@ QString Settings::StudyInstanceUIDKey = "StudyStudyUID";
 QString Settings::SeriesDescriptionKey = "SeriesDescription";
 QString Settings::SeriesNumberKey = "SeriesNumber";
 QString Settings::SeriesPatientPositionKey = "SeriesPatientPosition";
+QString Settings::NumberOfThreadsKey = "NumberOfThreads";
+QString Settings::StreamSlicesKey = "StreamSlices";
+QString Settings::MaxSlicesInFlightKey = "MaxSlicesInFlight";
+QString Settings::SliceViewsKey = "SliceViews";
+QString Settings::MultiFrameKey = "MultiFrame";
+QString Settings::CompressionKey = "Compression";
+QString Settings::MinCompressionRateKey = "MinCompressionRate";
+QString Settings::OutputFormatKey = "OutputFormat";
+QString Settings::UidRootKey = "UidRoot";
 //QString Settings::ImageSliceSpacingKey = "ImageSliceSpacing";
 //QString Settings::ImagePatientPositionXKey = "ImagePatientPositionX";
 //QString Settings::ImagePatientPositionYKey = "ImagePatientPositionY";
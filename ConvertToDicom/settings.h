@@ -61,6 +61,16 @@ public:
     static QString SeriesPatientPositionKey;
     static QString SeriesTimeIncrementKey;
 
+    static QString NumberOfThreadsKey;
+    static QString StreamSlicesKey;
+    static QString MaxSlicesInFlightKey;
+    static QString SliceViewsKey;
+    static QString MultiFrameKey;
+    static QString CompressionKey;
+    static QString MinCompressionRateKey;
+    static QString OutputFormatKey;
+    static QString UidRootKey;
+
     //    static QString ImageSliceSpacingKey;
     //    static QString ImagePatientPositionXKey;
     //    static QString ImagePatientPositionYKey;
@@ -0,0 +1,115 @@
+//
+//  slicedictionary.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "slicedictionary.h"
+
+namespace
+{
+bool FindEntry(const SliceDictionary::EntryList& entries, const std::string& key, std::string& value)
+{
+    for (SliceDictionary::EntryList::const_iterator iter = entries.begin(); iter != entries.end(); ++iter)
+    {
+        if (iter->first == key)
+        {
+            value = iter->second;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void AddEntries(const SliceDictionary::EntryList& entries, itk::MetaDataDictionary& dict)
+{
+    for (SliceDictionary::EntryList::const_iterator iter = entries.begin(); iter != entries.end(); ++iter)
+        itk::EncapsulateMetaData<std::string>(dict, iter->first, iter->second);
+}
+}
+
+SliceDictionary::SliceDictionary(const SeriesLayer& series, const ImageLayer& image, StringArena* arena)
+    : m_series(series),
+      m_image(image),
+      m_arena(arena)
+{
+}
+
+void SliceDictionary::set(const std::string& key, const std::string& value)
+{
+    // A replaced value stays in the arena until it is cleared. Slices rarely set a key twice.
+    const char* arenaValue = m_arena->copy(value);
+    for (int idx = 0; idx < m_entries.size(); ++idx)
+    {
+        if (key == m_entries[idx].key)
+        {
+            m_entries[idx].value = arenaValue;
+            return;
+        }
+    }
+
+    Entry entry;
+    entry.key = m_arena->copy(key);
+    entry.value = arenaValue;
+    m_entries.append(entry);
+}
+
+bool SliceDictionary::find(const std::string& key, std::string& value) const
+{
+    for (int idx = 0; idx < m_entries.size(); ++idx)
+    {
+        if (key == m_entries[idx].key)
+        {
+            value = m_entries[idx].value;
+            return true;
+        }
+    }
+
+    if (!m_image.isNull() && FindEntry(*m_image, key, value))
+        return true;
+
+    return !m_series.isNull() && itk::ExposeMetaData<std::string>(*m_series, key, value);
+}
+
+void SliceDictionary::flatten(itk::MetaDataDictionary& dict) const
+{
+    if (m_series.isNull())
+        dict = itk::MetaDataDictionary();
+    else
+        dict = *m_series;
+
+    if (!m_image.isNull())
+        AddEntries(*m_image, dict);
+    for (int idx = 0; idx < m_entries.size(); ++idx)
+        itk::EncapsulateMetaData<std::string>(dict, m_entries[idx].key, std::string(m_entries[idx].value));
+}
+
+void SliceDictionary::setEntry(EntryList& entries, const std::string& key, const std::string& value)
+{
+    for (EntryList::iterator iter = entries.begin(); iter != entries.end(); ++iter)
+    {
+        if (iter->first == key)
+        {
+            iter->second = value;
+            return;
+        }
+    }
+
+    entries.push_back(std::make_pair(key, value));
+}
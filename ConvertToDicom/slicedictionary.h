@@ -0,0 +1,152 @@
+//
+//  slicedictionary.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SLICEDICTIONARY_H
+#define SLICEDICTIONARY_H
+
+#include "stringarena.h"
+
+#include "itkheaders.pch.h"
+
+#include <QSharedPointer>
+#include <QVarLengthArray>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * The DICOM attributes of one slice, kept in layers so that a long series does not hold a
+ * full itk::MetaDataDictionary for every slice. The series layer is a dictionary shared by
+ * all of the slices. Above it are the entries of the slice's image, shared by the slices of
+ * that image, and then the few entries of the slice itself. An entry hides any entry with
+ * the same key in the layers below it. The slice's own keys and values are kept in a
+ * StringArena shared by the series, so a slice makes no allocations of its own.
+ */
+class SliceDictionary
+{
+public:
+    typedef std::vector<std::pair<std::string, std::string> > EntryList;
+    typedef QSharedPointer<const itk::MetaDataDictionary> SeriesLayer;
+    typedef QSharedPointer<const EntryList> ImageLayer;
+
+    /**
+     * Constructor. The slice has no entries of its own.
+     * @param series The attributes of the series.
+     * @param image The attributes of the slice's image. May be null.
+     * @param arena Holds the slice's entries. It must not be cleared while the slice is in use.
+     */
+    SliceDictionary(const SeriesLayer& series, const ImageLayer& image, StringArena* arena);
+
+    /**
+     * Set an entry of the slice.
+     * @param key The DICOM tag as "gggg|eeee".
+     * @param value The value.
+     */
+    void set(const std::string& key, const std::string& value);
+
+    /**
+     * Look up an entry, starting with the slice's own and falling through to the image's
+     * and then the series'.
+     * @param key The DICOM tag as "gggg|eeee".
+     * @param value Set to the value if it is found.
+     * @return true if the entry was found.
+     */
+    bool find(const std::string& key, std::string& value) const;
+
+    /**
+     * Fill in a dictionary with every entry of the slice. The series layer is copied, which
+     * shares its values rather than making them again, and the image and slice entries are
+     * added on top.
+     * @param dict The dictionary. What it held before is replaced.
+     */
+    void flatten(itk::MetaDataDictionary& dict) const;
+
+    /**
+     * Get the layer shared by the series.
+     * @return The layer.
+     */
+    const SeriesLayer& seriesLayer() const
+    {
+        return m_series;
+    }
+
+    /**
+     * Get the layer shared by the slices of the image.
+     * @return The layer. May be null.
+     */
+    const ImageLayer& imageLayer() const
+    {
+        return m_image;
+    }
+
+    /**
+     * Get the number of the slice's own entries.
+     * @return The number of entries.
+     */
+    int entryCount() const
+    {
+        return m_entries.size();
+    }
+
+    /**
+     * Get the key of one of the slice's own entries.
+     * @param idx The index of the entry, less than entryCount().
+     * @return The key as "gggg|eeee".
+     */
+    const char* entryKey(int idx) const
+    {
+        return m_entries[idx].key;
+    }
+
+    /**
+     * Get the value of one of the slice's own entries.
+     * @param idx The index of the entry, less than entryCount().
+     * @return The value.
+     */
+    const char* entryValue(int idx) const
+    {
+        return m_entries[idx].value;
+    }
+
+    /**
+     * Set an entry in a list, replacing any with the same key.
+     * @param entries The list.
+     * @param key The DICOM tag as "gggg|eeee".
+     * @param value The value.
+     */
+    static void setEntry(EntryList& entries, const std::string& key, const std::string& value);
+
+private:
+    /** An entry of the slice. The strings are in the arena. */
+    struct Entry
+    {
+        const char* key;
+        const char* value;
+    };
+
+    SeriesLayer m_series;                   ///< Shared by every slice of the series.
+    ImageLayer m_image;                     ///< Shared by the slices of one image.
+    StringArena* m_arena;                   ///< Holds the strings of m_entries.
+    QVarLengthArray<Entry, 6> m_entries;    ///< The slice's own entries.
+};
+
+#endif // SLICEDICTIONARY_H
@@ -0,0 +1,84 @@
+//
+//  slicequeue.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "slicequeue.h"
+
+#include <QMutexLocker>
+
+SliceQueue::SliceQueue(int capacity)
+    : capacity(capacity > 0 ? capacity : 1), closed(false), aborted(false)
+{
+}
+
+bool SliceQueue::push(int sliceIdx, const AnyImage2DType::Pointer& slice)
+{
+    QMutexLocker locker(&mutex);
+
+    while (!aborted && entries.size() >= capacity)
+        notFull.wait(&mutex);
+
+    if (aborted)
+        return false;
+
+    Entry entry;
+    entry.sliceIdx = sliceIdx;
+    entry.slice = slice;
+    entries.enqueue(entry);
+
+    notEmpty.wakeOne();
+    return true;
+}
+
+bool SliceQueue::pop(int& sliceIdx, AnyImage2DType::Pointer& slice)
+{
+    QMutexLocker locker(&mutex);
+
+    while (!aborted && !closed && entries.isEmpty())
+        notEmpty.wait(&mutex);
+
+    if (aborted || entries.isEmpty())
+        return false;
+
+    Entry entry = entries.dequeue();
+    sliceIdx = entry.sliceIdx;
+    slice = entry.slice;
+
+    notFull.wakeOne();
+    return true;
+}
+
+void SliceQueue::close()
+{
+    QMutexLocker locker(&mutex);
+
+    closed = true;
+    notEmpty.wakeAll();
+}
+
+void SliceQueue::abort()
+{
+    QMutexLocker locker(&mutex);
+
+    aborted = true;
+    entries.clear();
+    notFull.wakeAll();
+    notEmpty.wakeAll();
+}
@@ -0,0 +1,90 @@
+//
+//  slicequeue.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SLICEQUEUE_H
+#define SLICEQUEUE_H
+
+#include "itktypedefs.h"
+
+#include <QMutex>
+#include <QQueue>
+#include <QWaitCondition>
+
+/**
+ * A bounded, thread safe queue of slices waiting to be written. Reader threads push slices
+ * in and writer threads pop them out. A push blocks while the queue is full so the number of
+ * slices held in the queue never exceeds its capacity.
+ */
+class SliceQueue
+{
+public:
+    /**
+     * Constructor.
+     * @param capacity The maximum number of slices the queue will hold. Values less than 1
+     * are treated as 1.
+     */
+    explicit SliceQueue(int capacity);
+
+    /**
+     * Add a slice to the queue, waiting for room if the queue is full.
+     * @param sliceIdx The index of the slice in the series.
+     * @param slice The slice.
+     * @return true if the slice was queued, false if the queue has been aborted.
+     */
+    bool push(int sliceIdx, const AnyImage2DType::Pointer& slice);
+
+    /**
+     * Take a slice from the queue, waiting for one if the queue is empty.
+     * @param sliceIdx Receives the index of the slice in the series.
+     * @param slice Receives the slice.
+     * @return true if a slice was taken, false if the queue is closed and empty or has been aborted.
+     */
+    bool pop(int& sliceIdx, AnyImage2DType::Pointer& slice);
+
+    /**
+     * Signal that no more slices will be pushed. Waiting consumers return once the
+     * queue has been emptied.
+     */
+    void close();
+
+    /**
+     * Stop the queue. Queued slices are released and all waiting threads return.
+     */
+    void abort();
+
+private:
+    /** One queued slice. */
+    struct Entry
+    {
+        int sliceIdx;
+        AnyImage2DType::Pointer slice;
+    };
+
+    QMutex mutex;              ///< Protects everything below.
+    QWaitCondition notFull;    ///< Signalled when a slice is taken.
+    QWaitCondition notEmpty;   ///< Signalled when a slice is added.
+    QQueue<Entry> entries;     ///< The queued slices.
+    int capacity;              ///< Maximum size of entries.
+    bool closed;               ///< No more slices will be pushed.
+    bool aborted;              ///< The queue has been stopped.
+};
+
+#endif // SLICEQUEUE_H
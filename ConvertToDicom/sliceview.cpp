@@ -0,0 +1,85 @@
+//
+//  sliceview.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "sliceview.h"
+
+template <typename TPixel>
+void SliceViewContainer<TPixel>::SetView(TPixel* pixels, itk::SizeValueType numberOfPixels,
+                                         const itk::LightObject* owner)
+{
+    // The container must never free or reallocate the pixels.
+    this->SetImportPointer(pixels, numberOfPixels, false);
+    this->owner = owner;
+}
+
+template <typename TPixel>
+typename itk::Image<TPixel, 2u>::Pointer MakeSliceView(itk::Image<TPixel, 3u>* volume, unsigned sliceIdx)
+{
+    typedef itk::Image<TPixel, 2u> SliceType;
+    typedef itk::Image<TPixel, 3u> VolumeType;
+
+    typename VolumeType::RegionType volumeRegion = volume->GetLargestPossibleRegion();
+    typename VolumeType::SizeType volumeSize = volumeRegion.GetSize();
+    typename VolumeType::IndexType volumeStart = volumeRegion.GetIndex();
+
+    typename SliceType::IndexType start;
+    start[0] = volumeStart[0];
+    start[1] = volumeStart[1];
+    typename SliceType::SizeType size;
+    size[0] = volumeSize[0];
+    size[1] = volumeSize[1];
+    typename SliceType::RegionType region(start, size);
+
+    // The geometry follows that given by itk::ExtractImageFilter: the in-plane spacing, the
+    // in-plane components of the volume's origin and an identity direction.
+    typename SliceType::SpacingType spacing;
+    spacing[0] = volume->GetSpacing()[0];
+    spacing[1] = volume->GetSpacing()[1];
+    typename SliceType::PointType origin;
+    origin[0] = volume->GetOrigin()[0];
+    origin[1] = volume->GetOrigin()[1];
+
+    // The slices are contiguous in the volume's buffer.
+    itk::SizeValueType slicePixels = size[0] * size[1];
+    typename SliceViewContainer<TPixel>::Pointer container = SliceViewContainer<TPixel>::New();
+    container->SetView(volume->GetBufferPointer() + slicePixels * sliceIdx, slicePixels, volume);
+
+    typename SliceType::Pointer slice = SliceType::New();
+    slice->SetRegions(region);
+    slice->SetSpacing(spacing);
+    slice->SetOrigin(origin);
+    slice->SetPixelContainer(container);
+
+    return slice;
+}
+
+// The pixel types which NativeComponentType() allows.
+template class SliceViewContainer<unsigned char>;
+template class SliceViewContainer<char>;
+template class SliceViewContainer<unsigned short>;
+template class SliceViewContainer<short>;
+template class SliceViewContainer<float>;
+
+template itk::Image<unsigned char, 2u>::Pointer MakeSliceView(itk::Image<unsigned char, 3u>*, unsigned);
+template itk::Image<char, 2u>::Pointer MakeSliceView(itk::Image<char, 3u>*, unsigned);
+template itk::Image<unsigned short, 2u>::Pointer MakeSliceView(itk::Image<unsigned short, 3u>*, unsigned);
+template itk::Image<short, 2u>::Pointer MakeSliceView(itk::Image<short, 3u>*, unsigned);
+template itk::Image<float, 2u>::Pointer MakeSliceView(itk::Image<float, 3u>*, unsigned);
@@ -0,0 +1,76 @@
+//
+//  sliceview.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SLICEVIEW_H
+#define SLICEVIEW_H
+
+#include "itktypedefs.h"
+
+#include "itkheaders.pch.h"
+
+/**
+ * A pixel container which does not own its pixels. They belong to another object, usually
+ * the 3D image a slice was taken from, and the container holds a reference to that object
+ * so the pixels stay valid for as long as the container does. It is instantiated for the
+ * pixel types which NativeComponentType() allows.
+ */
+template <typename TPixel>
+class SliceViewContainer : public itk::ImportImageContainer<itk::SizeValueType, TPixel>
+{
+public:
+    typedef SliceViewContainer Self;
+    typedef itk::ImportImageContainer<itk::SizeValueType, TPixel> Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(SliceViewContainer, ImportImageContainer);
+
+    /**
+     * Point the container at pixels belonging to another object.
+     * @param pixels The first pixel.
+     * @param numberOfPixels The number of pixels.
+     * @param owner The object which owns the pixels. It is kept alive by this container.
+     */
+    void SetView(TPixel* pixels, itk::SizeValueType numberOfPixels, const itk::LightObject* owner);
+
+protected:
+    SliceViewContainer() {}
+    ~SliceViewContainer() {}
+
+private:
+    ITK_DISALLOW_COPY_AND_ASSIGN(SliceViewContainer);
+
+    itk::LightObject::ConstPointer owner; ///< Owner of the pixels.
+};
+
+/**
+ * Make a 2D image of one slice of a 3D image without copying the pixels. The slice has the
+ * same geometry as one made by itk::ExtractImageFilter with the direction collapsed to the
+ * identity. The 3D image must not be reallocated or modified while the slice is in use.
+ * @param volume The 3D image. Its buffered region must be its largest possible region.
+ * @param sliceIdx The index of the slice along the third axis.
+ * @return The slice.
+ */
+template <typename TPixel>
+typename itk::Image<TPixel, 2u>::Pointer MakeSliceView(itk::Image<TPixel, 3u>* volume, unsigned sliceIdx);
+
+#endif // SLICEVIEW_H
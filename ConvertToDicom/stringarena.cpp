@@ -0,0 +1,75 @@
+//
+//  stringarena.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "stringarena.h"
+
+#include <cstring>
+
+StringArena::StringArena(std::size_t blockSize)
+    : blockSize(blockSize),
+      next(0),
+      remaining(0),
+      allocated(0)
+{
+}
+
+StringArena::~StringArena()
+{
+    clear();
+}
+
+const char* StringArena::copy(const std::string& str)
+{
+    std::size_t size = str.size() + 1;
+    if (size > remaining)
+    {
+        // A long string gets a block to itself so the current block can still be filled.
+        if (size > blockSize / 4)
+        {
+            char* block = new char[size];
+            blocks.push_back(block);
+            allocated += size;
+            std::memcpy(block, str.c_str(), size);
+            return block;
+        }
+
+        next = new char[blockSize];
+        blocks.push_back(next);
+        allocated += blockSize;
+        remaining = blockSize;
+    }
+
+    char* result = next;
+    std::memcpy(result, str.c_str(), size);
+    next += size;
+    remaining -= size;
+    return result;
+}
+
+void StringArena::clear()
+{
+    for (std::size_t idx = 0; idx < blocks.size(); ++idx)
+        delete [] blocks[idx];
+    blocks.clear();
+    next = 0;
+    remaining = 0;
+    allocated = 0;
+}
@@ -0,0 +1,81 @@
+//
+//  stringarena.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef STRINGARENA_H
+#define STRINGARENA_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Storage for many small strings which all live as long as each other, such as the values
+ * of the slice dictionaries of a series. The strings are copied into large blocks rather
+ * than each having its own allocation, and clear() releases them all at once. It is not
+ * thread safe.
+ */
+class StringArena
+{
+public:
+    /**
+     * Constructor. Nothing is allocated until the first string is copied.
+     * @param blockSize The size of each block of storage. Longer strings get a block of their own.
+     */
+    explicit StringArena(std::size_t blockSize = 64 * 1024);
+
+    /**
+     * Destructor. Releases every string.
+     */
+    ~StringArena();
+
+    /**
+     * Copy a string into the arena.
+     * @param str The string.
+     * @return The null terminated copy. It is valid until clear() is called or the arena is destroyed.
+     */
+    const char* copy(const std::string& str);
+
+    /**
+     * Release every string copied so far.
+     */
+    void clear();
+
+    /**
+     * Get the amount of storage held.
+     * @return The number of bytes in all of the blocks.
+     */
+    std::size_t bytesAllocated() const
+    {
+        return allocated;
+    }
+
+private:
+    StringArena(const StringArena&);
+    StringArena& operator=(const StringArena&);
+
+    std::size_t blockSize;      ///< Size of a normal block.
+    std::vector<char*> blocks;  ///< Every block allocated.
+    char* next;                 ///< Where the next string goes in the current block.
+    std::size_t remaining;      ///< Space left in the current block.
+    std::size_t allocated;      ///< Total size of the blocks.
+};
+
+#endif // STRINGARENA_H
@@ -0,0 +1,165 @@
+//
+//  uidgenerator.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "uidgenerator.h"
+
+#include "itkheaders.pch.h"
+
+#include <QByteArray>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QUuid>
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+const std::size_t MaxUidLength = 64;
+
+// Room is kept for a counter of this many digits.
+const std::size_t CounterDigits = 10;
+const quint64 MaxCounter = 9999999999ull;
+
+// The unique component has at least this many random digits, or 53 bits. A version 4
+// UUID has 122 random bits so there is no point in more than 36.
+const std::size_t MinUniqueDigits = 16;
+const std::size_t MaxUniqueDigits = 36;
+
+// A root may be this long and still leave room for the rest: two dots, the
+// unique component with its leading 1 and the counter.
+const std::size_t MaxRootLength = MaxUidLength - 2 - (1 + MinUniqueDigits) - CounterDigits;
+
+QMutex& RootMutex()
+{
+    static QMutex mutex;
+    return mutex;
+}
+
+std::string& RootStorage()
+{
+    static std::string root;
+    return root;
+}
+
+/**
+ * Get some random decimal digits from a new UUID.
+ */
+std::string UniqueDigits(std::size_t numDigits)
+{
+    // Read the UUID as a 128 bit number and take its last digits, dividing it by ten
+    // a byte at a time.
+    QByteArray bytes = QUuid::createUuid().toRfc4122();
+    std::vector<unsigned> number(bytes.begin(), bytes.end());
+    for (std::size_t idx = 0; idx < number.size(); ++idx)
+        number[idx] &= 0xffu;
+
+    std::string digits;
+    while (digits.size() < numDigits)
+    {
+        unsigned remainder = 0;
+        for (std::size_t idx = 0; idx < number.size(); ++idx)
+        {
+            unsigned value = (remainder << 8) | number[idx];
+            number[idx] = value / 10;
+            remainder = value % 10;
+        }
+        digits += char('0' + remainder);
+    }
+
+    return digits;
+}
+}
+
+UidGenerator::UidGenerator(const std::string& root, quint64 firstCount)
+    : m_counter(firstCount)
+{
+    std::string prefixRoot = root.empty() ? UidGenerator::root() : root;
+    if (prefixRoot.size() > MaxRootLength)
+        prefixRoot = gdcm::UIDGenerator::GetGDCMUID();
+
+    std::size_t numDigits = std::min(MaxUniqueDigits, MaxUidLength - prefixRoot.size() - 2 - 1 - CounterDigits);
+
+    // The leading 1 keeps the component from starting with a zero.
+    m_prefix = prefixRoot + ".1" + UniqueDigits(numDigits);
+}
+
+std::string UidGenerator::generate()
+{
+    quint64 count = m_counter.fetchAndAddRelaxed(1) + 1;
+
+    // No conversion comes near this, but the UID must not grow past 64 characters.
+    if (count > MaxCounter)
+    {
+        gdcm::UIDGenerator generator;
+        return generator.Generate();
+    }
+
+    std::string uid;
+    uid.reserve(m_prefix.size() + 1 + CounterDigits);
+    uid += m_prefix;
+    uid += '.';
+    uid += std::to_string(count);
+    return uid;
+}
+
+bool UidGenerator::setRoot(const std::string& root)
+{
+    if (!isValidUid(root) || root.size() > MaxRootLength)
+        return false;
+
+    QMutexLocker locker(&RootMutex());
+    RootStorage() = root;
+    return true;
+}
+
+std::string UidGenerator::root()
+{
+    QMutexLocker locker(&RootMutex());
+    if (RootStorage().empty())
+        return gdcm::UIDGenerator::GetRoot();
+
+    return RootStorage();
+}
+
+bool UidGenerator::isValidUid(const std::string& uid)
+{
+    if (uid.empty() || uid.size() > MaxUidLength)
+        return false;
+
+    std::size_t componentStart = 0;
+    for (std::size_t idx = 0; idx <= uid.size(); ++idx)
+    {
+        if (idx == uid.size() || uid[idx] == '.')
+        {
+            std::size_t length = idx - componentStart;
+            if (length == 0 || (length > 1 && uid[componentStart] == '0'))
+                return false;
+            componentStart = idx + 1;
+        }
+        else if (uid[idx] < '0' || uid[idx] > '9')
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
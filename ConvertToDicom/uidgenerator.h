@@ -0,0 +1,89 @@
+//
+//  uidgenerator.h
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef UIDGENERATOR_H
+#define UIDGENERATOR_H
+
+#include <QAtomicInteger>
+
+#include <string>
+
+/**
+ * Makes DICOM UIDs without going to the system for each one. When it is made the generator
+ * takes a prefix which is unique to it: the organisation's root followed by a component made
+ * from a random UUID. Each UID is then the prefix followed by the next value of a counter.
+ * Several threads may call generate() at once. The root is set once for the whole program
+ * with setRoot(); until then GDCM's root is used.
+ */
+class UidGenerator
+{
+public:
+    /**
+     * Constructor. This derives the prefix, which is the only time randomness is needed.
+     * @param root The organisation's UID root. If empty the one given to setRoot() is used.
+     * @param firstCount The counter starts after this. Only the tests need anything but 0, to
+     * reach the end of the counter.
+     */
+    explicit UidGenerator(const std::string& root = std::string(), quint64 firstCount = 0);
+
+    /**
+     * Make a new UID. This is thread safe and does not lock.
+     * @return The UID. It is unique among those made by every generator.
+     */
+    std::string generate();
+
+    /**
+     * Get the part which every UID from this generator begins with.
+     * @return The prefix, without the trailing dot.
+     */
+    const std::string& prefix() const
+    {
+        return m_prefix;
+    }
+
+    /**
+     * Set the organisation's UID root used by generators made from now on.
+     * @param root The root, such as 1.2.826.0.1.3680043.2.1143.
+     * @return false if the root is not a valid UID or is too long to leave room for the
+     * unique part, in which case the root is not changed.
+     */
+    static bool setRoot(const std::string& root);
+
+    /**
+     * Get the organisation's UID root.
+     * @return The root given to setRoot(), or GDCM's if there has been none.
+     */
+    static std::string root();
+
+    /**
+     * Check that a string is a valid DICOM UID: at most 64 characters of numeric components
+     * separated by dots, with no leading zeros.
+     * @param uid The string.
+     * @return true if it is valid.
+     */
+    static bool isValidUid(const std::string& uid);
+
+private:
+    std::string m_prefix;               ///< Root and unique component.
+    QAtomicInteger<quint64> m_counter;  ///< Number of UIDs made.
+};
+
+#endif // UIDGENERATOR_H
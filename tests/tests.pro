@@ -0,0 +1,10 @@
+#-------------------------------------------------
+#
+# Tests of ConvertToDicom. Build and run with
+#   qmake && make && make check
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += uidgenerator
@@ -0,0 +1,192 @@
+//
+//  tst_uidgenerator.cpp
+//  ConvertToDicom
+//
+
+/* ConvertToDicom converts a series of images to DICOM format from any format recognized
+ * by ITK (http://www.itk.org).
+ * Copyright (C) 2018 Tim Allman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "uidgenerator.h"
+
+#include <QCoreApplication>
+#include <QProcess>
+#include <QSet>
+#include <QStringList>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QVector>
+#include <QtConcurrent>
+#include <QtTest>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+const int UidsPerWorker = 20000;
+const int NumberOfThreads = 8;
+const int NumberOfProcesses = 4;
+
+// A child process is this program run with this argument and a count.
+const char* GenerateOption = "--generate-uids";
+
+// The last value of the counter which UidGenerator writes into a UID.
+const quint64 MaxCounter = 9999999999ull;
+
+/**
+ * The longest root UidGenerator::setRoot() takes: 35 characters.
+ */
+std::string LongestRoot()
+{
+    return "1." + std::string(33, '9');
+}
+
+/**
+ * Write UIDs to stdout, one a line, for the parent process to read.
+ */
+int GenerateUids(int count)
+{
+    UidGenerator generator;
+    QTextStream out(stdout);
+    for (int idx = 0; idx < count; ++idx)
+        out << QString::fromStdString(generator.generate()) << "\n";
+    out.flush();
+    return 0;
+}
+}
+
+/**
+ * Tests of UidGenerator.
+ */
+class TestUidGenerator : public QObject
+{
+    Q_OBJECT
+
+private:
+    /**
+     * Check that a UID is valid and is not in the set, then add it.
+     */
+    void addUid(QSet<QString>& uids, const std::string& uid)
+    {
+        QVERIFY2(UidGenerator::isValidUid(uid), uid.c_str());
+        QVERIFY2(uid.size() <= 64, uid.c_str());
+        QVERIFY2(!uids.contains(QString::fromStdString(uid)), uid.c_str());
+        uids.insert(QString::fromStdString(uid));
+    }
+
+private slots:
+    void uniqueAcrossThreads()
+    {
+        UidGenerator generator;
+        std::vector<std::vector<std::string> > threadUids(NumberOfThreads);
+        // A pool of its own so that every thread runs at once, however many cores there are.
+        QThreadPool pool;
+        pool.setMaxThreadCount(NumberOfThreads);
+        QVector<QFuture<void> > futures;
+        for (int thread = 0; thread < NumberOfThreads; ++thread)
+        {
+            std::vector<std::string>* uids = &threadUids[std::size_t(thread)];
+            futures.append(QtConcurrent::run(&pool, [&generator, uids]()
+            {
+                for (int idx = 0; idx < UidsPerWorker; ++idx)
+                    uids->push_back(generator.generate());
+            }));
+        }
+        for (int thread = 0; thread < futures.size(); ++thread)
+            futures[thread].waitForFinished();
+
+        QSet<QString> uids;
+        for (std::size_t thread = 0; thread < threadUids.size(); ++thread)
+        {
+            for (std::size_t idx = 0; idx < threadUids[thread].size(); ++idx)
+                addUid(uids, threadUids[thread][idx]);
+        }
+        QCOMPARE(uids.size(), NumberOfThreads * UidsPerWorker);
+    }
+
+    void uniqueAcrossProcesses()
+    {
+        std::vector<QProcess*> processes;
+        for (int process = 0; process < NumberOfProcesses; ++process)
+        {
+            processes.push_back(new QProcess);
+            processes.back()->start(QCoreApplication::applicationFilePath(),
+                                    QStringList() << GenerateOption << QString::number(UidsPerWorker));
+        }
+
+        // This process makes some too, with its own generator.
+        QSet<QString> uids;
+        UidGenerator generator;
+        for (int idx = 0; idx < UidsPerWorker; ++idx)
+            addUid(uids, generator.generate());
+
+        for (std::size_t process = 0; process < processes.size(); ++process)
+        {
+            QProcess* child = processes[process];
+            QVERIFY(child->waitForFinished(60000));
+            QCOMPARE(child->exitCode(), 0);
+            QStringList lines = QString::fromLatin1(child->readAllStandardOutput()).split('\n', QString::SkipEmptyParts);
+            QCOMPARE(lines.size(), UidsPerWorker);
+            for (int idx = 0; idx < lines.size(); ++idx)
+                addUid(uids, lines[idx].toStdString());
+            delete child;
+        }
+        QCOMPARE(uids.size(), (NumberOfProcesses + 1) * UidsPerWorker);
+    }
+
+    void longestRoot()
+    {
+        std::string root = LongestRoot();
+        QCOMPARE(root.size(), std::size_t(35));
+        QVERIFY(!UidGenerator::setRoot(root + "9"));
+
+        UidGenerator generator(root);
+        QVERIFY(generator.prefix().compare(0, root.size() + 1, root + ".") == 0);
+
+        QSet<QString> uids;
+        for (int idx = 0; idx < 1000; ++idx)
+            addUid(uids, generator.generate());
+    }
+
+    void counterLimit()
+    {
+        // The last UIDs with the counter are exactly 64 characters long with the longest root,
+        // and those after it must still be valid.
+        UidGenerator generator(LongestRoot(), MaxCounter - 2);
+        QSet<QString> uids;
+        for (int idx = 0; idx < 2; ++idx)
+        {
+            std::string uid = generator.generate();
+            QCOMPARE(uid.size(), std::size_t(64));
+            addUid(uids, uid);
+        }
+        for (int idx = 0; idx < 100; ++idx)
+            addUid(uids, generator.generate());
+    }
+};
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    if ((argc == 3) && (QString(argv[1]) == GenerateOption))
+        return GenerateUids(QString(argv[2]).toInt());
+
+    TestUidGenerator test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_uidgenerator.moc"
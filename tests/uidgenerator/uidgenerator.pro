@@ -0,0 +1,45 @@
+#-------------------------------------------------
+#
+# Uniqueness and validity of the UIDs made by UidGenerator, across threads and processes.
+#
+#-------------------------------------------------
+
+QT       += core concurrent testlib
+QT       -= gui
+
+TARGET = tst_uidgenerator
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += tst_uidgenerator.cpp \
+    ../../ConvertToDicom/uidgenerator.cpp
+
+HEADERS += ../../ConvertToDicom/uidgenerator.h
+
+INCLUDEPATH += $$PWD/../../ConvertToDicom
+
+# UidGenerator falls back on gdcm, which comes with ITK.
+ITKLIBDIR = -L/Users/tim/usr/local/ITK-4.11/x86_64/Release/lib
+
+ITKLIBS +=  -lITKgdcmMSFF-4.11 \
+            -lITKgdcmDSED-4.11 \
+            -lITKgdcmDICT-4.11 \
+            -lITKgdcmIOD-4.11 \
+            -lITKgdcmCommon-4.11 \
+            -lITKgdcmuuid-4.11 \
+            -lITKCommon-4.11 \
+            -lITKsys-4.11 \
+            -lITKvnl-4.11 \
+            -lITKvcl-4.11 \
+            -lITKdouble-conversion-4.11 \
+            -lITKzlib-4.11
+
+LIBS += $$ITKLIBDIR $$ITKLIBS
+macx: LIBS += -framework Foundation
+
+INCLUDEPATH += $$PWD/../../../../usr/local/include
+INCLUDEPATH += /opt/local/include
+INCLUDEPATH += $$PWD/../../../../usr/local/ITK-4.11/x86_64/Release/include/ITK-4.11